@@ -5,6 +5,7 @@
 #include "core/cmdlib.h"
 #include "core/dktypes.h"
 #include "util/image.h"
+#include "util/image_convert.h"
 #include "util/util.h"
 
 #include <string.h>
@@ -53,6 +54,9 @@ const int BG_SPLICE_W = 64;
 const int BG_SPLICE_H = 256;
 const int BG_SPLICE_SIZE = BG_SPLICE_W * 2 * BG_SPLICE_H;
 
+// write RLE compressed TGA files
+bool g_tgaRLE = false;
+
 void CopyTpageImage(const ushort* tp_src, ushort* dst, int x, int y, int dst_w, int dst_h)
 {
 	const ushort* src = tp_src + x + 128 * y;
@@ -80,48 +84,50 @@ void ExportSkyImage(const char* skyFileName, const ubyte* data, int x_idx, int y
 		imageCopy, 64 * SKY_SIZE_H, 0, 0, SKY_SIZE_W*2, SKY_SIZE_H, (ubyte*)imageClut, 1);
 }
 
-void ConvertSkyIndexedImage8(uint* colorData, const ubyte* srcIndexed, int x_idx, int y_idx, bool outputBGR, bool originalTransparencyKey)
+struct SkyImageRows_t
 {
-	ushort imageClut[16];
-
-	int clut_x = x_idx * 16;
-	int clut_y = SKY_CLUT_START_Y + y_idx;
+	const ubyte*	srcIndexed;
+	uint			palettes[3][4][16];
+};
 
-	CopyTpageImage((ushort*)srcIndexed, (ushort*)imageClut, clut_x, clut_y, 16, 1);
-	
-	int ox = x_idx * SKY_SIZE_W * 2;
-	int oy = y_idx * SKY_SIZE_H;
-	int w = SKY_SIZE_W * 2;
-	int h = SKY_SIZE_H;
+void InitSkyImageRows(SkyImageRows_t& sky, const ubyte* srcIndexed, bool outputBGR, bool originalTransparencyKey)
+{
+	sky.srcIndexed = srcIndexed;
 
-	int tp_wx = ox + w;
-	int tp_hy = oy + h;
-	
-	for (int y = oy; y < tp_hy; y++)
+	// 3x4 images, each has own CLUT
+	for (int y_idx = 0; y_idx < 3; y_idx++)
 	{
-		for (int x = ox; x < tp_wx; x++)
+		for (int x_idx = 0; x_idx < 4; x_idx++)
 		{
-			ubyte clindex = srcIndexed[y * 256 + x / 2];
+			ushort imageClut[16];
+			CopyTpageImage((ushort*)srcIndexed, (ushort*)imageClut, x_idx * 16, SKY_CLUT_START_Y + y_idx, 16, 1);
 
-			if (0 != (x & 1))
-				clindex >>= 4;
+			MakePalette_RGBA8(sky.palettes[y_idx][x_idx], imageClut, outputBGR, originalTransparencyKey);
+		}
+	}
+}
 
-			clindex &= 0xF;
+// converts 512 pixel row of sky sheet, y goes from bottom as TGA is flipped by Y
+void GetSkyImageRow(ubyte* row, int y, void* userData)
+{
+	SkyImageRows_t* sky = (SkyImageRows_t*)userData;
 
-			// flip texture by Y
-			int ypos = (256 - y - 1) * 512;
+	const int src_y = 255 - y;
+	const int y_idx = src_y / SKY_SIZE_H;
 
-			if (outputBGR)
-			{
-				TVec4D<ubyte> color = rgb5a1_ToBGRA8(imageClut[clindex], originalTransparencyKey);
-				colorData[ypos + x] = *(uint*)(&color);
-			}
-			else
-			{
-				TVec4D<ubyte> color = rgb5a1_ToRGBA8(imageClut[clindex], originalTransparencyKey);
-				colorData[ypos + x] = *(uint*)(&color);
-			}
-		}
+	// CLUT rows are not part of image
+	if (y_idx >= 3)
+	{
+		memset(row, 0, 512 * sizeof(uint));
+		return;
+	}
+
+	const ubyte* srcRow = sky->srcIndexed + src_y * 256;
+
+	for (int x_idx = 0; x_idx < 4; x_idx++)
+	{
+		const int ox = x_idx * SKY_SIZE_W * 2;
+		ConvertIndexed4ToRGBA8((uint*)row + ox, srcRow, ox, SKY_SIZE_W * 2, sky->palettes[y_idx][x_idx]);
 	}
 }
 
@@ -200,15 +206,9 @@ void ConvertSky(const char* skyFileName, bool saveTGA)
 	const int OFFSET_STEP = 0x10000;
 
 #define SKY_TEX_CHANNELS 4
-#define SKY_TEXPAGE_SIZE		(512*256)
-	
-	uint* color_data;
-	int imgSize = SKY_TEXPAGE_SIZE * SKY_TEX_CHANNELS;
-	
+
 	if(saveTGA)
 	{
-		color_data = (uint*)malloc(imgSize);
-
 		MsgInfo("Converting '%s' to separata TGAs...\n", skyFileName);
 	}
 	else
@@ -224,7 +224,12 @@ void ConvertSky(const char* skyFileName, bool saveTGA)
 
 		if (saveTGA)
 		{
-			memset(color_data, 0, imgSize);
+			// rows are converted while writing
+			SkyImageRows_t skyRows;
+			InitSkyImageRows(skyRows, skyImage, true, true);
+
+			SaveTGAByRows(varargs("%s_%d.TGA", skyFileName, i), 512, 256, SKY_TEX_CHANNELS, g_tgaRLE, GetSkyImageRow, &skyRows);
+			continue;
 		}
 
 		// 3x4 images (128x84 makes 256x252 tpage)
@@ -232,26 +237,9 @@ void ConvertSky(const char* skyFileName, bool saveTGA)
 		{
 			for (int x = 0; x < 4; x++, n++)
 			{
-				if(saveTGA)
-				{
-					ConvertSkyIndexedImage8(color_data, skyImage, x, y, true, true);
-				}
-				else
-				{
-					ExportSkyImage(skyFileName, skyImage, x, y, i, n);
-				}
+				ExportSkyImage(skyFileName, skyImage, x, y, i, n);
 			}
 		}
-
-		if(saveTGA)
-		{
-			SaveTGA(varargs("%s_%d.TGA", skyFileName, i), (ubyte*)color_data, 512, 256, SKY_TEX_CHANNELS);
-		}
-	}
-
-	if (saveTGA)
-	{
-		free(color_data);
 	}
 
 	MsgInfo("Done!\n");
@@ -654,13 +642,13 @@ void ConvertTex(const char* fileName)
 				MsgInfo("wut\n");
 
 			ConvertIndexedTexImage8(colorData, parentTextureMem, (PalEntry*)palette[parentData]);
-			SaveTGA(varargs("%s_par_%d.TGA", fileName, i), (ubyte*)colorData, 256, 256, 4);
+			SaveTGA(varargs("%s_par_%d.TGA", fileName, i), (ubyte*)colorData, 256, 256, 4, g_tgaRLE);
 
 			if (!palettePresent[childData])
 				MsgInfo("wut\n");
 
 			ConvertIndexedTexImage8(colorData, childTextureMem, (PalEntry*)palette[childData]);
-			SaveTGA(varargs("%s_chi_%d.TGA", fileName, i), (ubyte*)colorData, 256, 256, 4);
+			SaveTGA(varargs("%s_chi_%d.TGA", fileName, i), (ubyte*)colorData, 256, 256, 4, g_tgaRLE);
 
 			child = parent + 1;
 
@@ -676,7 +664,7 @@ void ConvertTex(const char* fileName)
 				MsgInfo("wut\n");
 
 			ConvertIndexedTexImage16(colorData, (ushort*)parentTextureMem);
-			SaveTGA(varargs("%s_%d.TGA", fileName, i), (ubyte*)colorData, 256, 256, SKY_TEX_CHANNELS);
+			SaveTGA(varargs("%s_%d.TGA", fileName, i), (ubyte*)colorData, 256, 256, SKY_TEX_CHANNELS, g_tgaRLE);
 		}
 	}
 
@@ -853,7 +841,7 @@ void ConvertTsd(const char* fileName)
 		else
 			ConvertTsdImage16(colorData, (ushort*)textureMem);
 
-		SaveTGA(varargs("%s_tset_%d.TGA", fileName, i), (ubyte*)colorData, 256, 256, 4);
+		SaveTGA(varargs("%s_tset_%d.TGA", fileName, i), (ubyte*)colorData, 256, 256, 4, g_tgaRLE);
 
 		fseek(fp, tsetStart + tsetInfo.length, SEEK_SET);
 		free(textureNames);
@@ -876,6 +864,7 @@ void PrintCommandLineArguments()
 	MsgInfo("\tDriverImageTool -tim2raw GFX.RAW BG.tim <FontAndSelection.tim Image3.tim ..>\n");
 	MsgInfo("\tDriverImageTool -tex2tga frontend.tex\n");
 	MsgInfo("\tDriverImageTool -tsd2tga frontend.tsd\n");
+	MsgInfo("\tDriverImageTool -tgarle -sky2tga SKY1.RAW\t(RLE compressed TGA, must be before conversion)\n");
 }
 
 int main(int argc, char** argv)
@@ -894,7 +883,11 @@ int main(int argc, char** argv)
 
 	for (int i = 0; i < argc; i++)
 	{
-		if (!stricmp(argv[i], "-sky2tim"))
+		if (!stricmp(argv[i], "-tgarle"))
+		{
+			g_tgaRLE = true;
+		}
+		else if (!stricmp(argv[i], "-sky2tim"))
 		{
 			if (i + 1 <= argc)
 				ConvertSky(argv[i + 1], false);
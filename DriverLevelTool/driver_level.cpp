@@ -7,10 +7,12 @@
 
 #include "model_compiler/compiler.h"
 #include "util/util.h"
+#include "util/image_compress.h"
 #include "viewer/viewer.h"
 
 #include "driver_routines/regions_d1.h"
 #include "driver_routines/regions_d2.h"
+#include "driver_routines/roadroute_d2.h"
 
 #include <nstd/String.hpp>
 #include <nstd/Directory.hpp>
@@ -25,11 +27,33 @@ bool g_export_worldUnityScript = false;
 
 bool g_export_textures = false;
 bool g_explode_tpages = false;
+bool g_export_texdedup = false;
+int g_export_texformat = 0;		// ETextureFileFormat
+bool g_export_texbc3 = false;
+String g_export_texcache;
+bool g_export_tgarle = false;
 
 bool g_export_overmap = false;
 
+int g_export_jobs = 0;
+
+int g_export_atlas_size = 0;
+
 int g_overlaymap_width = 0;
 
+bool g_print_route = false;
+bool g_route_ailanes = false;
+bool g_route_ch = false;
+XZPAIR g_route_from = { 0 };
+XZPAIR g_route_to = { 0 };
+
+bool g_road_report = false;
+int g_road_report_height = 256;
+
+bool g_model_bench = false;
+
+bool g_float_model_vertices = false;
+
 //---------------------------------------------------------------------------------------------------------------------------------
 
 OUT_CITYLUMP_INFO		g_levInfo;
@@ -52,6 +76,14 @@ void ExportLevelData()
 {
 	Msg("-------------\nExporting level data\n-------------\n");
 
+	const bool exportAtlas = g_export_atlas_size > 0 && (g_export_models || g_export_carmodels || g_export_world);
+
+	if (exportAtlas)
+	{
+		Directory::create(g_levname_texdir);
+		BuildTextureAtlas(g_export_atlas_size);
+	}
+
 	if (g_export_models || g_export_carmodels)
 	{
 		Directory::create(g_levname_moddir);
@@ -88,6 +120,24 @@ void ExportLevelData()
 		ExportOverlayMap();
 	}
 
+	if (exportAtlas)
+		FreeTextureAtlas();
+
+	if (g_print_route)
+	{
+		PrintRoadRoute(g_route_from, g_route_to, g_route_ailanes ? ROAD_ROUTE_AI_LANES_ONLY : 0, g_route_ch);
+	}
+
+	if (g_road_report)
+	{
+		PrintRoadReport(g_road_report_height);
+	}
+
+	if (g_model_bench)
+	{
+		BenchmarkModelBuffers();
+	}
+
 	Msg("Export done\n");
 }
 
@@ -114,7 +164,14 @@ void ExportLevelFile()
 	else
 		g_levMap = new CDriver1LevelMap();
 
-	levLoader.Initialize(g_levInfo, &g_levTextures, &g_levModels, g_levMap);
+	// road tools only need map and road lumps, skip models and textures
+	const bool roadDataOnly = (g_print_route || g_road_report) &&
+		!(g_export_models || g_export_carmodels || g_export_world || g_export_textures || g_export_overmap || g_model_bench);
+
+	if (roadDataOnly)
+		levLoader.Initialize(g_levInfo, nullptr, nullptr, g_levMap);
+	else
+		levLoader.Initialize(g_levInfo, &g_levTextures, &g_levModels, g_levMap);
 
 	if (levLoader.Load(&stream))
 	{
@@ -181,6 +238,22 @@ void PrintCommandLineArguments()
 		"  -extractmodels \t: Extracts MDLs instead of exporting to OBJ\n\n"
 		"  -overmap <width> \t: Extract overlay map with specified width\n\n"
 		"  -explodetpages \t: Extracts textures as separate TIM files instead of whole texture page exporting as TGA\n\n"
+		"  -texformat <tga/dds/ktx> \t: Exported texture file format. DDS and KTX have mipmaps and are BC1 compressed\n\n"
+		"  -texbc3 \t: Use BC3 instead of BC1 for DDS and KTX to keep semi-transparency alpha\n\n"
+		"  -tgarle \t: Writes RLE compressed TGA files\n\n"
+		"  -texcache <dir> \t: Keeps exported textures in directory by content hash and copies them instead of converting again\n\n"
+		"  -texdedup \t: Writes unique detail images for extra palettes with PALETTE_VARIANTS.ini table instead of page per palette\n\n"
+		"  -atlas <size> \t: Packs texture details into <size> x <size> atlases and uses them in exported models\n\n"
+		"  -j <n> \t: Number of threads used for texture export, 0 = all CPU cores (default)\n\n"
+		"  -route <x1> <z1> <x2> <z2> \t: Computes shortest road route between two world points (Driver 2)\n\n"
+		"  -routeai \t: Route using AI lanes only\n\n"
+		"  -routech \t: Build contraction hierarchy before route query\n\n"
+		"  -roadreport [height] \t: Prints road network statistics and validation report, reports height jumps over [height], 256 by default (Driver 2)\n\n"
+		"  -modelbench \t: Benchmarks render buffer generation on all level models\n\n"
+		"  -texconvbench \t: Benchmarks 4 bit texture conversion kernels and checks they are bit-exact\n\n"
+		"  -benchmark [frames] \t: Flies camera over the level in viewer for [frames], 600 by default, and prints CPU frame, spool and draw statistics\n\n"
+		"  -nullrenderer \t: Use renderer without window and GPU for -benchmark\n\n"
+		"  -floatvertices \t: Use float vertices for models in viewer instead of packed ones\n\n"
 		"  -mdl2obj <filename.MDL> <output.OBJ> \t: converts MDL to OBJ file\n\n";
 		"  -compilemdl <filename.OBJ> <output.MDL> \t: compiles OBJ to MDL file\n\n";
 		"  -denting \t: enables car denting file generation for next -compilemodel key\n\n";
@@ -203,6 +276,8 @@ int main(int argc, char* argv[])
 
 	bool generate_denting = false;
 	int main_routine = 2;
+	int viewer_benchmark_frames = 0;
+	bool viewer_null_renderer = false;
 
 	for (int i = 1; i < argc; i++)
 	{
@@ -242,6 +317,43 @@ int main(int argc, char* argv[])
 		{
 			g_explode_tpages = true;
 		}
+		else if (!stricmp(argv[i], "-texformat"))
+		{
+			if (!stricmp(argv[i + 1], "dds"))
+				g_export_texformat = TEXFILE_DDS;
+			else if (!stricmp(argv[i + 1], "ktx"))
+				g_export_texformat = TEXFILE_KTX;
+			else
+				g_export_texformat = TEXFILE_TGA;
+			i++;
+		}
+		else if (!stricmp(argv[i], "-texbc3"))
+		{
+			g_export_texbc3 = true;
+		}
+		else if (!stricmp(argv[i], "-tgarle"))
+		{
+			g_export_tgarle = true;
+		}
+		else if (!stricmp(argv[i], "-texcache"))
+		{
+			g_export_texcache = argv[i + 1];
+			i++;
+		}
+		else if (!stricmp(argv[i], "-texdedup"))
+		{
+			g_export_texdedup = true;
+		}
+		else if (!stricmp(argv[i], "-atlas"))
+		{
+			g_export_atlas_size = atoi(argv[i + 1]);
+			i++;
+		}
+		else if (!stricmp(argv[i], "-j"))
+		{
+			g_export_jobs = atoi(argv[i + 1]);
+			i++;
+		}
 		else if (!stricmp(argv[i], "-overmap"))
 		{
 			g_export_overmap = true;
@@ -249,6 +361,68 @@ int main(int argc, char* argv[])
 			main_routine = 1;
 			i++;
 		}
+		else if (!stricmp(argv[i], "-route"))
+		{
+			g_print_route = true;
+			g_route_from.x = atoi(argv[i + 1]);
+			g_route_from.z = atoi(argv[i + 2]);
+			g_route_to.x = atoi(argv[i + 3]);
+			g_route_to.z = atoi(argv[i + 4]);
+			main_routine = 1;
+			i += 4;
+		}
+		else if (!stricmp(argv[i], "-routeai"))
+		{
+			g_route_ailanes = true;
+		}
+		else if (!stricmp(argv[i], "-routech"))
+		{
+			g_route_ch = true;
+		}
+		else if (!stricmp(argv[i], "-roadreport"))
+		{
+			g_road_report = true;
+
+			// height is optional, only consumed when it's a positive number
+			if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+			{
+				g_road_report_height = atoi(argv[i + 1]);
+				i++;
+			}
+
+			main_routine = 1;
+		}
+		else if (!stricmp(argv[i], "-modelbench"))
+		{
+			g_model_bench = true;
+			main_routine = 1;
+		}
+		else if (!stricmp(argv[i], "-benchmark"))
+		{
+			viewer_benchmark_frames = VIEWER_BENCHMARK_DEFAULT_FRAMES;
+
+			// frame count is optional, only consumed when it's a positive number
+			if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+			{
+				viewer_benchmark_frames = atoi(argv[i + 1]);
+				i++;
+			}
+
+			main_routine = 3;
+		}
+		else if (!stricmp(argv[i], "-nullrenderer"))
+		{
+			viewer_null_renderer = true;
+		}
+		else if (!stricmp(argv[i], "-floatvertices"))
+		{
+			g_float_model_vertices = true;
+		}
+		else if (!stricmp(argv[i], "-texconvbench"))
+		{
+			BenchmarkTextureConversion();
+			main_routine = 0;
+		}
 		else if (!stricmp(argv[i], "-mdl2obj"))
 		{
 			ConvertMDLToOBJ(argv[i + 1], argv[i + 2]);
@@ -300,6 +474,10 @@ int main(int argc, char* argv[])
 	{
 		ViewerMain();
 	}
+	else if (main_routine == 3)
+	{
+		ViewerBenchmark(viewer_benchmark_frames, viewer_null_renderer);
+	}
 
 	return 0;
 }
\ No newline at end of file
@@ -8,6 +8,8 @@
 
 #include "math/Matrix.h"
 
+#include <stdio.h>
+
 //----------------------------------------------------------
 
 #define EXPORT_SCALING			(1.0f / ONE_F)
@@ -76,7 +78,22 @@ void ExportAllCarModels();
 
 void ExportRegions(const ModelExportFilters& filters, bool* regionsToExport = nullptr);
 
+const char* GetExportTextureExt();
+void SaveExportTexture(const char* fileName, uint* color_data, int w, int h);
+
+void PreloadAreaTPages();
 void ExportAllTextures();
 void ExportOverlayMap();
+void BenchmarkTextureConversion();
+void BenchmarkModelBuffers();
+
+void BuildTextureAtlas(int atlasSize);
+void FreeTextureAtlas();
+int GetTextureAtlasCount();
+int MapToTextureAtlas(int page, int detail, int u, int v, float& outU, float& outV);
+void WriteTextureAtlasMaterials(FILE* pMtlFile, const char* textureDir);
+
+void PrintRoadRoute(const XZPAIR& from, const XZPAIR& to, int routeFlags, bool useContractionHierarchy);
+void PrintRoadReport(int heightThreshold);
 
 #endif
\ No newline at end of file
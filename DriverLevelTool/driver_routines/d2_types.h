@@ -8,6 +8,7 @@
 #define TEXPAGE_SIZE_Y	(256)
 
 #define TEXPAGE_4BIT_SIZE	(TEXPAGE_SIZE_X*TEXPAGE_SIZE_Y)
+#define TEXPAGE_4BIT_PACKED_MAX_SIZE	(TEXPAGE_4BIT_SIZE + TEXPAGE_4BIT_SIZE / 128)	// all literal runs
 #define TEXPAGE_SIZE		(TEXPAGE_SIZE_Y*TEXPAGE_SIZE_Y)
 
 enum ETextureSetFlags
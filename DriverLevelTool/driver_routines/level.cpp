@@ -355,6 +355,10 @@ bool CDriverLevelLoader::Load(IVirtualStream* pStream)
 	if (m_format == LEV_FORMAT_DRIVER1_OLD)
 	{
 		ProcessLumps(pStream);
+
+		if (m_map)
+			m_map->OnLumpsLoaded();
+
 		return true;
 	}
 
@@ -429,5 +433,8 @@ bool CDriverLevelLoader::Load(IVirtualStream* pStream)
 	// read sublumps
 	ProcessLumps(pStream);
 
+	if (m_map)
+		m_map->OnLumpsLoaded();
+
 	return true;
 }
\ No newline at end of file
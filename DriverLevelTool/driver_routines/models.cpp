@@ -2,6 +2,7 @@
 #include "core/IVirtualStream.h"
 
 #include <nstd/HashSet.hpp>
+#include <nstd/Mutex.hpp>
 
 #include "models.h"
 
@@ -9,6 +10,53 @@
 
 //--------------------------------------------------------------------------------
 
+CModelArena::~CModelArena()
+{
+	FreeAll();
+}
+
+void CModelArena::Reserve(int size)
+{
+	if (m_blocks.size())
+	{
+		const block_t& last = m_blocks.back();
+
+		if (last.size - last.used >= size)
+			return;
+	}
+
+	block_t& block = m_blocks.append(block_t());
+	block.size = size > MODEL_ARENA_BLOCK_SIZE ? size : MODEL_ARENA_BLOCK_SIZE;
+	block.data = (ubyte*)Memory::alloc(block.size);
+	block.used = 0;
+}
+
+void* CModelArena::Alloc(int size)
+{
+	size = (size + MODEL_ARENA_ALIGNMENT - 1) & ~(MODEL_ARENA_ALIGNMENT - 1);
+
+	Reserve(size);
+
+	block_t& block = m_blocks.back();
+	void* ptr = block.data + block.used;
+
+	block.used += size;
+	m_usedSize += size;
+
+	return ptr;
+}
+
+void CModelArena::FreeAll()
+{
+	for (usize i = 0; i < m_blocks.size(); i++)
+		Memory::free(m_blocks[i].data);
+
+	m_blocks.clear();
+	m_usedSize = 0;
+}
+
+//--------------------------------------------------------------------------------
+
 CDriverLevelModels::CDriverLevelModels()
 {
 
@@ -16,6 +64,8 @@ CDriverLevelModels::CDriverLevelModels()
 
 CDriverLevelModels::~CDriverLevelModels()
 {
+	for (usize i = 0; i < m_areaModelArenas.size(); i++)
+		delete m_areaModelArenas[i];
 }
 
 void CDriverLevelModels::FreeAll()
@@ -25,28 +75,42 @@ void CDriverLevelModels::FreeAll()
 		ModelRef_t& ref = m_levelModels[i];
 
 		OnModelFreed(&ref);
-		
-		if (ref.model)
-			Memory::free(ref.model);
+
+		ref.model = nullptr;
 	}
 
+	// model data is released in bulk
+	m_levelModelsArena.FreeAll();
+
+	for (usize i = 0; i < m_areaModelArenas.size(); i++)
+	{
+		if (m_areaModelArenas[i])
+			m_areaModelArenas[i]->FreeAll();
+	}
+
+	FreeCarModels();
+
+	m_model_names.clear();
+}
+
+void CDriverLevelModels::FreeCarModels()
+{
 	for (int i = 0; i < MAX_CAR_MODELS; i++)
 	{
 		CarModelData_t& carModelData = m_carModels[i];
 
-		OnCarModelFreed(&carModelData);
-		
-		if (carModelData.cleanmodel)
-			Memory::free(carModelData.cleanmodel);
-
-		if (carModelData.dammodel)
-			Memory::free(carModelData.dammodel);
+		if (m_carModelsData)
+			OnCarModelFreed(&carModelData);
 
-		if (carModelData.lowmodel)
-			Memory::free(carModelData.lowmodel);
+		carModelData = CarModelData_t();
 	}
 
-	m_model_names.clear();
+	// all car models are in lump data
+	if (m_carModelsData)
+		Memory::free(m_carModelsData);
+
+	m_carModelsData = nullptr;
+	m_carModelsDataSize = 0;
 }
 
 ModelRef_t* CDriverLevelModels::GetModelByIndex(int nIndex) const
@@ -86,6 +150,8 @@ CarModelData_t* CDriverLevelModels::GetCarModel(int index) const
 //-------------------------------------------------------------
 void CDriverLevelModels::LoadCarModelsLump(IVirtualStream* pFile, int size)
 {
+	const int lumpStart = pFile->Tell();
+
 	int modelCount;
 	pFile->Read(&modelCount, sizeof(int), 1);
 
@@ -102,57 +168,64 @@ void CDriverLevelModels::LoadCarModelsLump(IVirtualStream* pFile, int size)
 	if ((uint)model_entries[0].cleanOffset > 100000)
 		return;
 
-	// position
-	int r_ofs = pFile->Tell();
+	// offsets are relative to this position
+	const int r_ofs = pFile->Tell();
+	const int dataSize = size - (r_ofs - lumpStart);
+
+	if (dataSize <= 0)
+	{
+		MsgWarning("Car models lump has no model data\n");
+		return;
+	}
+
+	FreeCarModels();
+
+	// read all models at once, car models point into this data
+	m_carModelsData = (ubyte*)Memory::alloc(dataSize);
+	m_carModelsDataSize = dataSize;
 
-	int pad; // really padding?
-	pFile->Read(&pad, sizeof(int), 1);
+	pFile->Read(m_carModelsData, 1, dataSize);
 
-	// load car models
 	for (int i = 0; i < MAX_CAR_MODELS; i++)
 	{
 		DevMsg(SPEW_NORM, "car model: %d %d %d\n", model_entries[i].cleanOffset != -1, model_entries[i].damOffset != -1, model_entries[i].lowOffset != -1);
 
 		CarModelData_t& carModelData = m_carModels[i];
-		
-		if (model_entries[i].cleanOffset != -1)
-		{
-			pFile->Seek(r_ofs + model_entries[i].cleanOffset, VS_SEEK_SET);
-
-			pFile->Read(&carModelData.cleanSize, 1, sizeof(int));
-
-			carModelData.cleanmodel = (MODEL*)Memory::alloc(carModelData.cleanSize);
-			pFile->Read(carModelData.cleanmodel, 1, carModelData.cleanSize);
-		}
-		else
-			carModelData.cleanmodel = nullptr;
 
-		if (model_entries[i].damOffset != -1)
-		{
-			pFile->Seek(r_ofs + model_entries[i].damOffset, VS_SEEK_SET);
+		carModelData.cleanmodel = GetCarModelFromLumpData(model_entries[i].cleanOffset, carModelData.cleanSize);
+		carModelData.dammodel = GetCarModelFromLumpData(model_entries[i].damOffset, carModelData.damSize);
+		carModelData.lowmodel = GetCarModelFromLumpData(model_entries[i].lowOffset, carModelData.lowSize);
+	}
 
-			pFile->Read(&carModelData.damSize, 1, sizeof(int));
+	// notify once all models are set up
+	for (int i = 0; i < MAX_CAR_MODELS; i++)
+		OnCarModelLoaded(&m_carModels[i]);
+}
 
-			carModelData.dammodel = (MODEL*)Memory::alloc(carModelData.damSize);
-			pFile->Read(carModelData.dammodel, 1, carModelData.damSize);
-		}
-		else
-			carModelData.dammodel = nullptr;
+// car model in lump is model size followed by MODEL
+MODEL* CDriverLevelModels::GetCarModelFromLumpData(int offset, int& modelSize) const
+{
+	modelSize = 0;
 
-		if (model_entries[i].lowOffset != -1)
-		{
-			pFile->Seek(r_ofs + model_entries[i].lowOffset, VS_SEEK_SET);
+	if (offset == -1)
+		return nullptr;
 
-			pFile->Read(&carModelData.lowSize, 1, sizeof(int));
+	if (offset < 0 || offset + (int)sizeof(int) > m_carModelsDataSize)
+	{
+		MsgWarning("Car model offset %d is outside of lump\n", offset);
+		return nullptr;
+	}
 
-			carModelData.lowmodel = (MODEL*)Memory::alloc(carModelData.lowSize);
-			pFile->Read(carModelData.lowmodel, 1, carModelData.lowSize);
-		}
-		else
-			carModelData.lowmodel = nullptr;
+	const int size = *(int*)(m_carModelsData + offset);
 
-		OnCarModelLoaded(&carModelData);
+	if (size <= 0 || size > m_carModelsDataSize - offset - (int)sizeof(int))
+	{
+		MsgWarning("Car model at offset %d has invalid size %d\n", offset, size);
+		return nullptr;
 	}
+
+	modelSize = size;
+	return (MODEL*)(m_carModelsData + offset + sizeof(int));
 }
 
 //-------------------------------------------------------------
@@ -248,7 +321,7 @@ void CDriverLevelModels::LoadLevelModelsLump(IVirtualStream* pFile)
 		{
 			ModelRef_t& ref = m_levelModels[i];
 			ref.index = i;
-			ref.model = (MODEL*)Memory::alloc(modelSize);
+			ref.model = (MODEL*)m_levelModelsArena.Alloc(modelSize);
 			ref.size = modelSize;
 
 			pFile->Read(ref.model, modelSize, 1);
@@ -272,6 +345,56 @@ void CDriverLevelModels::LoadLevelModelsLump(IVirtualStream* pFile)
 	}
 }
 
+int CDriverLevelModels::GetModelDataSize() const
+{
+	int size = m_levelModelsArena.GetUsedSize();
+
+	for (usize i = 0; i < m_areaModelArenas.size(); i++)
+	{
+		if (m_areaModelArenas[i])
+			size += m_areaModelArenas[i]->GetUsedSize();
+	}
+
+	return size;
+}
+
+CModelArena* CDriverLevelModels::GetAreaModelArena(int areaDataNum)
+{
+	if (areaDataNum < 0)
+		return nullptr;
+
+	while ((int)m_areaModelArenas.size() <= areaDataNum)
+		m_areaModelArenas.append(nullptr);
+
+	if (!m_areaModelArenas[areaDataNum])
+		m_areaModelArenas[areaDataNum] = new CModelArena();
+
+	return m_areaModelArenas[areaDataNum];
+}
+
+void CDriverLevelModels::FreeAreaModels(int areaDataNum)
+{
+	if (areaDataNum < 0 || areaDataNum >= (int)m_areaModelArenas.size() || !m_areaModelArenas[areaDataNum])
+		return;
+
+	for (int i = 0; i < MAX_MODELS; i++)
+	{
+		ModelRef_t& ref = m_levelModels[i];
+
+		if (ref.areaDataNum != areaDataNum)
+			continue;
+
+		OnModelFreed(&ref);
+
+		ref.model = nullptr;
+		ref.size = 0;
+		ref.baseInstance = nullptr;
+		ref.areaDataNum = -1;
+	}
+
+	m_areaModelArenas[areaDataNum]->FreeAll();
+}
+
 void CDriverLevelModels::SetModelLoadingCallbacks(OnModelLoaded_t onLoaded, OnModelFreed_t onFreed)
 {
 	m_onModelLoaded = onLoaded;
@@ -310,6 +433,8 @@ void CDriverLevelModels::OnModelFreed(ModelRef_t* ref)
 {
 	if (m_onModelFreed)
 		m_onModelFreed(ref);
+
+	FreeModelPolys(ref);
 }
 
 void CDriverLevelModels::OnCarModelLoaded(CarModelData_t* data)
@@ -336,6 +461,7 @@ const int PolySizes[56] = {
 };
 
 HashSet<int> g_UnknownPolyTypes;
+static Mutex s_unknownPolyTypesMutex;	// models can be decoded on worker threads
 
 void PrintUnknownPolys()
 {
@@ -363,159 +489,164 @@ void SwapValues(T& a, T& b)
 	b = tmp;
 }
 
-// returns size of face and fills dface_t struct
-// TODO: rework, few variants of faces still looks bad
-int decode_poly(const char* polyList, dpoly_t* out, int forceType /*= -1*/)
+//--------------------------------------------------------------------------------
+// Polygon decoders, one per PSX polygon type. Called through s_decodePolyFuncs
+//--------------------------------------------------------------------------------
+
+typedef void (*DecodePolyFunc_t)(const char* polyList, dpoly_t* out, int ptype);
+
+static void DecodePoly_Unknown(const char* polyList, dpoly_t* out, int ptype)
 {
-	memset(out, 0, sizeof(dpoly_t));
-	int polyType = forceType == -1 ? *polyList : forceType;
-	int ptype = polyType & 31;
-	int extFlags = (polyType >> 5) & 7;
+	Mutex::Guard guard(s_unknownPolyTypesMutex);
+	g_UnknownPolyTypes.append(ptype);
+}
 
-	out->type = ptype;
-	out->page = 0xFF;
-	out->detail = 0xFF;
-	out->flags = 0;
-	out->color = CVECTOR{ 255, 0, 255, 0 };
+// what a strange face type. Hardcoded?
+static void DecodePoly_Type1(const char* polyList, dpoly_t* out, int ptype)
+{
+	*(uint*)out->vindices = *(uint*)&polyList[4];
+	*(uint*)&out->color = *(uint*)&polyList[8];
+	out->flags = FACE_IS_QUAD | FACE_RGB;
+}
 
-	// TODO: D1 and D2 to have different decoding routines
+static void DecodePoly_F3(const char* polyList, dpoly_t* out, int ptype)
+{
+	*(uint*)out->vindices = *(uint*)&polyList[1];
+	*(uint*)&out->color = *(uint*)&polyList[8];
+	// FIXME: read colours
 
-	switch (ptype)
-	{
-		case 1:
-			// what a strange face type. Hardcoded?
-			*(uint*)out->vindices = *(uint*)&polyList[4];
-			*(uint*)&out->color = *(uint*)&polyList[8];
-			out->flags = FACE_IS_QUAD | FACE_RGB;
-			break;
-		case 0:
-		case 8:
-		case 16:
-		case 18:
-		{
-			// F3
-			*(uint*)out->vindices = *(uint*)&polyList[1];
-			*(uint*)&out->color = *(uint*)&polyList[8];
-			// FIXME: read colours
+	out->flags = FACE_RGB; // RGB?
+}
 
-			out->flags = FACE_RGB; // RGB?
-			break;
-		}
-		case 19:
-		{
-			// F4
-			*(uint*)out->vindices = *(uint*)&polyList[4];
-			*(uint*)out->uv = *(uint*)&polyList[8];
-			*(uint*)&out->color = *(uint*)&polyList[12];
-			
-			// FIXME: read colours
+static void DecodePoly_F4(const char* polyList, dpoly_t* out, int ptype)
+{
+	*(uint*)out->vindices = *(uint*)&polyList[4];
+	*(uint*)out->uv = *(uint*)&polyList[8];
+	*(uint*)&out->color = *(uint*)&polyList[12];
 
-			out->flags = FACE_RGB | FACE_IS_QUAD; // RGB?
+	// FIXME: read colours
 
-			break;
-		}
-		case 4:
-		case 10:
-		case 20:
-		{
-			POLYFT3* pft3 = (POLYFT3*)polyList;
+	out->flags = FACE_RGB | FACE_IS_QUAD; // RGB?
+}
 
-			*(uint*)out->vindices = *(uint*)&pft3->v0;
-			*(ushort*)out->uv[0] = *(ushort*)&pft3->uv0;
-			*(ushort*)out->uv[1] = *(ushort*)&pft3->uv1;
-			*(ushort*)out->uv[2] = *(ushort*)&pft3->uv2;
+static void DecodePoly_FT3(const char* polyList, dpoly_t* out, int ptype)
+{
+	POLYFT3* pft3 = (POLYFT3*)polyList;
 
-			if(ptype != 10)
-				*(uint*)&out->color = *(uint*)&pft3->color;
+	*(uint*)out->vindices = *(uint*)&pft3->v0;
+	*(ushort*)out->uv[0] = *(ushort*)&pft3->uv0;
+	*(ushort*)out->uv[1] = *(ushort*)&pft3->uv1;
+	*(ushort*)out->uv[2] = *(ushort*)&pft3->uv2;
 
-			out->page = pft3->texture_set;
-			out->detail = pft3->texture_id;
+	if (ptype != 10)
+		*(uint*)&out->color = *(uint*)&pft3->color;
 
-			out->flags = FACE_TEXTURED;
+	out->page = pft3->texture_set;
+	out->detail = pft3->texture_id;
 
-			break;
-		}
-		case 5:
-		case 7:
-		case 9:
-		case 11:
-		case 21:
-		{
-			POLYFT4* pft4 = (POLYFT4*)polyList;
-
-			*(uint*)out->vindices = *(uint*)&pft4->v0;
-			*(ushort*)out->uv[0] = *(ushort*)&pft4->uv0;
-			*(ushort*)out->uv[1] = *(ushort*)&pft4->uv1;
-			*(ushort*)out->uv[2] = *(ushort*)&pft4->uv2;
-			*(ushort*)out->uv[3] = *(ushort*)&pft4->uv3;
-			
-			if(ptype != 11)
-				*(uint*)&out->color = *(uint*)&pft4->color;
-			
-			out->page = pft4->texture_set;
-			out->detail = pft4->texture_id;
-
-			out->flags = FACE_IS_QUAD | FACE_TEXTURED;
-
-			break;
-		}
-		case 17:
-		{
-			// F4
-			out->page = polyList[1];
-			out->detail = polyList[2];
+	out->flags = FACE_TEXTURED;
+}
 
-			*(uint*)out->vindices = *(uint*)&polyList[4];
-			*(uint*)&out->color = *(uint*)&polyList[8];
+static void DecodePoly_FT4(const char* polyList, dpoly_t* out, int ptype)
+{
+	POLYFT4* pft4 = (POLYFT4*)polyList;
 
-			out->flags = FACE_IS_QUAD | FACE_RGB; // RGB?
+	*(uint*)out->vindices = *(uint*)&pft4->v0;
+	*(ushort*)out->uv[0] = *(ushort*)&pft4->uv0;
+	*(ushort*)out->uv[1] = *(ushort*)&pft4->uv1;
+	*(ushort*)out->uv[2] = *(ushort*)&pft4->uv2;
+	*(ushort*)out->uv[3] = *(ushort*)&pft4->uv3;
 
-			break;
-		}
-		case 22:
-		{
-			POLYGT3* pgt3 = (POLYGT3*)polyList;
+	if (ptype != 11)
+		*(uint*)&out->color = *(uint*)&pft4->color;
 
-			*(uint*)out->vindices = *(uint*)&pgt3->v0;
-			*(uint*)out->nindices = *(uint*)&pgt3->n0;
-			*(ushort*)out->uv[0] = *(ushort*)&pgt3->uv0;
-			*(ushort*)out->uv[1] = *(ushort*)&pgt3->uv1;
-			*(ushort*)out->uv[2] = *(ushort*)&pgt3->uv2;
+	out->page = pft4->texture_set;
+	out->detail = pft4->texture_id;
 
-			*(uint*)&out->color = *(uint*)&pgt3->color;
-			
-			out->page = pgt3->texture_set;
-			out->detail = pgt3->texture_id;
+	out->flags = FACE_IS_QUAD | FACE_TEXTURED;
+}
 
-			out->flags = FACE_VERT_NORMAL | FACE_TEXTURED;
-			break;
-		}
-		case 23:
-		{
-			POLYGT4* pgt4 = (POLYGT4*)polyList;
-
-			*(uint*)out->vindices = *(uint*)&pgt4->v0;
-			*(uint*)out->nindices = *(uint*)&pgt4->n0;
-			*(ushort*)out->uv[0] = *(ushort*)&pgt4->uv0;
-			*(ushort*)out->uv[1] = *(ushort*)&pgt4->uv1;
-			*(ushort*)out->uv[2] = *(ushort*)&pgt4->uv2;
-			*(ushort*)out->uv[3] = *(ushort*)&pgt4->uv3;
-
-			*(uint*)&out->color = *(uint*)&pgt4->color;
-			
-			out->page = pgt4->texture_set;
-			out->detail = pgt4->texture_id;
-			out->flags = FACE_IS_QUAD | FACE_VERT_NORMAL | FACE_TEXTURED;
-			break;
-		}
-		default:
-		{
-			g_UnknownPolyTypes.append(ptype);
-		}
-	}
+static void DecodePoly_Type17(const char* polyList, dpoly_t* out, int ptype)
+{
+	// F4
+	out->page = polyList[1];
+	out->detail = polyList[2];
+
+	*(uint*)out->vindices = *(uint*)&polyList[4];
+	*(uint*)&out->color = *(uint*)&polyList[8];
+
+	out->flags = FACE_IS_QUAD | FACE_RGB; // RGB?
+}
+
+static void DecodePoly_GT3(const char* polyList, dpoly_t* out, int ptype)
+{
+	POLYGT3* pgt3 = (POLYGT3*)polyList;
+
+	*(uint*)out->vindices = *(uint*)&pgt3->v0;
+	*(uint*)out->nindices = *(uint*)&pgt3->n0;
+	*(ushort*)out->uv[0] = *(ushort*)&pgt3->uv0;
+	*(ushort*)out->uv[1] = *(ushort*)&pgt3->uv1;
+	*(ushort*)out->uv[2] = *(ushort*)&pgt3->uv2;
+
+	*(uint*)&out->color = *(uint*)&pgt3->color;
+
+	out->page = pgt3->texture_set;
+	out->detail = pgt3->texture_id;
+
+	out->flags = FACE_VERT_NORMAL | FACE_TEXTURED;
+}
+
+static void DecodePoly_GT4(const char* polyList, dpoly_t* out, int ptype)
+{
+	POLYGT4* pgt4 = (POLYGT4*)polyList;
+
+	*(uint*)out->vindices = *(uint*)&pgt4->v0;
+	*(uint*)out->nindices = *(uint*)&pgt4->n0;
+	*(ushort*)out->uv[0] = *(ushort*)&pgt4->uv0;
+	*(ushort*)out->uv[1] = *(ushort*)&pgt4->uv1;
+	*(ushort*)out->uv[2] = *(ushort*)&pgt4->uv2;
+	*(ushort*)out->uv[3] = *(ushort*)&pgt4->uv3;
+
+	*(uint*)&out->color = *(uint*)&pgt4->color;
+
+	out->page = pgt4->texture_set;
+	out->detail = pgt4->texture_id;
+	out->flags = FACE_IS_QUAD | FACE_VERT_NORMAL | FACE_TEXTURED;
+}
+
+// TODO: D1 and D2 to have different decoding routines
+static const DecodePolyFunc_t s_decodePolyFuncs[32] = {
+	DecodePoly_F3,		DecodePoly_Type1,	DecodePoly_Unknown,	DecodePoly_Unknown,		// 0..3
+	DecodePoly_FT3,		DecodePoly_FT4,		DecodePoly_Unknown,	DecodePoly_FT4,			// 4..7
+	DecodePoly_F3,		DecodePoly_FT4,		DecodePoly_FT3,		DecodePoly_FT4,			// 8..11
+	DecodePoly_Unknown,	DecodePoly_Unknown,	DecodePoly_Unknown,	DecodePoly_Unknown,		// 12..15
+	DecodePoly_F3,		DecodePoly_Type17,	DecodePoly_F3,		DecodePoly_F4,			// 16..19
+	DecodePoly_FT3,		DecodePoly_FT4,		DecodePoly_GT3,		DecodePoly_GT4,			// 20..23
+	DecodePoly_Unknown,	DecodePoly_Unknown,	DecodePoly_Unknown,	DecodePoly_Unknown,		// 24..27
+	DecodePoly_Unknown,	DecodePoly_Unknown,	DecodePoly_Unknown,	DecodePoly_Unknown,		// 28..31
+};
+
+static const dpoly_t s_emptyPoly = {
+	0, 0, 0xFF, 0xFF,
+	{ 0 }, { { 0 } }, { 0 },
+	{ 255, 0, 255, 0 },
+	0
+};
+
+// returns size of face and fills dface_t struct
+// TODO: rework, few variants of faces still looks bad
+int decode_poly(const char* polyList, dpoly_t* out, int forceType /*= -1*/)
+{
+	const int polyType = forceType == -1 ? *polyList : forceType;
+	const int ptype = polyType & 31;
+
+	*out = s_emptyPoly;
+	out->type = ptype;
+
+	s_decodePolyFuncs[ptype](polyList, out, ptype);
 
 	// triangles are hacked to be quads for PSX. We don't need that
-	if (out->flags && FACE_IS_QUAD && out->vindices[2] == out->vindices[3])
+	if ((out->flags & FACE_IS_QUAD) && out->vindices[2] == out->vindices[3])
 	{
 		out->flags &= ~FACE_IS_QUAD;
 	}
@@ -528,4 +659,68 @@ int decode_poly(const char* polyList, dpoly_t* out, int forceType /*= -1*/)
 	}
 	
 	return PolySizes[*polyList & 31];
-}
\ No newline at end of file
+}
+
+//-------------------------------------------------------------
+// decodes whole polygon block of model into fixed size entries
+// returns number of decoded polygons, stops on bad offset or size
+//-------------------------------------------------------------
+int decode_model_polys(const MODEL* model, int modelSize, dpoly_t* out, int forceType /*= -1*/, int modelIndex /*= -1*/)
+{
+	const ubyte* modelEnd = (ubyte*)model + modelSize;
+	int face_ofs = 0;
+
+	for (int i = 0; i < model->num_polys; i++)
+	{
+		const char* facedata = model->pPolyAt(face_ofs);
+
+		// check offset
+		if ((ubyte*)facedata >= modelEnd)
+		{
+			MsgError("MDL %d poly id=%d ofs=%d bad offset!\n", modelIndex, i, model->poly_block + face_ofs);
+			return i;
+		}
+
+		const int poly_size = decode_poly(facedata, &out[i], forceType);
+
+		// check poly size
+		if (poly_size == 0)
+		{
+			MsgError("MDL %d poly id=%d type=%d ofs=%d zero size!\n", modelIndex, i, *facedata & 31, model->poly_block + face_ofs);
+			return i;
+		}
+
+		out[i].ofs = face_ofs;
+		face_ofs += poly_size;
+	}
+
+	return model->num_polys;
+}
+
+//-------------------------------------------------------------
+// returns decoded polygons of model, they are decoded once
+//-------------------------------------------------------------
+dpoly_t* GetModelPolys(ModelRef_t* ref, int& numPolys)
+{
+	numPolys = 0;
+
+	if (!ref->model)
+		return nullptr;
+
+	if (!ref->polys)
+	{
+		ref->polys = new dpoly_t[ref->model->num_polys > 0 ? ref->model->num_polys : 1];
+		ref->numPolys = decode_model_polys(ref->model, ref->size, ref->polys, -1, ref->index);
+	}
+
+	numPolys = ref->numPolys;
+
+	return ref->polys;
+}
+
+void FreeModelPolys(ModelRef_t* ref)
+{
+	delete[] ref->polys;
+	ref->polys = nullptr;
+	ref->numPolys = 0;
+}
@@ -36,7 +36,8 @@ struct dpoly_t
 	ubyte	uv[4][2];
 	ubyte	nindices[4];
 	CVECTOR	color;
-	// something more?
+
+	ushort	ofs;		// offset in poly block
 };
 
 enum EFaceFlags_e
@@ -64,11 +65,49 @@ struct ModelRef_t
 	
 	void*		userData{ nullptr }; // might contain a hardware model pointer
 
+	dpoly_t*	polys{ nullptr };	// decoded polygons cache, see GetModelPolys
+	int			numPolys{ 0 };
+
+	short		areaDataNum{ -1 };	// spooled area data which model belongs to, -1 for level models lump
+
 	bool		enabled { true };
 };
 
 //------------------------------------------------------------------------------------------------------------
 
+#define MODEL_ARENA_BLOCK_SIZE	(256 * 1024)
+#define MODEL_ARENA_ALIGNMENT	16
+
+// Bump allocator for model data. Models are never freed one by one,
+// the whole arena is released when level or area data is freed
+class CModelArena
+{
+public:
+	~CModelArena();
+
+	// makes sure next allocations up to size fit into single block
+	void				Reserve(int size);
+	void*				Alloc(int size);
+
+	void				FreeAll();
+
+	int					GetUsedSize() const		{ return m_usedSize; }
+	int					GetNumBlocks() const	{ return m_blocks.size(); }
+
+protected:
+	struct block_t
+	{
+		ubyte*	data;
+		int		size;
+		int		used;
+	};
+
+	Array<block_t>		m_blocks;
+	int					m_usedSize{ 0 };
+};
+
+//------------------------------------------------------------------------------------------------------------
+
 struct CarModelData_t
 {
 	MODEL* cleanmodel{ nullptr };
@@ -106,6 +145,9 @@ public:
 	const char*			GetModelNameByIndex(int nIndex) const;
 
 	CarModelData_t*		GetCarModel(int index) const;
+
+	// memory used by level and spooled area models
+	int					GetModelDataSize() const;
 	
 protected:
 	void				OnModelLoaded(ModelRef_t* ref);
@@ -113,10 +155,24 @@ protected:
 
 	void				OnCarModelLoaded(CarModelData_t* data);
 	void				OnCarModelFreed(CarModelData_t* data);
+
+	void				FreeCarModels();
+	MODEL*				GetCarModelFromLumpData(int offset, int& modelSize) const;
+
+	// model storage of spooled area data, created on demand
+	CModelArena*		GetAreaModelArena(int areaDataNum);
+
+	// frees all models of area data in bulk
+	void				FreeAreaModels(int areaDataNum);
 	
 	ModelRef_t			m_levelModels[MAX_MODELS];
 
 	CarModelData_t		m_carModels[MAX_CAR_MODELS];
+	ubyte*				m_carModelsData{ nullptr };		// whole car models lump, models point into it
+	int					m_carModelsDataSize{ 0 };
+
+	CModelArena			m_levelModelsArena;				// permanent models
+	Array<CModelArena*>	m_areaModelArenas;				// indexed by area data number
 
 	Array<String>		m_model_names;
 
@@ -132,6 +188,11 @@ protected:
 
 void			PrintUnknownPolys();
 int				decode_poly(const char* face, dpoly_t* out, int forceType = -1);
+int				decode_model_polys(const MODEL* model, int modelSize, dpoly_t* out, int forceType = -1, int modelIndex = -1);
+
+// decoded polygons are cached in ModelRef_t until model is freed
+dpoly_t*		GetModelPolys(ModelRef_t* ref, int& numPolys);
+void			FreeModelPolys(ModelRef_t* ref);
 
 //-------------------------------------------------------------------------------
 
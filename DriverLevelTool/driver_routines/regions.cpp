@@ -30,23 +30,8 @@ void CBaseLevelRegion::FreeAll()
 	
 	// do I need that?
 	if(m_spoolInfo && m_spoolInfo->super_region != 0xFF)
-	{
-		int areaDataNum = m_spoolInfo->super_region;
-		int numAreaTpages = m_owner->m_areaData[areaDataNum].num_tpages;
-		AreaTpageList& areaTPages = m_owner->m_areaTPages[areaDataNum];
-
-		for (int i = 0; numAreaTpages; i++)
-		{
-			if (areaTPages.pageIndexes[i] == 0xFF)
-				break;
+		m_owner->FreeAreaTPages(m_spoolInfo->super_region);
 
-			if (areaTPages.tpage[i])
-			{
-				areaTPages.tpage[i]->FreeBitmap();
-				areaTPages.tpage[i] = nullptr;
-			}
-		}
-	}
 	m_spoolInfo = nullptr;
 
 	delete[] m_cellPointers;
@@ -202,6 +187,9 @@ void CBaseLevelMap::Init(CDriverLevelModels* models, CDriverLevelTextures* textu
 
 void CBaseLevelMap::FreeAll()
 {
+	for (int i = 0; i < m_numAreas; i++)
+		FreeAreaData(i);
+
 	if (m_regionSpoolInfo)
 		free(m_regionSpoolInfo);
 	m_regionSpoolInfo = nullptr;
@@ -295,6 +283,13 @@ void CBaseLevelMap::LoadMapLump(IVirtualStream* pFile)
 	m_regions_down = m_mapInfo.cells_down / m_mapInfo.region_size;
 }
 
+//-------------------------------------------------------------
+// called when all LOADTIME and INMEMORY lumps are processed
+//-------------------------------------------------------------
+void CBaseLevelMap::OnLumpsLoaded()
+{
+}
+
 //-------------------------------------------------------------
 // parses LUMP_SPOOLINFO, and also loads region data
 //-------------------------------------------------------------
@@ -427,6 +422,37 @@ void CBaseLevelMap::LoadInAreaTPages(const SPOOL_CONTEXT& ctx, int areaDataNum)
 	}
 }
 
+void CBaseLevelMap::FreeAreaTPages(int areaDataNum)
+{
+	int numAreaTpages = m_areaData[areaDataNum].num_tpages;
+	AreaTpageList& areaTPages = m_areaTPages[areaDataNum];
+
+	for (int i = 0; numAreaTpages; i++)
+	{
+		if (areaTPages.pageIndexes[i] == 0xFF)
+			break;
+
+		if (areaTPages.tpage[i])
+		{
+			areaTPages.tpage[i]->FreeBitmap();
+			areaTPages.tpage[i] = nullptr;
+		}
+	}
+}
+
+void CBaseLevelMap::FreeAreaData(int areaDataNum)
+{
+	if (!m_areaDataStates || areaDataNum < 0 || areaDataNum >= m_numAreas || !m_areaDataStates[areaDataNum])
+		return;
+
+	FreeAreaTPages(areaDataNum);
+
+	if (m_models)
+		m_models->FreeAreaModels(areaDataNum);
+
+	m_areaDataStates[areaDataNum] = false;
+}
+
 void CBaseLevelMap::LoadInAreaModels(const SPOOL_CONTEXT& ctx, int areaDataNum) const
 {
 	if (areaDataNum == -1)
@@ -454,6 +480,10 @@ void CBaseLevelMap::LoadInAreaModels(const SPOOL_CONTEXT& ctx, int areaDataNum)
 	DevMsg(SPEW_INFO, "	model count: %d\n", numModels);
 	ctx.dataStream->Seek(modelsOffset, VS_SEEK_SET);
 
+	// all area models go to single arena block
+	CModelArena* arena = m_models->GetAreaModelArena(areaDataNum);
+	arena->Reserve(length * SPOOL_CD_BLOCK_SIZE + numModels * MODEL_ARENA_ALIGNMENT);
+
 	for (int i = 0; i < numModels; i++)
 	{
 		int modelSize;
@@ -474,8 +504,9 @@ void CBaseLevelMap::LoadInAreaModels(const SPOOL_CONTEXT& ctx, int areaDataNum)
 				continue;
 			}
 
-			ref->model = (MODEL*)Memory::alloc(modelSize);
+			ref->model = (MODEL*)arena->Alloc(modelSize);
 			ref->size = modelSize;
+			ref->areaDataNum = areaDataNum;
 
 			ctx.dataStream->Read(ref->model, modelSize, 1);
 
@@ -560,6 +591,20 @@ bool CBaseLevelMap::SpoolRegion(const SPOOL_CONTEXT& ctx, int regionIdx)
 	return false;
 }
 
+bool CBaseLevelMap::SpoolRegionRoads(const SPOOL_CONTEXT& ctx, int regionIdx)
+{
+	CBaseLevelRegion* region = GetRegion(regionIdx);
+
+	if (!region || region->m_loaded)
+		return false;
+
+	if (m_regionSpoolInfoOffsets[region->m_regionNumber] == REGION_EMPTY)
+		return false;
+
+	region->LoadRoadData(ctx);
+	return true;
+}
+
 void CBaseLevelMap::SetLoadingCallbacks(OnRegionLoaded_t onLoaded, OnRegionFreed_t onFreed)
 {
 	m_onRegionLoaded = onLoaded;
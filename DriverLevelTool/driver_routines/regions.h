@@ -40,6 +40,7 @@ public:
 
 	virtual void			FreeAll();
 	virtual void			LoadRegionData(const SPOOL_CONTEXT& ctx) = 0;
+	virtual void			LoadRoadData(const SPOOL_CONTEXT& ctx) = 0;
 	void					LoadAreaData(const SPOOL_CONTEXT& ctx);
 	int						GetAreaDataIdx() const;
 
@@ -91,6 +92,9 @@ public:
 	virtual void				LoadMapLump(IVirtualStream* pFile);
 	virtual void				LoadSpoolInfoLump(IVirtualStream* pFile);
 
+	// called by loader when all LOADTIME and INMEMORY lumps are processed
+	virtual void				OnLumpsLoaded();
+
 	virtual int					GetAreaDataCount() const;
 	virtual void				LoadInAreaTPages(const SPOOL_CONTEXT& ctx, int areaDataNum) const;
 	virtual void				LoadInAreaModels(const SPOOL_CONTEXT& ctx, int areaDataNum) const;
@@ -101,6 +105,10 @@ public:
 	bool						SpoolRegion(const SPOOL_CONTEXT& ctx, const XZPAIR& cell);
 	bool						SpoolRegion(const SPOOL_CONTEXT& ctx, int regionIdx);
 
+	// loads only road and heightmap data of region, no cells and area data.
+	// Can be called from multiple threads for different regions, each with it's own stream
+	bool						SpoolRegionRoads(const SPOOL_CONTEXT& ctx, int regionIdx);
+
 	int							GetRegionIndex(const XZPAIR& cell) const;
 
 	bool						IsRegionSpooled(const XZPAIR& cell) const;
@@ -109,7 +117,8 @@ public:
 	virtual CBaseLevelRegion*	GetRegion(const XZPAIR& cell) const = 0;
 	virtual CBaseLevelRegion*	GetRegion(int regionIdx) const = 0;
 
-	virtual void				FindSurface(const VECTOR_NOPAD& position, VECTOR_NOPAD& outPoint, sdPlane& outPlane) const = 0;
+	// always fills outputs, returns false if there is no surface data at position (outside of map or region not spooled)
+	virtual bool				FindSurface(const VECTOR_NOPAD& position, VECTOR_NOPAD& outPoint, sdPlane& outPlane) const = 0;
 
 	// converters
 	void						WorldPositionToCellXZ(XZPAIR& cell, const VECTOR_NOPAD& position, const XZPAIR& offset = {0}) const;
@@ -125,6 +134,10 @@ public:
 protected:
 
 	void						InitRegion(CBaseLevelRegion* region, int index) const;
+	void						FreeAreaTPages(int areaDataNum);
+
+	// frees area textures and models, only safe when all regions are freed as well
+	void						FreeAreaData(int areaDataNum);
 
 	void						OnRegionLoaded(CBaseLevelRegion* region);
 	void						OnRegionFreed(CBaseLevelRegion* region);
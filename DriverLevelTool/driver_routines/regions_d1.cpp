@@ -9,8 +9,18 @@
 extern sdPlane g_defaultPlane;
 extern sdPlane g_seaPlane;
 
+int PointInTri2d(int tx, int ty, const XYPAIR* verts);
+int PointInQuad2d(int tx, int ty, const XYPAIR* verts);
+
 void CDriver1LevelRegion::FreeAll()
 {
+	// road map can be loaded alone by LoadRoadData
+	delete[] m_roadMap;
+	m_roadMap = nullptr;
+
+	delete[] m_surfaceRoads;
+	m_surfaceRoads = nullptr;
+
 	if (!m_loaded)
 		return;
 
@@ -19,12 +29,6 @@ void CDriver1LevelRegion::FreeAll()
 	if (m_cells)
 		Memory::free(m_cells);
 	m_cells = nullptr;
-
-	delete[] m_roadMap;
-	m_roadMap = nullptr;
-
-	delete[] m_surfaceRoads;
-	m_surfaceRoads = nullptr;
 }
 
 void CDriver1LevelRegion::LoadRegionData(const SPOOL_CONTEXT& ctx)
@@ -60,13 +64,7 @@ void CDriver1LevelRegion::LoadRegionData(const SPOOL_CONTEXT& ctx)
 	const int cellObjectsOffset = cellDataOffset + m_spoolInfo->cell_data_size[0];
 	const int pvsDataOffset = cellObjectsOffset + m_spoolInfo->cell_data_size[2]; // FIXME: is it even there in Driver 1?
 
-	// read roadm (map?)
-	pFile->Seek(ctx.lumpInfo->spooled_offset + roadMOffset * SPOOL_CD_BLOCK_SIZE, VS_SEEK_SET);
-	LoadRoadCellsData(pFile);
-
-	// read roadh (heights?)
-	pFile->Seek(ctx.lumpInfo->spooled_offset + roadHOffset * SPOOL_CD_BLOCK_SIZE, VS_SEEK_SET);
-	LoadRoadHeightMapData(pFile);
+	LoadRoadData(ctx);
 
 	char* packed_cell_pointers = new char[m_spoolInfo->cell_data_size[1] * SPOOL_CD_BLOCK_SIZE];
 
@@ -103,6 +101,25 @@ void CDriver1LevelRegion::LoadRegionData(const SPOOL_CONTEXT& ctx)
 	// TODO: PVS and heightmap data
 }
 
+//-------------------------------------------------------------
+// Loads road map only, cells and objects are left untouched
+//-------------------------------------------------------------
+void CDriver1LevelRegion::LoadRoadData(const SPOOL_CONTEXT& ctx)
+{
+	IVirtualStream* pFile = ctx.dataStream;
+
+	const int roadMOffset = m_spoolInfo->offset;
+	const int roadHOffset = roadMOffset + m_spoolInfo->roadm_size;
+
+	// read roadm (map?)
+	pFile->Seek(ctx.lumpInfo->spooled_offset + roadMOffset * SPOOL_CD_BLOCK_SIZE, VS_SEEK_SET);
+	LoadRoadCellsData(pFile);
+
+	// read roadh (heights?)
+	pFile->Seek(ctx.lumpInfo->spooled_offset + roadHOffset * SPOOL_CD_BLOCK_SIZE, VS_SEEK_SET);
+	LoadRoadHeightMapData(pFile);
+}
+
 void CDriver1LevelRegion::LoadRoadHeightMapData(IVirtualStream* pFile)
 {
 	const OUT_CELL_FILE_HEADER& mapInfo = m_owner->m_mapInfo;
@@ -117,6 +134,7 @@ void CDriver1LevelRegion::LoadRoadHeightMapData(IVirtualStream* pFile)
 	int i = double_region_size * double_region_size;
 
 	// road map is in cell size
+	delete[] m_roadMap;
 	m_roadMap = new uint[double_region_size * double_region_size];
 	memset(m_roadMap, 0, sizeof(m_roadMap));
 
@@ -142,6 +160,7 @@ void CDriver1LevelRegion::LoadRoadHeightMapData(IVirtualStream* pFile)
 
 void CDriver1LevelRegion::LoadRoadCellsData(IVirtualStream* pFile)
 {
+	delete[] m_surfaceRoads;
 	m_surfaceRoads = new ushort[ROAD_MAP_REGION_CELLS];
 	ushort* pRoadIds = m_surfaceRoads;
 	int i = ROAD_MAP_REGION_CELLS;
@@ -202,6 +221,12 @@ void CDriver1LevelMap::FreeAll()
 	Memory::free(m_surfaceData);
 	m_surfaceData = nullptr;
 
+	delete[] m_surfacePolyCells;
+	m_surfacePolyCells = nullptr;
+
+	delete[] m_surfacePolyIndices;
+	m_surfacePolyIndices = nullptr;
+
 	delete[] m_roads;
 	m_roads = nullptr;
 
@@ -307,15 +332,145 @@ void CDriver1LevelMap::LoadRoadSurfaceLump(IVirtualStream* pFile, int size)
 	// get the surface count
 	numSurfaces = *(int*)m_surfaceData;
 
-	memset(m_surfacePtrs, 0, numSurfaces * sizeof(SURFACEINFO*));
+	memset(m_surfacePtrs, 0, sizeof(m_surfacePtrs));
 
 	// then flatten linked list into array
 	SURFACEINFO* si = (SURFACEINFO*)(m_surfaceData + sizeof(int));
 	for (int i = 0; i < numSurfaces; i++)
 	{
-		m_surfacePtrs[si->type] = si;
+		if ((ushort)si->type < MAX_SURFACE_TYPES)
+			m_surfacePtrs[si->type] = si;
+
 		si = (SURFACEINFO*)si->GetPoly(si->numpolys);
 	}
+
+	BuildSurfacePolyGrid(numSurfaces);
+}
+
+static int SurfacePolyGridCoord(int v)
+{
+	const int c = (v + 750) * SURFACE_POLY_GRID_SIZE / 1500;
+
+	if (c < 0)
+		return 0;
+
+	if (c >= SURFACE_POLY_GRID_SIZE)
+		return SURFACE_POLY_GRID_SIZE - 1;
+
+	return c;
+}
+
+//-------------------------------------------------------------
+// Buckets surface polygons by their bounds so FindSurface
+// tests only polygons that may contain the point
+//-------------------------------------------------------------
+void CDriver1LevelMap::BuildSurfacePolyGrid(int numSurfaces)
+{
+	const int numCells = MAX_SURFACE_TYPES * SURFACE_POLY_GRID_CELLS;
+
+	delete[] m_surfacePolyCells;
+	delete[] m_surfacePolyIndices;
+
+	m_surfacePolyCells = new int[numCells + 1];
+	memset(m_surfacePolyCells, 0, sizeof(int) * (numCells + 1));
+
+	// first pass counts, second pass fills
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (int type = 0; type < MAX_SURFACE_TYPES; type++)
+		{
+			const SURFACEINFO* si = m_surfacePtrs[type];
+
+			if (!si)
+				continue;
+
+			int* cells = m_surfacePolyCells + type * SURFACE_POLY_GRID_CELLS;
+
+			for (int i = 0; i < si->numpolys; i++)
+			{
+				const SIPOLY* poly = si->GetPoly(i);
+				const int numVerts = poly->num_vertices == 4 ? 4 : 3;
+
+				int minX = poly->xz[0].x, maxX = poly->xz[0].x;
+				int minY = poly->xz[0].y, maxY = poly->xz[0].y;
+
+				for (int j = 1; j < numVerts; j++)
+				{
+					minX = Math::min(minX, poly->xz[j].x);
+					maxX = Math::max(maxX, poly->xz[j].x);
+					minY = Math::min(minY, poly->xz[j].y);
+					maxY = Math::max(maxY, poly->xz[j].y);
+				}
+
+				const int cx1 = SurfacePolyGridCoord(minX), cx2 = SurfacePolyGridCoord(maxX);
+				const int cy1 = SurfacePolyGridCoord(minY), cy2 = SurfacePolyGridCoord(maxY);
+
+				for (int cy = cy1; cy <= cy2; cy++)
+				{
+					for (int cx = cx1; cx <= cx2; cx++)
+					{
+						const int cell = cx + cy * SURFACE_POLY_GRID_SIZE;
+
+						if (pass == 0)
+							cells[cell + 1]++;
+						else
+							m_surfacePolyIndices[cells[cell]++] = i;
+					}
+				}
+			}
+		}
+
+		if (pass == 0)
+		{
+			// prefix sum to get starts
+			for (int i = 0; i < numCells; i++)
+				m_surfacePolyCells[i + 1] += m_surfacePolyCells[i];
+
+			m_surfacePolyIndices = new ushort[Math::max(m_surfacePolyCells[numCells], 1)];
+		}
+		else
+		{
+			// fill advanced every start to the next cell start, shift back
+			for (int i = numCells; i > 0; i--)
+				m_surfacePolyCells[i] = m_surfacePolyCells[i - 1];
+
+			m_surfacePolyCells[0] = 0;
+		}
+	}
+
+	DevMsg(SPEW_NORM, "Surface poly grid: %d surfaces, %d poly references\n", numSurfaces, m_surfacePolyCells[numCells]);
+}
+
+//-------------------------------------------------------------
+// Returns surface polygon containing local point.
+// When polygons overlap, the last one in surface wins
+//-------------------------------------------------------------
+const SIPOLY* CDriver1LevelMap::FindSurfacePoly(int surfaceType, int px, int py) const
+{
+	const SURFACEINFO* si = m_surfacePtrs[surfaceType];
+
+	if (!si || !m_surfacePolyCells)
+		return nullptr;
+
+	const int cell = surfaceType * SURFACE_POLY_GRID_CELLS + SurfacePolyGridCoord(px) + SurfacePolyGridCoord(py) * SURFACE_POLY_GRID_SIZE;
+
+	const int start = m_surfacePolyCells[cell];
+	const int end = m_surfacePolyCells[cell + 1];
+
+	// indices are in ascending order, walk backwards
+	for (int i = end - 1; i >= start; i--)
+	{
+		const SIPOLY* poly = si->GetPoly(m_surfacePolyIndices[i]);
+
+		const int res = (poly->num_vertices == 4) ?
+			PointInQuad2d(px, py, poly->xz) :
+			PointInTri2d(px, py, poly->xz);
+
+		if (res != 0)
+			return poly;
+	}
+
+	return nullptr;
 }
 
 CBaseLevelRegion* CDriver1LevelMap::GetRegion(const XZPAIR& cell) const
@@ -428,6 +583,21 @@ bool CDriver1LevelMap::GetRoadInfo(ROUTE_DATA& outData, const VECTOR_NOPAD& posi
 	return true;
 }
 
+int CDriver1LevelMap::GetRoadInfo(ROUTE_DATA* outData, const VECTOR_NOPAD* positions, int count) const
+{
+	int numFound = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		if (GetRoadInfo(outData[i], positions[i]))
+			numFound++;
+		else
+			outData[i].type = -1;
+	}
+
+	return numFound;
+}
+
 static void RotatePoint(const ROUTE_DATA& routeData, int& px, int& py)
 {
 	// NOTE: if you uncommend PC reversing code, it breaks rotation
@@ -488,7 +658,31 @@ static int GetHardcodedFriscoHeight(const VECTOR_NOPAD& position)
 	return 0;
 }
 
-void CDriver1LevelMap::FindSurface(const VECTOR_NOPAD& position, VECTOR_NOPAD& outPoint, sdPlane& outPlane) const
+bool CDriver1LevelMap::FindSurface(const VECTOR_NOPAD& position, VECTOR_NOPAD& outPoint, sdPlane& outPlane) const
+{
+	ROUTE_DATA routeData;
+	if (!GetRoadInfo(routeData, position))
+		routeData.type = -1;
+
+	FindSurface(routeData, position, outPoint, outPlane);
+
+	return routeData.type != -1;
+}
+
+void CDriver1LevelMap::FindSurfaces(const VECTOR_NOPAD* positions, int count, VECTOR_NOPAD* outPoints, sdPlane* outPlanes) const
+{
+	ROUTE_DATA routeData;
+
+	for (int i = 0; i < count; i++)
+	{
+		if (!GetRoadInfo(routeData, positions[i]))
+			routeData.type = -1;
+
+		FindSurface(routeData, positions[i], outPoints[i], outPlanes[i]);
+	}
+}
+
+void CDriver1LevelMap::FindSurface(const ROUTE_DATA& routeData, const VECTOR_NOPAD& position, VECTOR_NOPAD& outPoint, sdPlane& outPlane) const
 {
 	outPlane = g_defaultPlane;
 
@@ -497,58 +691,40 @@ void CDriver1LevelMap::FindSurface(const VECTOR_NOPAD& position, VECTOR_NOPAD& o
 	outPoint.vy = outPlane.d;
 
 	// oh, there is a trouble with D1...
-	ROUTE_DATA routeData;
-	if (!GetRoadInfo(routeData, position))
-	{
+	if (routeData.type == -1)
 		return;
-	}
 
 	outPlane.d = -routeData.height;
-
-	outPoint.vx = position.vx;
-	outPoint.vz = position.vz;
 	outPoint.vy = -routeData.height;
 
 	// check collision
-	if (routeData.type < 900)
+	if (routeData.type < MAX_SURFACE_TYPES)
 	{
-		const SURFACEINFO* si = m_surfacePtrs[routeData.type];
+		int px, py;
+		GetSurfaceLocalCoords(position, px, py);
+		RotatePoint(routeData, px, py);
 
-		if (si)
-		{
-			int px, py;
-			GetSurfaceLocalCoords(position, px, py);
-			RotatePoint(routeData, px, py);
+		const SIPOLY* poly = FindSurfacePoly(routeData.type, px, py);
 
-			for (int i = 0; i < si->numpolys; i++)
-			{
-				const SIPOLY* poly = si->GetPoly(i);
-
-				int res = (poly->num_vertices == 4) ?
-					PointInQuad2d(px, py, poly->xz) :
-					PointInTri2d(px, py, poly->xz);
-
-				if (res != 0)
-				{
-					const int normFac = px * poly->normals.a + py * poly->normals.c;
-					const int height = ((normFac / ONE) - poly->normals.d) - routeData.height;
+		if (poly)
+		{
+			const int normFac = px * poly->normals.a + py * poly->normals.c;
+			const int height = ((normFac / ONE) - poly->normals.d) - routeData.height;
 
-					int n_vx = poly->normals.a;
-					int n_vz = poly->normals.c;
-					const int n_vy = poly->normals.b;
+			int n_vx = poly->normals.a;
+			int n_vz = poly->normals.c;
+			const int n_vy = poly->normals.b;
 
-					RotateNormal(routeData, n_vx, n_vz);
+			RotateNormal(routeData, n_vx, n_vz);
 
-					outPlane.a = n_vx << 2;
-					outPlane.b = n_vy << 2;
-					outPlane.c = n_vz << 2;
+			outPlane.a = n_vx << 2;
+			outPlane.b = n_vy << 2;
+			outPlane.c = n_vz << 2;
 
-					outPoint.vy = height;
-				}
-			}
-		} // si != null
+			outPoint.vy = height;
+		}
 
-		ModelRef_t* ref = m_models->GetModelByIndex(routeData.type);
+		ModelRef_t* ref = m_models ? m_models->GetModelByIndex(routeData.type) : nullptr;
 
 		if (ref && ref->baseInstance)
 			ref = ref->baseInstance;
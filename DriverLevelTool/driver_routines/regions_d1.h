@@ -7,6 +7,11 @@
 //----------------------------------------------------------------------------------
 
 #define ROAD_MAP_REGION_CELLS	3600
+#define MAX_SURFACE_TYPES		900
+
+// road surface polygons are bucketed in local road cell space (-750..750)
+#define SURFACE_POLY_GRID_SIZE	4
+#define SURFACE_POLY_GRID_CELLS	(SURFACE_POLY_GRID_SIZE * SURFACE_POLY_GRID_SIZE)
 
 class CDriver1LevelRegion;
 class CDriver1LevelMap;
@@ -28,6 +33,7 @@ class CDriver1LevelRegion : public CBaseLevelRegion
 public:
 	void					FreeAll() override;
 	void					LoadRegionData(const SPOOL_CONTEXT& ctx) override;
+	void					LoadRoadData(const SPOOL_CONTEXT& ctx) override;
 
 	// cell iterator
 	CELL_OBJECT*			StartIterator(CELL_ITERATOR_D1* iterator, int cellNumber) const;
@@ -65,7 +71,7 @@ public:
 	CBaseLevelRegion*		GetRegion(const XZPAIR& cell) const override;
 	CBaseLevelRegion*		GetRegion(int regionIdx) const override;
 
-	void					FindSurface(const VECTOR_NOPAD& position, VECTOR_NOPAD& outPoint, sdPlane& outPlane) const override;
+	bool					FindSurface(const VECTOR_NOPAD& position, VECTOR_NOPAD& outPoint, sdPlane& outPlane) const override;
 
 	//----------------------------------------
 	// cell iterator
@@ -76,6 +82,10 @@ public:
 	// road map stuff
 	bool						GetRoadInfo(ROUTE_DATA& outData, const VECTOR_NOPAD& position) const;
 
+	// batched versions. Positions without road info have type = -1
+	int							GetRoadInfo(ROUTE_DATA* outData, const VECTOR_NOPAD* positions, int count) const;
+	void						FindSurfaces(const VECTOR_NOPAD* positions, int count, VECTOR_NOPAD* outPoints, sdPlane* outPlanes) const;
+
 	int							GetNumRoads() const { return m_numRoads; }
 	int							GetNumJunctions() const { return m_numJunctions; }
 
@@ -89,13 +99,20 @@ public:
 protected:
 
 	void					GetSurfaceLocalCoords(const VECTOR_NOPAD& position, int& px, int& py) const;
+	void					FindSurface(const ROUTE_DATA& routeData, const VECTOR_NOPAD& position, VECTOR_NOPAD& outPoint, sdPlane& outPlane) const;
+
+	void					BuildSurfacePolyGrid(int numSurfaces);
+	const SIPOLY*			FindSurfacePoly(int surfaceType, int px, int py) const;
 
 	ROAD_MAP_LUMP_DATA		m_roadMapLumpData;
 
 	CDriver1LevelRegion*	m_regions{ nullptr };					// map of regions
-	SURFACEINFO*			m_surfacePtrs[900];
+	SURFACEINFO*			m_surfacePtrs[MAX_SURFACE_TYPES];
 	char*					m_surfaceData{ nullptr };
 
+	int*					m_surfacePolyCells{ nullptr };			// per surface type CSR starts into m_surfacePolyIndices
+	ushort*					m_surfacePolyIndices{ nullptr };
+
 	DRIVER1_ROAD*			m_roads{ nullptr };
 	DRIVER1_ROADBOUNDS*		m_roadBounds{ nullptr };
 	DRIVER1_JUNCTION*		m_junctions{ nullptr };
@@ -336,6 +336,16 @@ int CDriver2LevelRegion::RoadInCell(VECTOR_NOPAD& position) const
 
 void CDriver2LevelRegion::FreeAll()
 {
+	// heightmap can be loaded alone by LoadRoadData
+	if (m_pvsData)
+		Memory::free(m_pvsData);
+	m_pvsData = nullptr;
+
+	m_planeData = nullptr;
+	m_bspData = nullptr;
+	m_nodeData = nullptr;
+	m_surfaceData = nullptr;
+
 	if (!m_loaded)
 		return;
 
@@ -348,10 +358,6 @@ void CDriver2LevelRegion::FreeAll()
 	if (m_packedCellObjects)
 		Memory::free(m_packedCellObjects);
 	m_packedCellObjects = nullptr;
-
-	if (m_pvsData)
-		Memory::free(m_pvsData);
-	m_pvsData = nullptr;
 }
 
 void CDriver2LevelRegion::LoadRegionData(const SPOOL_CONTEXT& ctx)
@@ -382,22 +388,15 @@ void CDriver2LevelRegion::LoadRegionData(const SPOOL_CONTEXT& ctx)
 	int cellPointersOffset;
 	int cellDataOffset;
 	int cellObjectsOffset;
-	int pvsHeightmapDataOffset;
+	const int pvsHeightmapDataOffset = GetHeightmapDataOffset();
 
 	if (m_owner->m_format == LEV_FORMAT_DRIVER2_RETAIL) // retail
-	{
 		cellPointersOffset = m_spoolInfo->offset;
-		cellDataOffset = cellPointersOffset + m_spoolInfo->cell_data_size[1];
-		cellObjectsOffset = cellDataOffset + m_spoolInfo->cell_data_size[0];
-		pvsHeightmapDataOffset = cellObjectsOffset + m_spoolInfo->cell_data_size[2];
-	}
 	else // 1.6 alpha
-	{
-		pvsHeightmapDataOffset = m_spoolInfo->offset;
 		cellPointersOffset = pvsHeightmapDataOffset + m_spoolInfo->roadm_size;
-		cellDataOffset = cellPointersOffset + m_spoolInfo->cell_data_size[1];
-		cellObjectsOffset = cellDataOffset + m_spoolInfo->cell_data_size[0];
-	}
+
+	cellDataOffset = cellPointersOffset + m_spoolInfo->cell_data_size[1];
+	cellObjectsOffset = cellDataOffset + m_spoolInfo->cell_data_size[0];
 
 	char* packed_cell_pointers = new char[m_spoolInfo->cell_data_size[1] * SPOOL_CD_BLOCK_SIZE];
 
@@ -440,6 +439,26 @@ void CDriver2LevelRegion::LoadRegionData(const SPOOL_CONTEXT& ctx)
 	m_owner->OnRegionLoaded(this);
 }
 
+//---------------------------------------------------------------------
+// Loads heightmap only, cells and objects are left untouched
+//---------------------------------------------------------------------
+void CDriver2LevelRegion::LoadRoadData(const SPOOL_CONTEXT& ctx)
+{
+	IVirtualStream* pFile = ctx.dataStream;
+
+	pFile->Seek(ctx.lumpInfo->spooled_offset + GetHeightmapDataOffset() * SPOOL_CD_BLOCK_SIZE, VS_SEEK_SET);
+	ReadHeightmapData(ctx);
+}
+
+int CDriver2LevelRegion::GetHeightmapDataOffset() const
+{
+	if (m_owner->m_format == LEV_FORMAT_DRIVER2_RETAIL) // retail
+		return m_spoolInfo->offset + m_spoolInfo->cell_data_size[1] + m_spoolInfo->cell_data_size[0] + m_spoolInfo->cell_data_size[2];
+
+	// 1.6 alpha
+	return m_spoolInfo->offset;
+}
+
 //---------------------------------------------------------------------
 // Unpacks all cell objects from PACKED_CELL_OBJECT
 //---------------------------------------------------------------------
@@ -492,6 +511,10 @@ void CDriver2LevelRegion::ReadHeightmapData(const SPOOL_CONTEXT& ctx)
 	IVirtualStream* pFile = ctx.dataStream;
 
 	int pvsDataSize = 0;
+
+	if (m_pvsData)
+		Memory::free(m_pvsData);
+
 	m_pvsData = (char*)Memory::alloc(m_spoolInfo->roadm_size * SPOOL_CD_BLOCK_SIZE);
 
 	if (m_owner->m_format == LEV_FORMAT_DRIVER2_RETAIL) // retail do have PVS data in the start
@@ -614,6 +637,9 @@ void CDriver2LevelMap::FreeAll()
 	delete[] m_junctions;
 	m_junctions = nullptr;
 
+	m_roadGraph.Release();
+	m_roadGrid.Release();
+
 	CBaseLevelMap::FreeAll();
 }
 
@@ -689,6 +715,15 @@ void CDriver2LevelMap::LoadJunctionsLump(IVirtualStream* pFile, bool oldFormat)
 		pFile->Read(m_junctions, m_numJunctions, sizeof(DRIVER2_JUNCTION));
 }
 
+//-------------------------------------------------------------
+// Builds road network and index once roads are loaded
+//-------------------------------------------------------------
+void CDriver2LevelMap::OnLumpsLoaded()
+{
+	m_roadGraph.Build(this);
+	m_roadGrid.Build(this);
+}
+
 CBaseLevelRegion* CDriver2LevelMap::GetRegion(const XZPAIR& cell) const
 {
 	// lookup region
@@ -710,7 +745,7 @@ CBaseLevelRegion* CDriver2LevelMap::GetRegion(int regionIdx) const
 	return &m_regions[regionIdx];
 }
 
-void CDriver2LevelMap::FindSurface(const VECTOR_NOPAD& position, VECTOR_NOPAD& outPoint, sdPlane& outPlane) const
+bool CDriver2LevelMap::FindSurface(const VECTOR_NOPAD& position, VECTOR_NOPAD& outPoint, sdPlane& outPlane) const
 {
 	VECTOR_NOPAD cellPos;
 	XZPAIR cell;
@@ -721,21 +756,25 @@ void CDriver2LevelMap::FindSurface(const VECTOR_NOPAD& position, VECTOR_NOPAD& o
 	cellPos.vz = position.vz - 512;
 
 	WorldPositionToCellXZ(cell, cellPos);
-	const CDriver2LevelRegion* region = (CDriver2LevelRegion*)GetRegion(cell);
 
-	if (region)
-	{
-		const sdPlane* foundPlane = region->SdGetCell(cellPos, level);
+	const sdPlane* foundPlane = nullptr;
 
-		if (foundPlane)
-			outPlane = *foundPlane;
-		else
-			outPlane = g_seaPlane;
+	// GetRegion has no bounds check
+	if (cell.x >= 0 && cell.z >= 0 && cell.x < GetCellsAcross() && cell.z < GetCellsDown())
+	{
+		const CDriver2LevelRegion* region = (CDriver2LevelRegion*)GetRegion(cell);
 
-		outPoint.vx = position.vx;
-		outPoint.vz = position.vz;
-		outPoint.vy = SdHeightOnPlane(position, &outPlane, m_curves);
+		if (region)
+			foundPlane = region->SdGetCell(cellPos, level);
 	}
+
+	outPlane = foundPlane ? *foundPlane : g_seaPlane;
+
+	outPoint.vx = position.vx;
+	outPoint.vz = position.vz;
+	outPoint.vy = SdHeightOnPlane(position, &outPlane, m_curves);
+
+	return foundPlane != nullptr;
 }
 
 int	CDriver2LevelMap::GetRoadIndex(VECTOR_NOPAD& position) const
@@ -833,6 +872,16 @@ int CDriver2LevelMap::GetNumJunctions() const
 	return m_numJunctions;
 }
 
+const CDriver2RoadGraph& CDriver2LevelMap::GetRoadGraph() const
+{
+	return m_roadGraph;
+}
+
+const CDriver2RoadGrid& CDriver2LevelMap::GetRoadGrid() const
+{
+	return m_roadGrid;
+}
+
 //-------------------------------------------------------------
 // returns first cell object of cell
 //-------------------------------------------------------------
@@ -2,6 +2,8 @@
 #define REGIONS_D2
 
 #include "regions.h"
+#include "roadgraph_d2.h"
+#include "roadgrid_d2.h"
 
 //----------------------------------------------------------------------------------
 // DRIVER 2 roads
@@ -97,6 +99,7 @@ class CDriver2LevelRegion : public CBaseLevelRegion
 public:
 	void					FreeAll() override;
 	void					LoadRegionData(const SPOOL_CONTEXT& ctx) override;
+	void					LoadRoadData(const SPOOL_CONTEXT& ctx) override;
 
 	PACKED_CELL_OBJECT*		GetPackedCellObject(int num) const;
 	CELL_DATA*				GetCellData(int num) const;
@@ -115,6 +118,7 @@ protected:
 	void					UnpackAllCellObjects();
 
 	void					ReadHeightmapData(const SPOOL_CONTEXT& ctx);
+	int						GetHeightmapDataOffset() const;
 
 	CELL_DATA*				m_cells{ nullptr };					// cell data that holding information about cell pointers. 3D world seeks cells first here
 	PACKED_CELL_OBJECT*		m_packedCellObjects{ nullptr };		// cell objects that represents objects placed in the world
@@ -143,12 +147,14 @@ public:
 	void					LoadCurvesLump(IVirtualStream* pFile);
 	void					LoadJunctionsLump(IVirtualStream* pFile, bool oldFormat);
 
+	void					OnLumpsLoaded() override;
+
 	//----------------------------------------
 
 	CBaseLevelRegion*		GetRegion(const XZPAIR& cell) const override;
 	CBaseLevelRegion*		GetRegion(int regionIdx) const override;
 
-	void					FindSurface(const VECTOR_NOPAD& position, VECTOR_NOPAD& outPoint, sdPlane& outPlane) const override;
+	bool					FindSurface(const VECTOR_NOPAD& position, VECTOR_NOPAD& outPoint, sdPlane& outPlane) const override;
 
 	int						GetRoadIndex(VECTOR_NOPAD& position) const;
 
@@ -163,6 +169,12 @@ public:
 	int						GetNumStraights() const;
 	int						GetNumCurves() const;
 	int						GetNumJunctions() const;
+
+	// road network built from straights, curves and junctions
+	const CDriver2RoadGraph&	GetRoadGraph() const;
+
+	// spatial index for nearest road and lane queries
+	const CDriver2RoadGrid&		GetRoadGrid() const;
 	
 	//----------------------------------------
 	// cell iterator
@@ -183,6 +195,9 @@ protected:
 	int						m_numStraights{ 0 };
 	int						m_numCurves{ 0 };
 	int						m_numJunctions{ 0 };
+
+	CDriver2RoadGraph		m_roadGraph;
+	CDriver2RoadGrid		m_roadGrid;
 };
 
 
@@ -0,0 +1,481 @@
+#include "roadgraph_d2.h"
+#include "regions_d2.h"
+
+#include "core/cmdlib.h"
+#include "math/isin.h"
+
+#include <string.h>
+
+static RoadGraphNode_t s_emptyNode = { -1 };
+
+CDriver2RoadGraph::CDriver2RoadGraph()
+{
+}
+
+CDriver2RoadGraph::~CDriver2RoadGraph()
+{
+	Release();
+}
+
+void CDriver2RoadGraph::Release()
+{
+	delete[] m_nodes;
+	m_nodes = nullptr;
+
+	delete[] m_edgeStart;
+	m_edgeStart = nullptr;
+
+	delete[] m_edges;
+	m_edges = nullptr;
+
+	m_numNodes = 0;
+	m_numEdges = 0;
+
+	m_numStraights = 0;
+	m_numCurves = 0;
+	m_numJunctions = 0;
+
+	m_map = nullptr;
+}
+
+bool CDriver2RoadGraph::IsBuilt() const
+{
+	return m_nodes != nullptr;
+}
+
+int CDriver2RoadGraph::GetNodeCount() const
+{
+	return m_numNodes;
+}
+
+int CDriver2RoadGraph::GetEdgeCount() const
+{
+	return m_numEdges;
+}
+
+const RoadGraphNode_t& CDriver2RoadGraph::GetNode(int node) const
+{
+	if (node < 0 || node >= m_numNodes)
+		return s_emptyNode;
+
+	return m_nodes[node];
+}
+
+const RoadGraphEdge_t* CDriver2RoadGraph::GetEdges(int node, int& numEdges) const
+{
+	if (node < 0 || node >= m_numNodes)
+	{
+		numEdges = 0;
+		return nullptr;
+	}
+
+	numEdges = m_edgeStart[node + 1] - m_edgeStart[node];
+	return m_edges + m_edgeStart[node];
+}
+
+const RoadGraphEdge_t* CDriver2RoadGraph::EdgesBegin(int node) const
+{
+	return m_edges + m_edgeStart[node];
+}
+
+const RoadGraphEdge_t* CDriver2RoadGraph::EdgesEnd(int node) const
+{
+	return m_edges + m_edgeStart[node + 1];
+}
+
+//-------------------------------------------------------------
+// surface ID <-> node index
+//-------------------------------------------------------------
+int CDriver2RoadGraph::SurfaceIdToNode(int surfId) const
+{
+	if (surfId < 0)
+		return -1;
+
+	const int idx = surfId & 0x1FFF;
+
+	switch (surfId & 0xFFFFE000)
+	{
+		case 0x0000:
+			return idx < m_numStraights ? idx : -1;
+		case 0x4000:
+			return idx < m_numCurves ? m_numStraights + idx : -1;
+		case 0x2000:
+			return idx < m_numJunctions ? m_numStraights + m_numCurves + idx : -1;
+	}
+
+	return -1;
+}
+
+int CDriver2RoadGraph::NodeToSurfaceId(int node) const
+{
+	if (node < 0 || node >= m_numNodes)
+		return -1;
+
+	return m_nodes[node].surfId;
+}
+
+//-------------------------------------------------------------
+// Lane position at the node end
+//-------------------------------------------------------------
+void CDriver2RoadGraph::GetLanePosition(int node, int lane, int end, XZPAIR& outPos) const
+{
+	const RoadGraphNode_t& nd = m_nodes[node];
+
+	if (nd.type == ROAD_NODE_STRAIGHT)
+	{
+		const DRIVER2_STRAIGHT* straight = m_map->GetStraight(nd.surfId);
+
+		const int cs = icos(straight->angle);
+		const int sn = isin(straight->angle);
+		const int laneOfs = 512 * lane - nd.numLanes * 256 + 256;
+
+		outPos.x = nd.ends[end].x + (laneOfs * -cs) / ONE;
+		outPos.z = nd.ends[end].z + (laneOfs * sn) / ONE;
+	}
+	else if (nd.type == ROAD_NODE_CURVE)
+	{
+		const DRIVER2_CURVE* curve = m_map->GetCurve(nd.surfId);
+
+		const int radius = curve->inside * 1024 + 256 + 512 * lane;
+		const int angle = end ? curve->end : curve->start;
+
+		outPos.x = curve->Midx + (radius * isin(angle)) / ONE;
+		outPos.z = curve->Midz + (radius * icos(angle)) / ONE;
+	}
+	else
+	{
+		outPos = nd.ends[0];
+	}
+}
+
+//-------------------------------------------------------------
+// Builds graph from map road lumps. Call once after level loading
+//-------------------------------------------------------------
+void CDriver2RoadGraph::Build(const CDriver2LevelMap* map)
+{
+	Release();
+
+	m_map = map;
+
+	m_numStraights = map->GetNumStraights();
+	m_numCurves = map->GetNumCurves();
+	m_numJunctions = map->GetNumJunctions();
+	m_numNodes = m_numStraights + m_numCurves + m_numJunctions;
+
+	if (!m_numNodes)
+	{
+		m_map = nullptr;
+		return;
+	}
+
+	BuildNodes(map);
+	BuildEdges(map);
+
+	DevMsg(SPEW_INFO, "Road graph: %d nodes, %d edges\n", m_numNodes, m_numEdges);
+}
+
+void CDriver2RoadGraph::BuildNodes(const CDriver2LevelMap* map)
+{
+	m_nodes = new RoadGraphNode_t[m_numNodes];
+	memset(m_nodes, 0, sizeof(RoadGraphNode_t) * m_numNodes);
+
+	RoadGraphNode_t* nd = m_nodes;
+
+	for (int i = 0; i < m_numStraights; i++, nd++)
+	{
+		const DRIVER2_STRAIGHT* straight = map->GetStraight(i);
+
+		const int sn = isin(straight->angle);
+		const int cs = icos(straight->angle);
+		const int halfLength = straight->length / 2;
+
+		nd->surfId = i;
+		nd->type = ROAD_NODE_STRAIGHT;
+		nd->length = straight->length;
+
+		nd->ends[0].x = straight->Midx - (halfLength * sn) / ONE;
+		nd->ends[0].z = straight->Midz - (halfLength * cs) / ONE;
+		nd->ends[1].x = straight->Midx + (halfLength * sn) / ONE;
+		nd->ends[1].z = straight->Midz + (halfLength * cs) / ONE;
+
+		nd->numLanes = ROAD_WIDTH_IN_LANES(straight);
+
+		for (int j = 0; j < nd->numLanes && j < ROAD_GRAPH_MAX_LANES; j++)
+		{
+			nd->laneDirMask |= ROAD_LANE_DIR(straight, j) << j;
+			nd->aiLaneMask |= ROAD_IS_AI_LANE(straight, j) << j;
+		}
+	}
+
+	for (int i = 0; i < m_numCurves; i++, nd++)
+	{
+		const DRIVER2_CURVE* curve = map->GetCurve(i | 0x4000);
+
+		const int curveLength = curve->end - curve->start & 4095;
+		const int radius = curve->inside * 1024 + 256 * ROAD_WIDTH_IN_LANES(curve);
+
+		nd->surfId = i | 0x4000;
+		nd->type = ROAD_NODE_CURVE;
+
+		// 4096 angle units is a full circle
+		nd->length = (int)((float)radius * (float)curveLength * (2.0f * 3.14159265f) / 4096.0f);
+
+		nd->ends[0].x = curve->Midx + (radius * isin(curve->start)) / ONE;
+		nd->ends[0].z = curve->Midz + (radius * icos(curve->start)) / ONE;
+		nd->ends[1].x = curve->Midx + (radius * isin(curve->end)) / ONE;
+		nd->ends[1].z = curve->Midz + (radius * icos(curve->end)) / ONE;
+
+		nd->numLanes = ROAD_WIDTH_IN_LANES(curve);
+
+		for (int j = 0; j < nd->numLanes && j < ROAD_GRAPH_MAX_LANES; j++)
+		{
+			nd->laneDirMask |= ROAD_LANE_DIR(curve, j) << j;
+			nd->aiLaneMask |= ROAD_IS_AI_LANE(curve, j) << j;
+		}
+	}
+
+	for (int i = 0; i < m_numJunctions; i++, nd++)
+	{
+		nd->surfId = i | 0x2000;
+		nd->type = ROAD_NODE_JUNCTION;
+
+		// junction is a single virtual lane any car can drive through
+		nd->numLanes = 1;
+		nd->aiLaneMask = 1;
+	}
+
+	// junctions have no position data in retail format, place them to the middle of exits
+	for (int i = 0; i < m_numJunctions; i++)
+	{
+		const int node = m_numStraights + m_numCurves + i;
+
+		short connections[4];
+		const int numConnections = GetConnectionCount(map, node, connections);
+
+		if (!numConnections)
+			continue;
+
+		long long sumX = 0;
+		long long sumZ = 0;
+		int numRoads = 0;
+
+		for (int j = 0; j < numConnections; j++)
+		{
+			const int target = SurfaceIdToNode(connections[j]);
+
+			if (m_nodes[target].type == ROAD_NODE_JUNCTION)
+				continue;
+
+			const int end = GetEndTowards(map, target, node);
+
+			sumX += m_nodes[target].ends[end].x;
+			sumZ += m_nodes[target].ends[end].z;
+			numRoads++;
+		}
+
+		if (!numRoads)
+			continue;
+
+		m_nodes[node].ends[0].x = m_nodes[node].ends[1].x = (int)(sumX / numRoads);
+		m_nodes[node].ends[0].z = m_nodes[node].ends[1].z = (int)(sumZ / numRoads);
+	}
+}
+
+//-------------------------------------------------------------
+// Returns valid ConnectIdx/ExitIdx of the node
+//-------------------------------------------------------------
+int CDriver2RoadGraph::GetConnectionCount(const CDriver2LevelMap* map, int node, short* outConnections) const
+{
+	const short* connectIdx;
+	const int surfId = m_nodes[node].surfId;
+
+	switch (m_nodes[node].type)
+	{
+		case ROAD_NODE_STRAIGHT:
+			connectIdx = map->GetStraight(surfId)->ConnectIdx;
+			break;
+		case ROAD_NODE_CURVE:
+			connectIdx = map->GetCurve(surfId)->ConnectIdx;
+			break;
+		default:
+			connectIdx = map->GetJunction(surfId)->ExitIdx;
+			break;
+	}
+
+	int numConnections = 0;
+
+	for (int i = 0; i < 4; i++)
+	{
+		if (SurfaceIdToNode(connectIdx[i]) == -1)
+			continue;
+
+		outConnections[numConnections++] = connectIdx[i];
+	}
+
+	return numConnections;
+}
+
+//-------------------------------------------------------------
+// Finds out which end of the node is connected to target
+//-------------------------------------------------------------
+int CDriver2RoadGraph::GetEndTowards(const CDriver2LevelMap* map, int node, int target) const
+{
+	if (m_nodes[node].type == ROAD_NODE_JUNCTION)
+		return 0;
+
+	XZPAIR points[8];
+	int numPoints = 0;
+
+	if (m_nodes[target].type == ROAD_NODE_JUNCTION)
+	{
+		// all roads leading to junction are ending near it
+		short connections[4];
+		const int numConnections = GetConnectionCount(map, target, connections);
+
+		for (int i = 0; i < numConnections; i++)
+		{
+			const int exitNode = SurfaceIdToNode(connections[i]);
+
+			if (exitNode == node || m_nodes[exitNode].type == ROAD_NODE_JUNCTION)
+				continue;
+
+			points[numPoints++] = m_nodes[exitNode].ends[0];
+			points[numPoints++] = m_nodes[exitNode].ends[1];
+		}
+	}
+	else
+	{
+		points[numPoints++] = m_nodes[target].ends[0];
+		points[numPoints++] = m_nodes[target].ends[1];
+	}
+
+	int bestEnd = 0;
+	long long bestDist = -1;
+
+	for (int e = 0; e < 2; e++)
+	{
+		const XZPAIR& endPos = m_nodes[node].ends[e];
+
+		for (int i = 0; i < numPoints; i++)
+		{
+			const long long dx = points[i].x - endPos.x;
+			const long long dz = points[i].z - endPos.z;
+			const long long dist = dx * dx + dz * dz;
+
+			if (bestDist < 0 || dist < bestDist)
+			{
+				bestDist = dist;
+				bestEnd = e;
+			}
+		}
+	}
+
+	return bestEnd;
+}
+
+//-------------------------------------------------------------
+// Lanes that are heading towards the end
+//-------------------------------------------------------------
+uint CDriver2RoadGraph::GetLanesLeavingAt(int node, int end) const
+{
+	const RoadGraphNode_t& nd = m_nodes[node];
+
+	if (nd.type == ROAD_NODE_JUNCTION)
+		return 1;
+
+	const uint allLanes = nd.numLanes >= ROAD_GRAPH_MAX_LANES ? 0xFFFFFFFF : (1U << nd.numLanes) - 1;
+
+	// ROAD_LANE_DIR is set for lanes driving from the end to the start
+	return end ? (~nd.laneDirMask & allLanes) : (nd.laneDirMask & allLanes);
+}
+
+void CDriver2RoadGraph::BuildEdges(const CDriver2LevelMap* map)
+{
+	m_edgeStart = new int[m_numNodes + 1];
+
+	// count
+	m_numEdges = 0;
+
+	for (int i = 0; i < m_numNodes; i++)
+	{
+		short connections[4];
+
+		m_edgeStart[i] = m_numEdges;
+		m_numEdges += GetConnectionCount(map, i, connections);
+	}
+
+	m_edgeStart[m_numNodes] = m_numEdges;
+
+	m_edges = new RoadGraphEdge_t[m_numEdges];
+
+	// fill
+	for (int i = 0; i < m_numNodes; i++)
+	{
+		const short* connectIdx;
+		const RoadGraphNode_t& nd = m_nodes[i];
+
+		switch (nd.type)
+		{
+			case ROAD_NODE_STRAIGHT:
+				connectIdx = map->GetStraight(nd.surfId)->ConnectIdx;
+				break;
+			case ROAD_NODE_CURVE:
+				connectIdx = map->GetCurve(nd.surfId)->ConnectIdx;
+				break;
+			default:
+				connectIdx = map->GetJunction(nd.surfId)->ExitIdx;
+				break;
+		}
+
+		RoadGraphEdge_t* edge = m_edges + m_edgeStart[i];
+
+		for (int j = 0; j < 4; j++)
+		{
+			const int target = SurfaceIdToNode(connectIdx[j]);
+
+			if (target == -1)
+				continue;
+
+			const RoadGraphNode_t& td = m_nodes[target];
+
+			edge->to = target;
+			edge->slot = j;
+			edge->fromEnd = GetEndTowards(map, i, target);
+			edge->toEnd = GetEndTowards(map, target, i);
+
+			edge->exitLanes = GetLanesLeavingAt(i, edge->fromEnd);
+			edge->entryLanes = GetLanesLeavingAt(target, edge->toEnd ^ 1);
+
+			edge->aiExitLanes = edge->exitLanes & nd.aiLaneMask;
+			edge->aiEntryLanes = edge->entryLanes & td.aiLaneMask;
+
+			edge->flags = 0;
+
+			if (edge->exitLanes && edge->entryLanes)
+				edge->flags |= ROAD_EDGE_DRIVEABLE;
+
+			if (edge->aiExitLanes && edge->aiEntryLanes)
+				edge->flags |= ROAD_EDGE_AI;
+
+			if (nd.type == ROAD_NODE_JUNCTION || td.type == ROAD_NODE_JUNCTION)
+				edge->flags |= ROAD_EDGE_JUNCTION;
+
+			// check back reference
+			short backConnections[4];
+			const int numBack = GetConnectionCount(map, target, backConnections);
+
+			edge->flags |= ROAD_EDGE_ONE_SIDED;
+
+			for (int k = 0; k < numBack; k++)
+			{
+				if (backConnections[k] == nd.surfId)
+				{
+					edge->flags &= ~ROAD_EDGE_ONE_SIDED;
+					break;
+				}
+			}
+
+			edge++;
+		}
+	}
+}
@@ -0,0 +1,115 @@
+#ifndef ROADGRAPH_D2_H
+#define ROADGRAPH_D2_H
+
+#include "core/dktypes.h"
+#include "math/psx_math_types.h"
+
+//----------------------------------------------------------------------------------
+// DRIVER 2 road network graph
+//
+// Every straight, curve and junction is a node. Edges are built from
+// ConnectIdx/ExitIdx and stored in CSR form: edges of node N are
+// m_edges[m_edgeStart[N] .. m_edgeStart[N+1]-1]
+//----------------------------------------------------------------------------------
+
+class CDriver2LevelMap;
+
+#define ROAD_GRAPH_MAX_LANES		32
+
+enum ERoadNodeType
+{
+	ROAD_NODE_STRAIGHT = 0,
+	ROAD_NODE_CURVE,
+	ROAD_NODE_JUNCTION,
+};
+
+enum ERoadEdgeFlags
+{
+	ROAD_EDGE_DRIVEABLE		= (1 << 0),		// there are lanes that leave the node and lanes that continue on the target
+	ROAD_EDGE_AI			= (1 << 1),		// same as above, but only AI lanes counted
+	ROAD_EDGE_JUNCTION		= (1 << 2),		// either side is a junction
+	ROAD_EDGE_ONE_SIDED		= (1 << 3),		// target node has no ConnectIdx/ExitIdx back to us
+};
+
+struct RoadGraphNode_t
+{
+	int			surfId;				// original surface ID (0x0000 - straight, 0x4000 - curve, 0x2000 - junction)
+	int			length;				// along the middle of the road, world units
+	XZPAIR		ends[2];			// [0] - start, [1] - end (junctions have both at centroid of their exits)
+
+	uint		laneDirMask;		// lanes that drive from the end to the start (ROAD_LANE_DIR set)
+	uint		aiLaneMask;			// lanes that AI can drive on
+
+	ubyte		type;				// ERoadNodeType
+	ubyte		numLanes;			// ROAD_WIDTH_IN_LANES
+	ushort		pad;
+};
+
+struct RoadGraphEdge_t
+{
+	int			to;					// target node index
+
+	uint		exitLanes;			// lanes of source node that leave through this connection
+	uint		entryLanes;			// lanes of target node that continue from this connection
+	uint		aiExitLanes;		// exitLanes & AI lanes
+	uint		aiEntryLanes;		// entryLanes & AI lanes
+
+	ubyte		fromEnd;			// source node end (0 - start, 1 - end)
+	ubyte		toEnd;				// target node end
+	ubyte		slot;				// ConnectIdx/ExitIdx slot
+	ubyte		flags;				// ERoadEdgeFlags
+};
+
+class CDriver2RoadGraph
+{
+public:
+	CDriver2RoadGraph();
+	~CDriver2RoadGraph();
+
+	void						Build(const CDriver2LevelMap* map);
+	void						Release();
+
+	bool						IsBuilt() const;
+
+	int							GetNodeCount() const;
+	int							GetEdgeCount() const;
+
+	const RoadGraphNode_t&		GetNode(int node) const;
+
+	// fast neighbour iteration
+	const RoadGraphEdge_t*		GetEdges(int node, int& numEdges) const;
+	const RoadGraphEdge_t*		EdgesBegin(int node) const;
+	const RoadGraphEdge_t*		EdgesEnd(int node) const;
+
+	// surface ID <-> node index. Returns -1 if not a road surface
+	int							SurfaceIdToNode(int surfId) const;
+	int							NodeToSurfaceId(int node) const;
+
+	// lane position helpers (world units, Y is zero)
+	void						GetLanePosition(int node, int lane, int end, XZPAIR& outPos) const;
+
+	// lanes of the node that are heading towards the end (0 - start, 1 - end)
+	uint						GetLanesLeavingAt(int node, int end) const;
+
+protected:
+	void						BuildNodes(const CDriver2LevelMap* map);
+	void						BuildEdges(const CDriver2LevelMap* map);
+
+	int							GetConnectionCount(const CDriver2LevelMap* map, int node, short* outConnections) const;
+	int							GetEndTowards(const CDriver2LevelMap* map, int node, int target) const;
+
+	const CDriver2LevelMap*		m_map{ nullptr };
+
+	RoadGraphNode_t*			m_nodes{ nullptr };
+	int*						m_edgeStart{ nullptr };		// m_numNodes + 1 entries
+	RoadGraphEdge_t*			m_edges{ nullptr };
+
+	int							m_numNodes{ 0 };
+	int							m_numEdges{ 0 };
+
+	int							m_numStraights{ 0 };
+	int							m_numCurves{ 0 };
+	int							m_numJunctions{ 0 };
+};
+
+#endif // ROADGRAPH_D2_H
@@ -0,0 +1,493 @@
+#include "roadgrid_d2.h"
+#include "roadgraph_d2.h"
+#include "regions_d2.h"
+
+#include "core/cmdlib.h"
+#include "math/isin.h"
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#define ROAD_LANE_WIDTH			512
+#define ROAD_CURVE_BOUND_STEPS	16
+
+CDriver2RoadGrid::CDriver2RoadGrid()
+{
+}
+
+CDriver2RoadGrid::~CDriver2RoadGrid()
+{
+	Release();
+}
+
+void CDriver2RoadGrid::Release()
+{
+	delete[] m_items;
+	m_items = nullptr;
+
+	delete[] m_cellStart;
+	m_cellStart = nullptr;
+
+	delete[] m_cellItems;
+	m_cellItems = nullptr;
+
+	m_numItems = 0;
+	m_cellsX = 0;
+	m_cellsZ = 0;
+}
+
+bool CDriver2RoadGrid::IsBuilt() const
+{
+	return m_cellStart != nullptr;
+}
+
+//-------------------------------------------------------------
+// Converts item world bounds to cell bounds
+//-------------------------------------------------------------
+void CDriver2RoadGrid::InitItem(Item_t& item, int minX, int minZ, int maxX, int maxZ)
+{
+	item.cellMinX = (minX - m_originX) / m_cellSize;
+	item.cellMinZ = (minZ - m_originZ) / m_cellSize;
+	item.cellMaxX = (maxX - m_originX) / m_cellSize;
+	item.cellMaxZ = (maxZ - m_originZ) / m_cellSize;
+}
+
+//-------------------------------------------------------------
+// Builds grid from road lumps
+//-------------------------------------------------------------
+void CDriver2RoadGrid::Build(const CDriver2LevelMap* map, int cellSize)
+{
+	Release();
+
+	const int numStraights = map->GetNumStraights();
+	const int numCurves = map->GetNumCurves();
+
+	m_numItems = numStraights + numCurves;
+	m_cellSize = cellSize;
+
+	if (!m_numItems)
+		return;
+
+	m_items = new Item_t[m_numItems];
+
+	int* bounds = new int[m_numItems * 4];
+
+	int minX = INT_MAX, minZ = INT_MAX;
+	int maxX = INT_MIN, maxZ = INT_MIN;
+
+	auto addBoundPoint = [](int* itemBounds, int x, int z) {
+		if (x < itemBounds[0]) itemBounds[0] = x;
+		if (z < itemBounds[1]) itemBounds[1] = z;
+		if (x > itemBounds[2]) itemBounds[2] = x;
+		if (z > itemBounds[3]) itemBounds[3] = z;
+	};
+
+	for (int i = 0; i < numStraights; i++)
+	{
+		const DRIVER2_STRAIGHT* straight = map->GetStraight(i);
+		Item_t& item = m_items[i];
+		int* itemBounds = bounds + i * 4;
+
+		item.surfId = i;
+		item.type = ROAD_NODE_STRAIGHT;
+		item.x = straight->Midx;
+		item.z = straight->Midz;
+		item.numLanes = ROAD_WIDTH_IN_LANES(straight);
+		item.aiLaneMask = 0;
+
+		for (int j = 0; j < item.numLanes && j < 32; j++)
+			item.aiLaneMask |= ROAD_IS_AI_LANE(straight, j) << j;
+
+		item.straight.sn = isin(straight->angle);
+		item.straight.cs = icos(straight->angle);
+		item.straight.halfLength = straight->length / 2;
+		item.straight.halfWidth = item.numLanes * ROAD_LANE_WIDTH / 2;
+
+		itemBounds[0] = itemBounds[1] = INT_MAX;
+		itemBounds[2] = itemBounds[3] = INT_MIN;
+
+		for (int j = 0; j < 4; j++)
+		{
+			const int l = (j & 1) ? item.straight.halfLength : -item.straight.halfLength;
+			const int w = (j & 2) ? item.straight.halfWidth : -item.straight.halfWidth;
+
+			addBoundPoint(itemBounds,
+				item.x + (l * item.straight.sn - w * item.straight.cs) / ONE,
+				item.z + (l * item.straight.cs + w * item.straight.sn) / ONE);
+		}
+	}
+
+	for (int i = 0; i < numCurves; i++)
+	{
+		const DRIVER2_CURVE* curve = map->GetCurve(i | 0x4000);
+		Item_t& item = m_items[numStraights + i];
+		int* itemBounds = bounds + (numStraights + i) * 4;
+
+		item.surfId = i | 0x4000;
+		item.type = ROAD_NODE_CURVE;
+		item.x = curve->Midx;
+		item.z = curve->Midz;
+		item.numLanes = ROAD_WIDTH_IN_LANES(curve);
+		item.aiLaneMask = 0;
+
+		for (int j = 0; j < item.numLanes && j < 32; j++)
+			item.aiLaneMask |= ROAD_IS_AI_LANE(curve, j) << j;
+
+		item.curve.start = curve->start & 4095;
+		item.curve.end = curve->end & 4095;
+		item.curve.innerRadius = curve->inside * 1024;
+		item.curve.outerRadius = item.curve.innerRadius + item.numLanes * ROAD_LANE_WIDTH;
+
+		itemBounds[0] = itemBounds[1] = INT_MAX;
+		itemBounds[2] = itemBounds[3] = INT_MIN;
+
+		// sample arc at both radii, grow by a lane to cover chord error
+		const int curveLength = curve->end - curve->start & 4095;
+
+		for (int j = 0; j <= ROAD_CURVE_BOUND_STEPS; j++)
+		{
+			const int angle = curve->start + curveLength * j / ROAD_CURVE_BOUND_STEPS;
+			const int sn = isin(angle);
+			const int cs = icos(angle);
+
+			addBoundPoint(itemBounds, item.x + item.curve.innerRadius * sn / ONE, item.z + item.curve.innerRadius * cs / ONE);
+			addBoundPoint(itemBounds, item.x + item.curve.outerRadius * sn / ONE, item.z + item.curve.outerRadius * cs / ONE);
+		}
+
+		itemBounds[0] -= ROAD_LANE_WIDTH;
+		itemBounds[1] -= ROAD_LANE_WIDTH;
+		itemBounds[2] += ROAD_LANE_WIDTH;
+		itemBounds[3] += ROAD_LANE_WIDTH;
+	}
+
+	for (int i = 0; i < m_numItems; i++)
+	{
+		const int* itemBounds = bounds + i * 4;
+
+		if (itemBounds[0] < minX) minX = itemBounds[0];
+		if (itemBounds[1] < minZ) minZ = itemBounds[1];
+		if (itemBounds[2] > maxX) maxX = itemBounds[2];
+		if (itemBounds[3] > maxZ) maxZ = itemBounds[3];
+	}
+
+	m_originX = minX;
+	m_originZ = minZ;
+	m_cellsX = (maxX - minX) / m_cellSize + 1;
+	m_cellsZ = (maxZ - minZ) / m_cellSize + 1;
+
+	for (int i = 0; i < m_numItems; i++)
+	{
+		const int* itemBounds = bounds + i * 4;
+		InitItem(m_items[i], itemBounds[0], itemBounds[1], itemBounds[2], itemBounds[3]);
+	}
+
+	delete[] bounds;
+
+	// count and fill cells
+	const int numCells = m_cellsX * m_cellsZ;
+
+	m_cellStart = new int[numCells + 1];
+	memset(m_cellStart, 0, sizeof(int) * (numCells + 1));
+
+	for (int i = 0; i < m_numItems; i++)
+	{
+		const Item_t& item = m_items[i];
+
+		for (int z = item.cellMinZ; z <= item.cellMaxZ; z++)
+		{
+			for (int x = item.cellMinX; x <= item.cellMaxX; x++)
+				m_cellStart[z * m_cellsX + x + 1]++;
+		}
+	}
+
+	for (int i = 0; i < numCells; i++)
+		m_cellStart[i + 1] += m_cellStart[i];
+
+	m_cellItems = new int[m_cellStart[numCells]];
+
+	int* cellFill = new int[numCells];
+	memcpy(cellFill, m_cellStart, sizeof(int) * numCells);
+
+	for (int i = 0; i < m_numItems; i++)
+	{
+		const Item_t& item = m_items[i];
+
+		for (int z = item.cellMinZ; z <= item.cellMaxZ; z++)
+		{
+			for (int x = item.cellMinX; x <= item.cellMaxX; x++)
+				m_cellItems[cellFill[z * m_cellsX + x]++] = i;
+		}
+	}
+
+	delete[] cellFill;
+
+	DevMsg(SPEW_INFO, "Road grid: %d roads, %dx%d cells, %d references\n", m_numItems, m_cellsX, m_cellsZ, m_cellStart[numCells]);
+}
+
+//-------------------------------------------------------------
+// Calls callback once for each item that overlaps bounds
+//-------------------------------------------------------------
+template<typename CB>
+void CDriver2RoadGrid::VisitItems(int minX, int minZ, int maxX, int maxZ, CB callback) const
+{
+	// use floor division for cells before origin
+	auto toCell = [](int value, int cellSize) {
+		return value >= 0 ? value / cellSize : -((-value + cellSize - 1) / cellSize);
+	};
+
+	int x0 = toCell(minX - m_originX, m_cellSize);
+	int z0 = toCell(minZ - m_originZ, m_cellSize);
+	int x1 = toCell(maxX - m_originX, m_cellSize);
+	int z1 = toCell(maxZ - m_originZ, m_cellSize);
+
+	if (x1 < 0 || z1 < 0 || x0 >= m_cellsX || z0 >= m_cellsZ)
+		return;
+
+	if (x0 < 0) x0 = 0;
+	if (z0 < 0) z0 = 0;
+	if (x1 >= m_cellsX) x1 = m_cellsX - 1;
+	if (z1 >= m_cellsZ) z1 = m_cellsZ - 1;
+
+	for (int z = z0; z <= z1; z++)
+	{
+		for (int x = x0; x <= x1; x++)
+		{
+			const int cell = z * m_cellsX + x;
+
+			for (int i = m_cellStart[cell]; i < m_cellStart[cell + 1]; i++)
+			{
+				const Item_t& item = m_items[m_cellItems[i]];
+
+				// report only in first shared cell
+				const int firstX = item.cellMinX > x0 ? item.cellMinX : x0;
+				const int firstZ = item.cellMinZ > z0 ? item.cellMinZ : z0;
+
+				if (firstX != x || firstZ != z)
+					continue;
+
+				callback(item);
+			}
+		}
+	}
+}
+
+//-------------------------------------------------------------
+// Returns distance from position to road and lane on it
+//-------------------------------------------------------------
+int CDriver2RoadGrid::TestItem(const Item_t& item, const XZPAIR& position, int& outLane) const
+{
+	const double dx = (double)position.x - item.x;
+	const double dz = (double)position.z - item.z;
+
+	double offset;
+	double dist;
+
+	if (item.type == ROAD_NODE_STRAIGHT)
+	{
+		const double u = (dx * item.straight.sn + dz * item.straight.cs) / ONE;
+		const double v = (-dx * item.straight.cs + dz * item.straight.sn) / ONE;
+
+		double du = fabs(u) - item.straight.halfLength;
+		double dv = fabs(v) - item.straight.halfWidth;
+
+		if (du < 0.0) du = 0.0;
+		if (dv < 0.0) dv = 0.0;
+
+		dist = sqrt(du * du + dv * dv);
+		offset = v + item.straight.halfWidth;
+	}
+	else
+	{
+		const double r = sqrt(dx * dx + dz * dz);
+
+		int angle = (int)(atan2(dx, dz) * (4096.0 / (2.0 * 3.14159265358979)));
+		angle &= 4095;
+
+		const int curveLength = item.curve.end - item.curve.start & 4095;
+
+		if ((angle - item.curve.start & 4095) <= curveLength)
+		{
+			dist = 0.0;
+
+			if (r < item.curve.innerRadius)
+				dist = item.curve.innerRadius - r;
+			else if (r > item.curve.outerRadius)
+				dist = r - item.curve.outerRadius;
+
+			offset = r - item.curve.innerRadius;
+		}
+		else
+		{
+			// distance to the nearest curve end cap
+			dist = -1.0;
+			offset = 0.0;
+
+			for (int i = 0; i < 2; i++)
+			{
+				const int capAngle = i ? item.curve.end : item.curve.start;
+				const double sn = isin(capAngle) / ONE_F;
+				const double cs = icos(capAngle) / ONE_F;
+
+				double t = dx * sn + dz * cs;
+
+				if (t < item.curve.innerRadius)
+					t = item.curve.innerRadius;
+				else if (t > item.curve.outerRadius)
+					t = item.curve.outerRadius;
+
+				const double px = dx - sn * t;
+				const double pz = dz - cs * t;
+				const double capDist = sqrt(px * px + pz * pz);
+
+				if (dist < 0.0 || capDist < dist)
+				{
+					dist = capDist;
+					offset = t - item.curve.innerRadius;
+				}
+			}
+		}
+	}
+
+	int lane = (int)floor(offset / ROAD_LANE_WIDTH);
+
+	if (lane < 0)
+		lane = 0;
+	else if (lane >= item.numLanes)
+		lane = item.numLanes - 1;
+
+	outLane = lane;
+
+	return (int)dist;
+}
+
+int CDriver2RoadGrid::GetNearestLane(const Item_t& item, int lane, int flags) const
+{
+	if (!(flags & ROAD_QUERY_AI_LANES))
+		return lane;
+
+	for (int i = 0; i < item.numLanes; i++)
+	{
+		if (lane - i >= 0 && (item.aiLaneMask & (1U << (lane - i))))
+			return lane - i;
+
+		if (lane + i < item.numLanes && (item.aiLaneMask & (1U << (lane + i))))
+			return lane + i;
+	}
+
+	return -1;
+}
+
+//-------------------------------------------------------------
+// Queries
+//-------------------------------------------------------------
+bool CDriver2RoadGrid::FindNearestRoad(const XZPAIR& position, RoadQueryResult_t& result, int maxDist, RoadQueryFilterFunc filter, void* userData) const
+{
+	result.surfId = -1;
+	result.lane = -1;
+	result.distance = maxDist;
+
+	if (!m_cellStart)
+		return false;
+
+	// grow search radius until found road is closer than radius
+	for (int radius = m_cellSize / 2; ; radius *= 2)
+	{
+		if (radius > maxDist)
+			radius = maxDist;
+
+		VisitItems(position.x - radius, position.z - radius, position.x + radius, position.z + radius, [&](const Item_t& item) {
+			int lane;
+			const int dist = TestItem(item, position, lane);
+
+			if (dist > result.distance || (dist == result.distance && result.surfId != -1))
+				return;
+
+			if (filter && !filter(item.surfId, userData))
+				return;
+
+			result.surfId = item.surfId;
+			result.lane = lane;
+			result.distance = dist;
+		});
+
+		if ((result.surfId != -1 && result.distance <= radius) || radius >= maxDist)
+			break;
+	}
+
+	return result.surfId != -1;
+}
+
+bool CDriver2RoadGrid::FindNearestLane(const XZPAIR& position, RoadQueryResult_t& result, int flags, int maxDist) const
+{
+	result.surfId = -1;
+	result.lane = -1;
+	result.distance = maxDist;
+
+	if (!m_cellStart)
+		return false;
+
+	for (int radius = m_cellSize / 2; ; radius *= 2)
+	{
+		if (radius > maxDist)
+			radius = maxDist;
+
+		VisitItems(position.x - radius, position.z - radius, position.x + radius, position.z + radius, [&](const Item_t& item) {
+			if ((flags & ROAD_QUERY_AI_LANES) && !item.aiLaneMask)
+				return;
+
+			int lane;
+			const int dist = TestItem(item, position, lane);
+
+			if (dist > result.distance || (dist == result.distance && result.surfId != -1))
+				return;
+
+			result.surfId = item.surfId;
+			result.lane = GetNearestLane(item, lane, flags);
+			result.distance = dist;
+		});
+
+		if ((result.surfId != -1 && result.distance <= radius) || radius >= maxDist)
+			break;
+	}
+
+	return result.surfId != -1;
+}
+
+int CDriver2RoadGrid::FindRoadsInRadius(const XZPAIR& position, int radius, RoadQueryResult_t* results, int maxResults) const
+{
+	if (!m_cellStart)
+		return 0;
+
+	int numResults = 0;
+
+	VisitItems(position.x - radius, position.z - radius, position.x + radius, position.z + radius, [&](const Item_t& item) {
+		if (numResults >= maxResults)
+			return;
+
+		int lane;
+		const int dist = TestItem(item, position, lane);
+
+		if (dist > radius)
+			return;
+
+		RoadQueryResult_t& res = results[numResults++];
+		res.surfId = item.surfId;
+		res.lane = lane;
+		res.distance = dist;
+	});
+
+	return numResults;
+}
+
+void CDriver2RoadGrid::FindNearestRoads(const XZPAIR* positions, int count, RoadQueryResult_t* results, int maxDist) const
+{
+	for (int i = 0; i < count; i++)
+		FindNearestRoad(positions[i], results[i], maxDist);
+}
+
+void CDriver2RoadGrid::FindNearestLanes(const XZPAIR* positions, int count, RoadQueryResult_t* results, int flags, int maxDist) const
+{
+	for (int i = 0; i < count; i++)
+		FindNearestLane(positions[i], results[i], flags, maxDist);
+}
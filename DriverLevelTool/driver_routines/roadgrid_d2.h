@@ -0,0 +1,110 @@
+#ifndef ROADGRID_D2_H
+#define ROADGRID_D2_H
+
+#include "core/dktypes.h"
+#include "math/psx_math_types.h"
+
+//----------------------------------------------------------------------------------
+// DRIVER 2 road spatial index
+//
+// Uniform grid over straights (oriented boxes) and curves (annular sectors).
+// Each road is referenced by every cell its bounds overlap; queries report
+// a road once by testing it only in the first cell shared with query bounds.
+//----------------------------------------------------------------------------------
+
+class CDriver2LevelMap;
+
+#define ROAD_GRID_DEFAULT_CELL_SIZE		4096
+#define ROAD_GRID_DEFAULT_MAX_DIST		65536
+
+enum ERoadQueryFlags
+{
+	ROAD_QUERY_AI_LANES		= (1 << 0),		// road must have AI lanes, nearest AI lane is reported
+};
+
+struct RoadQueryResult_t
+{
+	int			surfId;			// -1 if nothing found
+	int			lane;			// lane index the point is on (or nearest to)
+	int			distance;		// distance to the road surface bounds, zero if inside
+};
+
+// returns false if road should be skipped
+typedef bool (*RoadQueryFilterFunc)(int surfId, void* userData);
+
+class CDriver2RoadGrid
+{
+public:
+	CDriver2RoadGrid();
+	~CDriver2RoadGrid();
+
+	void						Build(const CDriver2LevelMap* map, int cellSize = ROAD_GRID_DEFAULT_CELL_SIZE);
+	void						Release();
+
+	bool						IsBuilt() const;
+
+	// nearest road of any type
+	bool						FindNearestRoad(const XZPAIR& position, RoadQueryResult_t& result, int maxDist = ROAD_GRID_DEFAULT_MAX_DIST,
+									RoadQueryFilterFunc filter = nullptr, void* userData = nullptr) const;
+
+	// nearest road lane, ERoadQueryFlags
+	bool						FindNearestLane(const XZPAIR& position, RoadQueryResult_t& result, int flags, int maxDist = ROAD_GRID_DEFAULT_MAX_DIST) const;
+
+	// all roads within radius, returns count written to results
+	int							FindRoadsInRadius(const XZPAIR& position, int radius, RoadQueryResult_t* results, int maxResults) const;
+
+	// batched versions. Results not found have surfId = -1
+	void						FindNearestRoads(const XZPAIR* positions, int count, RoadQueryResult_t* results, int maxDist = ROAD_GRID_DEFAULT_MAX_DIST) const;
+	void						FindNearestLanes(const XZPAIR* positions, int count, RoadQueryResult_t* results, int flags, int maxDist = ROAD_GRID_DEFAULT_MAX_DIST) const;
+
+protected:
+	struct Item_t
+	{
+		int			surfId;
+		int			x, z;						// straight middle or curve center
+
+		union
+		{
+			struct
+			{
+				int		sn, cs;					// direction
+				int		halfLength;
+				int		halfWidth;
+			} straight;
+			struct
+			{
+				int		start, end;				// angles
+				int		innerRadius;
+				int		outerRadius;
+			} curve;
+		};
+
+		uint		aiLaneMask;
+		short		numLanes;
+		short		type;						// ERoadNodeType
+		short		cellMinX, cellMinZ;
+		short		cellMaxX, cellMaxZ;
+	};
+
+	void						InitItem(Item_t& item, int minX, int minZ, int maxX, int maxZ);
+
+	int							TestItem(const Item_t& item, const XZPAIR& position, int& outLane) const;
+	int							GetNearestLane(const Item_t& item, int lane, int flags) const;
+
+	template<typename CB>
+	void						VisitItems(int minX, int minZ, int maxX, int maxZ, CB callback) const;
+
+	Item_t*						m_items{ nullptr };
+	int							m_numItems{ 0 };
+
+	int*						m_cellStart{ nullptr };
+	int*						m_cellItems{ nullptr };
+
+	int							m_cellSize{ ROAD_GRID_DEFAULT_CELL_SIZE };
+	int							m_originX{ 0 };
+	int							m_originZ{ 0 };
+	int							m_cellsX{ 0 };
+	int							m_cellsZ{ 0 };
+};
+
+#endif // ROADGRID_D2_H
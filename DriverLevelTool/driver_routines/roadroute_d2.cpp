@@ -0,0 +1,939 @@
+#include "roadroute_d2.h"
+
+#include "core/cmdlib.h"
+
+#include <nstd/Time.hpp>
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#define ROUTE_INFINITY				INT_MAX
+#define ROUTE_MAX_STATE_ARCS		4
+
+#define CH_WITNESS_SETTLE_LIMIT		64
+
+//-------------------------------------------------------------
+// Binary heap used by searches
+//-------------------------------------------------------------
+struct RouteHeapItem_t
+{
+	int key;
+	int state;
+};
+
+static void RouteHeapPush(Array<RouteHeapItem_t>& heap, int key, int state)
+{
+	RouteHeapItem_t item;
+	item.key = key;
+	item.state = state;
+
+	heap.append(item);
+
+	int i = (int)heap.size() - 1;
+
+	while (i > 0)
+	{
+		const int parent = (i - 1) / 2;
+
+		if (heap[parent].key <= item.key)
+			break;
+
+		heap[i] = heap[parent];
+		i = parent;
+	}
+
+	heap[i] = item;
+}
+
+static RouteHeapItem_t RouteHeapPop(Array<RouteHeapItem_t>& heap)
+{
+	const RouteHeapItem_t top = heap[0];
+	const RouteHeapItem_t last = heap[heap.size() - 1];
+
+	heap.resize(heap.size() - 1);
+
+	const int count = (int)heap.size();
+
+	if (!count)
+		return top;
+
+	int i = 0;
+
+	while (true)
+	{
+		int child = i * 2 + 1;
+
+		if (child >= count)
+			break;
+
+		if (child + 1 < count && heap[child + 1].key < heap[child].key)
+			child++;
+
+		if (last.key <= heap[child].key)
+			break;
+
+		heap[i] = heap[child];
+		i = child;
+	}
+
+	heap[i] = last;
+
+	return top;
+}
+
+static int RouteDistance(const XZPAIR& a, const XZPAIR& b)
+{
+	const double dx = (double)a.x - (double)b.x;
+	const double dz = (double)a.z - (double)b.z;
+
+	return (int)sqrt(dx * dx + dz * dz);
+}
+
+//-------------------------------------------------------------
+
+CDriver2RoadRouter::CDriver2RoadRouter()
+{
+}
+
+CDriver2RoadRouter::~CDriver2RoadRouter()
+{
+	Release();
+}
+
+void CDriver2RoadRouter::Init(const CDriver2RoadGraph* graph, int flags)
+{
+	Release();
+
+	m_graph = graph;
+	m_flags = flags;
+	m_numStates = graph->GetNodeCount() * 2;
+}
+
+void CDriver2RoadRouter::Release()
+{
+	delete[] m_rank;
+	m_rank = nullptr;
+
+	delete[] m_upStart;
+	m_upStart = nullptr;
+
+	delete[] m_upArcs;
+	m_upArcs = nullptr;
+
+	delete[] m_downStart;
+	m_downStart = nullptr;
+
+	delete[] m_downArcs;
+	m_downArcs = nullptr;
+
+	m_graph = nullptr;
+	m_grid = nullptr;
+	m_numStates = 0;
+}
+
+void CDriver2RoadRouter::SetSpatialIndex(const CDriver2RoadGrid* grid)
+{
+	m_grid = grid;
+}
+
+bool CDriver2RoadRouter::HasContractionHierarchy() const
+{
+	return m_rank != nullptr;
+}
+
+//-------------------------------------------------------------
+// State is (node, end car is heading to)
+//-------------------------------------------------------------
+bool CDriver2RoadRouter::IsStateUsable(int state) const
+{
+	const int node = state >> 1;
+	const int end = state & 1;
+
+	const RoadGraphNode_t& nd = m_graph->GetNode(node);
+
+	if (nd.type == ROAD_NODE_JUNCTION)
+		return end == 0;
+
+	uint lanes = m_graph->GetLanesLeavingAt(node, end);
+
+	if (m_flags & ROAD_ROUTE_AI_LANES_ONLY)
+		lanes &= nd.aiLaneMask;
+
+	return lanes != 0;
+}
+
+void CDriver2RoadRouter::GetStatePosition(int state, XZPAIR& outPos) const
+{
+	outPos = m_graph->GetNode(state >> 1).ends[state & 1];
+}
+
+int CDriver2RoadRouter::GetStateArcs(int state, Arc_t* outArcs) const
+{
+	const int node = state >> 1;
+	const int end = state & 1;
+
+	const RoadGraphNode_t& nd = m_graph->GetNode(node);
+	const bool aiOnly = (m_flags & ROAD_ROUTE_AI_LANES_ONLY) != 0;
+
+	XZPAIR statePos;
+	GetStatePosition(state, statePos);
+
+	int numArcs = 0;
+
+	for (const RoadGraphEdge_t* edge = m_graph->EdgesBegin(node); edge != m_graph->EdgesEnd(node); edge++)
+	{
+		if (nd.type != ROAD_NODE_JUNCTION && edge->fromEnd != end)
+			continue;
+
+		const uint exitLanes = aiOnly ? edge->aiExitLanes : edge->exitLanes;
+		const uint entryLanes = aiOnly ? edge->aiEntryLanes : edge->entryLanes;
+
+		if (!exitLanes || !entryLanes)
+			continue;
+
+		const RoadGraphNode_t& td = m_graph->GetNode(edge->to);
+
+		Arc_t& arc = outArcs[numArcs++];
+
+		arc.target = td.type == ROAD_NODE_JUNCTION ? edge->to * 2 : edge->to * 2 + (edge->toEnd ^ 1);
+		arc.weight = RouteDistance(statePos, td.ends[edge->toEnd]) + td.length;
+		arc.mid = -1;
+	}
+
+	return numArcs;
+}
+
+//-------------------------------------------------------------
+// Nearest node which has any usable direction
+//-------------------------------------------------------------
+bool CDriver2RoadRouter::NearestNodeFilter(int surfId, void* userData)
+{
+	const CDriver2RoadRouter* router = (const CDriver2RoadRouter*)userData;
+	const int node = router->m_graph->SurfaceIdToNode(surfId);
+
+	return router->IsStateUsable(node * 2) || router->IsStateUsable(node * 2 + 1);
+}
+
+int CDriver2RoadRouter::FindNearestNode(const XZPAIR& position) const
+{
+	if (m_grid && m_grid->IsBuilt())
+	{
+		RoadQueryResult_t result;
+
+		if (m_grid->FindNearestRoad(position, result, ROAD_GRID_DEFAULT_MAX_DIST, NearestNodeFilter, (void*)this))
+			return m_graph->SurfaceIdToNode(result.surfId);
+	}
+
+	int bestNode = -1;
+	double bestDist = 0.0;
+
+	for (int i = 0; i < m_graph->GetNodeCount(); i++)
+	{
+		const RoadGraphNode_t& nd = m_graph->GetNode(i);
+
+		if (nd.type == ROAD_NODE_JUNCTION)
+			continue;
+
+		if (!IsStateUsable(i * 2) && !IsStateUsable(i * 2 + 1))
+			continue;
+
+		// distance to the middle line
+		const double ax = nd.ends[0].x;
+		const double az = nd.ends[0].z;
+		const double abx = nd.ends[1].x - ax;
+		const double abz = nd.ends[1].z - az;
+
+		const double lenSqr = abx * abx + abz * abz;
+		double t = lenSqr > 0.0 ? ((position.x - ax) * abx + (position.z - az) * abz) / lenSqr : 0.0;
+
+		if (t < 0.0)
+			t = 0.0;
+		else if (t > 1.0)
+			t = 1.0;
+
+		const double dx = position.x - (ax + abx * t);
+		const double dz = position.z - (az + abz * t);
+		const double dist = dx * dx + dz * dz;
+
+		if (bestNode == -1 || dist < bestDist)
+		{
+			bestDist = dist;
+			bestNode = i;
+		}
+	}
+
+	return bestNode;
+}
+
+//-------------------------------------------------------------
+// Route queries
+//-------------------------------------------------------------
+bool CDriver2RoadRouter::FindRoute(const XZPAIR& from, const XZPAIR& to, Array<RoadRouteStep_t>& outRoute, RoadRouteStats_t* stats) const
+{
+	if (stats)
+		*stats = {};
+
+	const int startNode = FindNearestNode(from);
+	const int goalNode = FindNearestNode(to);
+
+	if (startNode == -1 || goalNode == -1)
+		return false;
+
+	return FindRoute(startNode, goalNode, outRoute, stats);
+}
+
+bool CDriver2RoadRouter::FindRoute(int startNode, int goalNode, Array<RoadRouteStep_t>& outRoute, RoadRouteStats_t* stats) const
+{
+	outRoute.clear();
+
+	if (stats)
+		*stats = {};
+
+	if (!m_graph || startNode < 0 || goalNode < 0 || startNode * 2 >= m_numStates || goalNode * 2 >= m_numStates)
+		return false;
+
+	const int64 startTime = Time::microTicks();
+
+	Array<int> states;
+	bool found;
+
+	if (m_rank)
+		found = FindRouteCH(startNode, goalNode, states, stats);
+	else
+		found = FindRouteAStar(startNode, goalNode, states, stats);
+
+	if (stats)
+		stats->queryTimeUs = (int)(Time::microTicks() - startTime);
+
+	if (!found)
+		return false;
+
+	// convert states to steps with accumulated distance
+	int distance = 0;
+
+	for (usize i = 0; i < states.size(); i++)
+	{
+		if (i > 0)
+		{
+			Arc_t arcs[ROUTE_MAX_STATE_ARCS];
+			const int numArcs = GetStateArcs(states[i - 1], arcs);
+
+			int weight = ROUTE_INFINITY;
+
+			for (int j = 0; j < numArcs; j++)
+			{
+				if (arcs[j].target == states[i] && arcs[j].weight < weight)
+					weight = arcs[j].weight;
+			}
+
+			if (weight != ROUTE_INFINITY)
+				distance += weight;
+		}
+
+		RoadRouteStep_t step;
+		step.node = states[i] >> 1;
+		step.surfId = m_graph->NodeToSurfaceId(step.node);
+		step.exitEnd = states[i] & 1;
+		step.distance = distance;
+
+		outRoute.append(step);
+	}
+
+	return true;
+}
+
+//-------------------------------------------------------------
+// Plain A* search. Heuristic is a distance to the goal node
+// bounds, so it remains zero on any goal state
+//-------------------------------------------------------------
+bool CDriver2RoadRouter::FindRouteAStar(int startNode, int goalNode, Array<int>& outStates, RoadRouteStats_t* stats) const
+{
+	const RoadGraphNode_t& goal = m_graph->GetNode(goalNode);
+
+	XZPAIR goalCenter;
+	goalCenter.x = goal.ends[0].x / 2 + goal.ends[1].x / 2;
+	goalCenter.z = goal.ends[0].z / 2 + goal.ends[1].z / 2;
+
+	const int goalRadius = RouteDistance(goalCenter, goal.ends[0]) + 1;
+
+	int* dist = new int[m_numStates];
+	int* parent = new int[m_numStates];
+	bool* closed = new bool[m_numStates];
+
+	for (int i = 0; i < m_numStates; i++)
+		dist[i] = ROUTE_INFINITY;
+
+	memset(parent, 0xFF, sizeof(int) * m_numStates);
+	memset(closed, 0, sizeof(bool) * m_numStates);
+
+	Array<RouteHeapItem_t> heap;
+
+	for (int i = 0; i < 2; i++)
+	{
+		const int state = startNode * 2 + i;
+
+		if (!IsStateUsable(state))
+			continue;
+
+		dist[state] = 0;
+		RouteHeapPush(heap, 0, state);
+	}
+
+	int goalState = -1;
+	int settled = 0;
+
+	while (heap.size())
+	{
+		const RouteHeapItem_t item = RouteHeapPop(heap);
+		const int state = item.state;
+
+		if (closed[state])
+			continue;
+
+		closed[state] = true;
+		settled++;
+
+		if ((state >> 1) == goalNode)
+		{
+			goalState = state;
+			break;
+		}
+
+		Arc_t arcs[ROUTE_MAX_STATE_ARCS];
+		const int numArcs = GetStateArcs(state, arcs);
+
+		for (int i = 0; i < numArcs; i++)
+		{
+			const int target = arcs[i].target;
+			const int newDist = dist[state] + arcs[i].weight;
+
+			if (closed[target] || newDist >= dist[target])
+				continue;
+
+			dist[target] = newDist;
+			parent[target] = state;
+
+			XZPAIR targetPos;
+			GetStatePosition(target, targetPos);
+
+			int h = RouteDistance(targetPos, goalCenter) - goalRadius;
+
+			if (h < 0)
+				h = 0;
+
+			RouteHeapPush(heap, newDist + h, target);
+		}
+	}
+
+	if (goalState != -1)
+	{
+		for (int state = goalState; state != -1; state = parent[state])
+			outStates.append(state);
+
+		// reverse
+		for (usize i = 0; i < outStates.size() / 2; i++)
+			QuickSwap(outStates[i], outStates[outStates.size() - 1 - i]);
+	}
+
+	if (stats)
+		stats->settledStates = settled;
+
+	delete[] dist;
+	delete[] parent;
+	delete[] closed;
+
+	return goalState != -1;
+}
+
+//-------------------------------------------------------------
+// Contraction hierarchy preprocessing
+//-------------------------------------------------------------
+struct CHWitnessSearch_t
+{
+	int*					dist;
+	Array<int>				touched;
+	Array<RouteHeapItem_t>	heap;
+};
+
+typedef Array<int> CHArcList_t;
+
+void CDriver2RoadRouter::BuildContractionHierarchy()
+{
+	if (!m_graph || !m_numStates)
+		return;
+
+	const int64 startTime = Time::microTicks();
+
+	delete[] m_rank;
+	m_rank = nullptr;
+
+	// dynamic arc storage during contraction. Arc lists keep indices into arcPool
+	Array<Arc_t> arcPool;
+	Array<int> arcSource;
+
+	CHArcList_t* outArcs = new CHArcList_t[m_numStates];
+	CHArcList_t* inArcs = new CHArcList_t[m_numStates];
+
+	for (int i = 0; i < m_numStates; i++)
+	{
+		if (!IsStateUsable(i))
+			continue;
+
+		Arc_t arcs[ROUTE_MAX_STATE_ARCS];
+		const int numArcs = GetStateArcs(i, arcs);
+
+		for (int j = 0; j < numArcs; j++)
+		{
+			outArcs[i].append(arcPool.size());
+			inArcs[arcs[j].target].append(arcPool.size());
+
+			arcPool.append(arcs[j]);
+			arcSource.append(i);
+		}
+	}
+
+	const int numOriginalArcs = arcPool.size();
+
+	bool* contracted = new bool[m_numStates];
+	int* rank = new int[m_numStates];
+	int* contractedNeighbours = new int[m_numStates];
+
+	memset(contracted, 0, sizeof(bool) * m_numStates);
+	memset(contractedNeighbours, 0, sizeof(int) * m_numStates);
+
+	CHWitnessSearch_t witness;
+	witness.dist = new int[m_numStates];
+
+	for (int i = 0; i < m_numStates; i++)
+		witness.dist[i] = ROUTE_INFINITY;
+
+	// runs limited Dijkstra from source avoiding the contracted state
+	auto witnessSearch = [&](int source, int avoid, int maxDist) {
+		for (usize i = 0; i < witness.touched.size(); i++)
+			witness.dist[witness.touched[i]] = ROUTE_INFINITY;
+
+		witness.touched.clear();
+		witness.heap.clear();
+
+		witness.dist[source] = 0;
+		witness.touched.append(source);
+		RouteHeapPush(witness.heap, 0, source);
+
+		int settled = 0;
+
+		while (witness.heap.size() && settled < CH_WITNESS_SETTLE_LIMIT)
+		{
+			const RouteHeapItem_t item = RouteHeapPop(witness.heap);
+
+			if (item.key > witness.dist[item.state])
+				continue;
+
+			if (item.key > maxDist)
+				break;
+
+			settled++;
+
+			const CHArcList_t& arcList = outArcs[item.state];
+
+			for (usize i = 0; i < arcList.size(); i++)
+			{
+				const Arc_t& arc = arcPool[arcList[i]];
+
+				if (arc.target == avoid || contracted[arc.target])
+					continue;
+
+				const int newDist = item.key + arc.weight;
+
+				if (newDist >= witness.dist[arc.target])
+					continue;
+
+				if (witness.dist[arc.target] == ROUTE_INFINITY)
+					witness.touched.append(arc.target);
+
+				witness.dist[arc.target] = newDist;
+				RouteHeapPush(witness.heap, newDist, arc.target);
+			}
+		}
+	};
+
+	// contracts state or only counts required shortcuts when simulating
+	auto contractState = [&](int state, bool simulate) -> int {
+		int numShortcuts = 0;
+
+		const CHArcList_t& inList = inArcs[state];
+		const CHArcList_t& outList = outArcs[state];
+
+		int maxOut = 0;
+
+		for (usize i = 0; i < outList.size(); i++)
+		{
+			const Arc_t& arc = arcPool[outList[i]];
+
+			if (!contracted[arc.target] && arc.weight > maxOut)
+				maxOut = arc.weight;
+		}
+
+		for (usize i = 0; i < inList.size(); i++)
+		{
+			const int inArcIdx = inList[i];
+			const int source = arcSource[inArcIdx];
+			const int inWeight = arcPool[inArcIdx].weight;
+
+			if (contracted[source] || source == state)
+				continue;
+
+			witnessSearch(source, state, inWeight + maxOut);
+
+			for (usize j = 0; j < outList.size(); j++)
+			{
+				const Arc_t outArc = arcPool[outList[j]];
+
+				if (contracted[outArc.target] || outArc.target == source || outArc.target == state)
+					continue;
+
+				const int viaDist = inWeight + outArc.weight;
+
+				if (witness.dist[outArc.target] <= viaDist)
+					continue;
+
+				numShortcuts++;
+
+				if (simulate)
+					continue;
+
+				// update existing arc or add new shortcut
+				CHArcList_t& sourceOut = outArcs[source];
+				bool updated = false;
+
+				for (usize k = 0; k < sourceOut.size(); k++)
+				{
+					Arc_t& existing = arcPool[sourceOut[k]];
+
+					if (existing.target != outArc.target)
+						continue;
+
+					if (viaDist < existing.weight)
+					{
+						existing.weight = viaDist;
+						existing.mid = state;
+					}
+
+					updated = true;
+					break;
+				}
+
+				if (!updated)
+				{
+					Arc_t shortcut;
+					shortcut.target = outArc.target;
+					shortcut.weight = viaDist;
+					shortcut.mid = state;
+
+					sourceOut.append(arcPool.size());
+					inArcs[outArc.target].append(arcPool.size());
+
+					arcPool.append(shortcut);
+					arcSource.append(source);
+				}
+
+				// shortcut is found by next witness searches
+				if (witness.dist[outArc.target] == ROUTE_INFINITY)
+					witness.touched.append(outArc.target);
+
+				witness.dist[outArc.target] = viaDist;
+			}
+		}
+
+		return numShortcuts;
+	};
+
+	auto statePriority = [&](int state) -> int {
+		int degree = 0;
+
+		for (usize i = 0; i < inArcs[state].size(); i++)
+			degree += contracted[arcSource[inArcs[state][i]]] ? 0 : 1;
+
+		for (usize i = 0; i < outArcs[state].size(); i++)
+			degree += contracted[arcPool[outArcs[state][i]].target] ? 0 : 1;
+
+		return contractState(state, true) * 2 - degree + contractedNeighbours[state];
+	};
+
+	// initial ordering
+	Array<RouteHeapItem_t> order;
+
+	for (int i = 0; i < m_numStates; i++)
+		RouteHeapPush(order, statePriority(i), i);
+
+	int nextRank = 0;
+
+	while (order.size())
+	{
+		RouteHeapItem_t item = RouteHeapPop(order);
+
+		if (contracted[item.state])
+			continue;
+
+		// lazy update
+		const int priority = statePriority(item.state);
+
+		if (order.size() && priority > order[0].key)
+		{
+			RouteHeapPush(order, priority, item.state);
+			continue;
+		}
+
+		contractState(item.state, false);
+
+		contracted[item.state] = true;
+		rank[item.state] = nextRank++;
+
+		for (usize i = 0; i < outArcs[item.state].size(); i++)
+			contractedNeighbours[arcPool[outArcs[item.state][i]].target]++;
+
+		for (usize i = 0; i < inArcs[item.state].size(); i++)
+			contractedNeighbours[arcSource[inArcs[item.state][i]]]++;
+	}
+
+	// split arcs into upward and downward CSR lists
+	m_upStart = new int[m_numStates + 1];
+	m_downStart = new int[m_numStates + 1];
+
+	memset(m_upStart, 0, sizeof(int) * (m_numStates + 1));
+	memset(m_downStart, 0, sizeof(int) * (m_numStates + 1));
+
+	for (usize i = 0; i < arcPool.size(); i++)
+	{
+		const int source = arcSource[i];
+		const int target = arcPool[i].target;
+
+		if (rank[target] > rank[source])
+			m_upStart[source + 1]++;
+		else
+			m_downStart[target + 1]++;
+	}
+
+	for (int i = 0; i < m_numStates; i++)
+	{
+		m_upStart[i + 1] += m_upStart[i];
+		m_downStart[i + 1] += m_downStart[i];
+	}
+
+	m_upArcs = new Arc_t[m_upStart[m_numStates]];
+	m_downArcs = new Arc_t[m_downStart[m_numStates]];
+
+	int* upFill = new int[m_numStates];
+	int* downFill = new int[m_numStates];
+
+	memcpy(upFill, m_upStart, sizeof(int) * m_numStates);
+	memcpy(downFill, m_downStart, sizeof(int) * m_numStates);
+
+	for (usize i = 0; i < arcPool.size(); i++)
+	{
+		const int source = arcSource[i];
+		const Arc_t& arc = arcPool[i];
+
+		if (rank[arc.target] > rank[source])
+		{
+			m_upArcs[upFill[source]++] = arc;
+		}
+		else
+		{
+			Arc_t& downArc = m_downArcs[downFill[arc.target]++];
+			downArc = arc;
+			downArc.target = source;
+		}
+	}
+
+	m_rank = rank;
+
+	delete[] upFill;
+	delete[] downFill;
+	delete[] witness.dist;
+	delete[] contracted;
+	delete[] contractedNeighbours;
+	delete[] outArcs;
+	delete[] inArcs;
+
+	MsgInfo("Contraction hierarchy: %d states, %d arcs, %d shortcuts, took %.2f ms\n",
+		m_numStates, numOriginalArcs, (int)arcPool.size() - numOriginalArcs, (Time::microTicks() - startTime) / 1000.0f);
+}
+
+const CDriver2RoadRouter::Arc_t* CDriver2RoadRouter::FindUpArc(int from, int to) const
+{
+	const Arc_t* best = nullptr;
+
+	for (int i = m_upStart[from]; i < m_upStart[from + 1]; i++)
+	{
+		if (m_upArcs[i].target == to && (!best || m_upArcs[i].weight < best->weight))
+			best = &m_upArcs[i];
+	}
+
+	return best;
+}
+
+const CDriver2RoadRouter::Arc_t* CDriver2RoadRouter::FindDownArc(int from, int to) const
+{
+	const Arc_t* best = nullptr;
+
+	for (int i = m_downStart[to]; i < m_downStart[to + 1]; i++)
+	{
+		if (m_downArcs[i].target == from && (!best || m_downArcs[i].weight < best->weight))
+			best = &m_downArcs[i];
+	}
+
+	return best;
+}
+
+//-------------------------------------------------------------
+// Appends states of the arc excluding the first one
+//-------------------------------------------------------------
+void CDriver2RoadRouter::UnpackArc(int from, int to, int mid, Array<int>& outStates) const
+{
+	if (mid == -1)
+	{
+		outStates.append(to);
+		return;
+	}
+
+	// contracted state always has lower rank than shortcut ends
+	const Arc_t* first = FindDownArc(from, mid);
+	const Arc_t* second = FindUpArc(mid, to);
+
+	if (!first || !second)
+	{
+		MsgError("Contraction hierarchy: unable to unpack shortcut %d -> %d\n", from, to);
+		outStates.append(to);
+		return;
+	}
+
+	UnpackArc(from, mid, first->mid, outStates);
+	UnpackArc(mid, to, second->mid, outStates);
+}
+
+//-------------------------------------------------------------
+// Bidirectional upward search
+//-------------------------------------------------------------
+bool CDriver2RoadRouter::FindRouteCH(int startNode, int goalNode, Array<int>& outStates, RoadRouteStats_t* stats) const
+{
+	int* distF = new int[m_numStates];
+	int* distB = new int[m_numStates];
+	int* parentF = new int[m_numStates];
+	int* parentB = new int[m_numStates];
+
+	for (int i = 0; i < m_numStates; i++)
+		distF[i] = distB[i] = ROUTE_INFINITY;
+
+	memset(parentF, 0xFF, sizeof(int) * m_numStates);
+	memset(parentB, 0xFF, sizeof(int) * m_numStates);
+
+	Array<RouteHeapItem_t> heapF;
+	Array<RouteHeapItem_t> heapB;
+
+	for (int i = 0; i < 2; i++)
+	{
+		const int startState = startNode * 2 + i;
+		const int goalState = goalNode * 2 + i;
+
+		if (IsStateUsable(startState))
+		{
+			distF[startState] = 0;
+			RouteHeapPush(heapF, 0, startState);
+		}
+
+		if (IsStateUsable(goalState))
+		{
+			distB[goalState] = 0;
+			RouteHeapPush(heapB, 0, goalState);
+		}
+	}
+
+	int best = ROUTE_INFINITY;
+	int meeting = -1;
+	int settled = 0;
+
+	while (heapF.size() || heapB.size())
+	{
+		const bool forwardDone = !heapF.size() || heapF[0].key >= best;
+		const bool backwardDone = !heapB.size() || heapB[0].key >= best;
+
+		if (forwardDone && backwardDone)
+			break;
+
+		// alternate between directions
+		const bool forward = !forwardDone && (backwardDone || heapF[0].key <= heapB[0].key);
+
+		Array<RouteHeapItem_t>& heap = forward ? heapF : heapB;
+		int* dist = forward ? distF : distB;
+		int* parent = forward ? parentF : parentB;
+		const int* otherDist = forward ? distB : distF;
+
+		const RouteHeapItem_t item = RouteHeapPop(heap);
+
+		if (item.key > dist[item.state])
+			continue;
+
+		settled++;
+
+		if (otherDist[item.state] != ROUTE_INFINITY && item.key + otherDist[item.state] < best)
+		{
+			best = item.key + otherDist[item.state];
+			meeting = item.state;
+		}
+
+		const int* arcStart = forward ? m_upStart : m_downStart;
+		const Arc_t* arcs = forward ? m_upArcs : m_downArcs;
+
+		for (int i = arcStart[item.state]; i < arcStart[item.state + 1]; i++)
+		{
+			const int target = arcs[i].target;
+			const int newDist = item.key + arcs[i].weight;
+
+			if (newDist >= dist[target])
+				continue;
+
+			dist[target] = newDist;
+			parent[target] = item.state;
+
+			RouteHeapPush(heap, newDist, target);
+		}
+	}
+
+	if (meeting != -1)
+	{
+		// forward part is collected backwards
+		Array<int> forwardStates;
+
+		for (int state = meeting; state != -1; state = parentF[state])
+			forwardStates.append(state);
+
+		const int firstState = forwardStates[forwardStates.size() - 1];
+		outStates.append(firstState);
+
+		for (int i = (int)forwardStates.size() - 1; i > 0; i--)
+		{
+			const int from = forwardStates[i];
+			const int to = forwardStates[i - 1];
+
+			UnpackArc(from, to, FindUpArc(from, to)->mid, outStates);
+		}
+
+		for (int state = meeting; parentB[state] != -1; state = parentB[state])
+		{
+			const int to = parentB[state];
+
+			UnpackArc(state, to, FindDownArc(state, to)->mid, outStates);
+		}
+	}
+
+	if (stats)
+		stats->settledStates = settled;
+
+	delete[] distF;
+	delete[] distB;
+	delete[] parentF;
+	delete[] parentB;
+
+	return meeting != -1;
+}
@@ -0,0 +1,95 @@
+#ifndef ROADROUTE_D2_H
+#define ROADROUTE_D2_H
+
+#include "roadgraph_d2.h"
+#include "roadgrid_d2.h"
+
+#include <nstd/Array.hpp>
+
+//----------------------------------------------------------------------------------
+// DRIVER 2 road routing
+//
+// Searches over states (node, end the car heading to). Transition is allowed
+// only when source node has lanes leaving through the connection and target
+// node has lanes continuing from it, so ROAD_LANE_DIR is always respected.
+//----------------------------------------------------------------------------------
+
+enum ERoadRouteFlags
+{
+	ROAD_ROUTE_AI_LANES_ONLY = (1 << 0),		// only use lanes marked as AI lanes
+};
+
+struct RoadRouteStep_t
+{
+	int			node;			// road graph node
+	int			surfId;			// road surface ID
+	int			exitEnd;		// end of the road car is heading to (0 - start, 1 - end)
+	int			distance;		// accumulated distance at the exit end
+};
+
+struct RoadRouteStats_t
+{
+	int			settledStates;
+	int			queryTimeUs;
+};
+
+class CDriver2RoadRouter
+{
+public:
+	CDriver2RoadRouter();
+	~CDriver2RoadRouter();
+
+	void						Init(const CDriver2RoadGraph* graph, int flags = 0);
+	void						Release();
+
+	// use spatial index for start and goal lookup instead of scanning all roads
+	void						SetSpatialIndex(const CDriver2RoadGrid* grid);
+
+	// optional preprocessing for fast queries
+	void						BuildContractionHierarchy();
+	bool						HasContractionHierarchy() const;
+
+	// finds route between two world points (nearest roads are used as start and goal)
+	bool						FindRoute(const XZPAIR& from, const XZPAIR& to, Array<RoadRouteStep_t>& outRoute, RoadRouteStats_t* stats = nullptr) const;
+
+	// finds route between two road graph nodes
+	bool						FindRoute(int startNode, int goalNode, Array<RoadRouteStep_t>& outRoute, RoadRouteStats_t* stats = nullptr) const;
+
+	// nearest road node which has lanes usable by router
+	int							FindNearestNode(const XZPAIR& position) const;
+
+protected:
+	struct Arc_t
+	{
+		int		target;
+		int		weight;
+		int		mid;			// contracted state for shortcuts, -1 for original arcs
+	};
+
+	static bool					NearestNodeFilter(int surfId, void* userData);
+
+	bool						IsStateUsable(int state) const;
+	void						GetStatePosition(int state, XZPAIR& outPos) const;
+	int							GetStateArcs(int state, Arc_t* outArcs) const;
+
+	bool						FindRouteAStar(int startNode, int goalNode, Array<int>& outStates, RoadRouteStats_t* stats) const;
+	bool						FindRouteCH(int startNode, int goalNode, Array<int>& outStates, RoadRouteStats_t* stats) const;
+
+	void						UnpackArc(int from, int to, int mid, Array<int>& outStates) const;
+	const Arc_t*				FindUpArc(int from, int to) const;
+	const Arc_t*				FindDownArc(int from, int to) const;
+
+	const CDriver2RoadGraph*	m_graph{ nullptr };
+	const CDriver2RoadGrid*		m_grid{ nullptr };
+	int							m_flags{ 0 };
+	int							m_numStates{ 0 };
+
+	// contraction hierarchy
+	int*						m_rank{ nullptr };
+	int*						m_upStart{ nullptr };		// arcs to higher ranked states
+	Arc_t*						m_upArcs{ nullptr };
+	int*						m_downStart{ nullptr };		// arcs from higher ranked states (target is the source)
+	Arc_t*						m_downArcs{ nullptr };
+};
+
+#endif // ROADROUTE_D2_H
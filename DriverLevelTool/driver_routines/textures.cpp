@@ -1,43 +1,84 @@
 ﻿#include "core/cmdlib.h"
-#include "core/IVirtualStream.h"
+#include "core/VirtualStream.h"
 #include "math/Vector.h"
 #include "util/rnc2.h"
+#include "util/image_convert.h"
+#include "util/hash.h"
 
 #include <string.h>
 
 #include <nstd/String.hpp>
 #include <nstd/Math.hpp>
+#include <nstd/Thread.hpp>
+#include <nstd/Atomic.hpp>
+#include <nstd/System.hpp>
 
 #include "textures.h"
 #include "level.h"
 
 //-------------------------------------------------------------------------------
 
-// unpacks texture, returns new source pointer
-// there is something like RLE used
-char* unpackTexture(char* src, char* dest)
+// unpacks texture, returns number of bytes consumed from src or -1 if src ends too early
+// there is something like RLE used, page is stored from the end
+//
+// control byte >= 0 - (n + 1) literal bytes follow
+// control byte < 0  - (2 - n) copies of next byte
+int UnpackTexture(const ubyte* src, int srcSize, ubyte* dest)
 {
-	// start from the end
-	char* ptr = dest + TEXPAGE_4BIT_SIZE - 1;
+	const ubyte* srcStart = src;
+	const ubyte* srcEnd = src + srcSize;
+
+	ubyte* ptr = dest;
+	ubyte* destEnd = dest + TEXPAGE_4BIT_SIZE;
+
+	// decode forwards and reverse once at the end so runs can use memset/memcpy
+	while (ptr < destEnd)
+	{
+		if (src >= srcEnd)
+			break;
 
-	do {
-		char pix = *src++;
+		const int pix = (signed char)*src++;
 
-		if ((pix & 0x80) != 0)
+		if (pix < 0)
 		{
-			char p = *src++;
+			if (src >= srcEnd)
+				break;
 
-			do (*ptr-- = p);
-			while (pix++ <= 0);
+			// last run may go past the page; the original decoder wrote those bytes out of bounds
+			const int count = Math::min(2 - pix, (int)(destEnd - ptr));
+
+			memset(ptr, *src++, count);
+			ptr += count;
 		}
 		else
 		{
-			do (*ptr-- = *src++);
-			while (pix-- != 0);
+			const int length = pix + 1;
+
+			if (length > srcEnd - src)
+				break;
+
+			const int count = Math::min(length, (int)(destEnd - ptr));
+
+			memcpy(ptr, src, count);
+			ptr += count;
+			src += length;
 		}
-	} while (ptr >= dest);
+	}
+
+	const bool complete = (ptr == destEnd);
+
+	// keep page deterministic if data is corrupt
+	if (!complete)
+		memset(ptr, 0, destEnd - ptr);
+
+	for (ubyte *a = dest, *b = destEnd - 1; a < b; a++, b--)
+	{
+		const ubyte t = *a;
+		*a = *b;
+		*b = t;
+	}
 
-	return src;
+	return complete ? (int)(src - srcStart) : -1;
 }
 
 //-------------------------------------------------------------------------------
@@ -52,6 +93,14 @@ struct SpooledTextureData_t
 	ubyte		texels[128 * 256];	// 256×256 four-bit indices
 };
 
+void TexPalette_t::Init(const TEXCLUT& clut)
+{
+	for (int i = 0; i < 4; i++)
+		MakePalette_RGBA8(colors[i], clut.colors, (i & 2) != 0, (i & 1) != 0);
+}
+
+//-------------------------------------------------------------------------------
+
 CTexturePage::CTexturePage()
 {
 	memset(&m_bitmap, 0, sizeof(m_bitmap));
@@ -71,9 +120,11 @@ void CTexturePage::FreeBitmap()
 	
 	delete[] m_bitmap.data;
 	delete[] m_bitmap.clut;
+	delete[] m_bitmap.palettes;
 
 	m_bitmap.data = nullptr;
 	m_bitmap.clut = nullptr;
+	m_bitmap.palettes = nullptr;
 }
 
 //-------------------------------------------------------------
@@ -89,46 +140,104 @@ void CTexturePage::ConvertIndexedTextureToRGBA(uint* dest_color_data, int detail
 		return;
 	}
 
+	const TEXINF& texInfo = m_details[detail].info;
+
+	const int ox = texInfo.x;
+	const int oy = texInfo.y;
+	const int w = texInfo.width ? texInfo.width : TEXPAGE_SIZE_Y;	// 0 means full size
+	const int h = texInfo.height ? texInfo.height : TEXPAGE_SIZE_Y;
+
+	const TexPalette_t* expanded = GetDetailPalette(detail, clut);
+
+	uint palette[16];
+	if (expanded)
+		memcpy(palette, expanded->Get(outputBGR, originalTransparencyKey), sizeof(palette));
+	else
+		MakePalette_RGBA8(palette, (clut ? clut : &bitmap.clut[detail])->colors, outputBGR, originalTransparencyKey);
+
+	// flip texture by Y
+	uint* dest = dest_color_data + (TEXPAGE_SIZE_Y - oy - 1) * TEXPAGE_SIZE_Y + ox;
+
+	ConvertIndexed4RectToRGBA8(dest, -TEXPAGE_SIZE_Y, bitmap.data, TEXPAGE_SIZE_X, ox, oy, w, h, palette);
+}
+
+//-------------------------------------------------------------
+// Returns palette expanded at page load
+//-------------------------------------------------------------
+const TexPalette_t* CTexturePage::GetDetailPalette(int detail, const TEXCLUT* clut) const
+{
+	if (m_bitmap.palettes)
+	{
+		if (clut == nullptr)
+			return detail < m_bitmap.numPalettes ? &m_bitmap.palettes[detail] : nullptr;
+
+		if (clut >= m_bitmap.clut && clut < m_bitmap.clut + m_bitmap.numPalettes)
+			return &m_bitmap.palettes[clut - m_bitmap.clut];
+	}
+
 	if (clut == nullptr)
-		clut = &bitmap.clut[detail];
+		return nullptr;
+
+	const TexDetailInfo_t& info = m_details[detail];
 
+	for (int i = 0; i < info.numExtraCLUTs; i++)
+	{
+		if (info.extraCLUTs[i] == clut)
+			return info.extraPalettes[i];
+	}
+
+	return nullptr;
+}
+
+uint64 CTexturePage::GetDetailHash(int detail, const TEXCLUT* clut) const
+{
 	const TEXINF& texInfo = m_details[detail].info;
 
+	if (clut == nullptr)
+		clut = &m_bitmap.clut[detail];
+
 	const int ox = texInfo.x;
 	const int oy = texInfo.y;
 	const int w = texInfo.width ? texInfo.width : TEXPAGE_SIZE_Y;	// 0 means full size
 	const int h = texInfo.height ? texInfo.height : TEXPAGE_SIZE_Y;
 
-	const int tp_wx = ox + w;
-	const int tp_hy = oy + h;
+	// odd x puts pixels in other nibbles
+	const int size[3] = { w, h, ox & 1 };
 
-	for (int y = oy; y < tp_hy; y++)
-	{
-		for (int x = ox; x < tp_wx; x++)
-		{
-			ubyte clindex = bitmap.data[y * TEXPAGE_SIZE_X + x / 2];
+	uint64 hash = Hash64(size, sizeof(size));
+	hash = Hash64(clut->colors, sizeof(clut->colors), hash);
 
-			if (0 != (x & 1))
-				clindex >>= 4;
+	const int rowStart = ox / 2;
+	const int rowSize = Math::min((ox + w + 1) / 2, TEXPAGE_SIZE_X) - rowStart;
 
-			clindex &= 15;
+	for (int y = oy; y < Math::min(oy + h, TEXPAGE_SIZE_Y); y++)
+		hash = Hash64(m_bitmap.data + y * TEXPAGE_SIZE_X + rowStart, rowSize, hash);
 
-			// flip texture by Y
-			const int ypos = (TEXPAGE_SIZE_Y - y - 1) * TEXPAGE_SIZE_Y;
+	return hash;
+}
 
-			if(outputBGR)
-			{
-				TVec4D<ubyte> color = rgb5a1_ToBGRA8(clut->colors[clindex], originalTransparencyKey);
-				dest_color_data[ypos + x] = *(uint*)(&color);
-			}
-			else
-			{
-				TVec4D<ubyte> color = rgb5a1_ToRGBA8(clut->colors[clindex], originalTransparencyKey);
-				dest_color_data[ypos + x] = *(uint*)(&color);
-			}
+void CTexturePage::InitPalettes()
+{
+	m_bitmap.palettes = new TexPalette_t[m_bitmap.numPalettes];
 
-		}
-	}
+	for (int i = 0; i < m_bitmap.numPalettes; i++)
+		m_bitmap.palettes[i].Init(m_bitmap.clut[i]);
+}
+
+//-------------------------------------------------------------
+// Dumps whole page indexes (index * 32) as 32 bit colors
+//-------------------------------------------------------------
+void CTexturePage::ConvertIndexesToRGBA(uint* dest_color_data) const
+{
+	uint palette[16];
+
+	for (int i = 0; i < 16; i++)
+		palette[i] = i * 32;
+
+	// flip texture by Y
+	uint* dest = dest_color_data + (TEXPAGE_SIZE_Y - 1) * TEXPAGE_SIZE_Y;
+
+	ConvertIndexed4RectToRGBA8(dest, -TEXPAGE_SIZE_Y, m_bitmap.data, TEXPAGE_SIZE_X, 0, 0, TEXPAGE_SIZE_Y, TEXPAGE_SIZE_Y, palette);
 }
 
 void CTexturePage::InitFromFile(int id, TEXPAGE_POS& tp, IVirtualStream* pFile)
@@ -150,6 +259,7 @@ void CTexturePage::InitFromFile(int id, TEXPAGE_POS& tp, IVirtualStream* pFile)
 			m_details[i].detailNum = i;
 			m_details[i].numExtraCLUTs = 0;
 			memset(m_details[i].extraCLUTs, 0, sizeof(m_details[i].extraCLUTs));
+			memset(m_details[i].extraPalettes, 0, sizeof(m_details[i].extraPalettes));
 			
 			pFile->Read(&m_details[i].info, 1, sizeof(TEXINF));
 		}
@@ -159,7 +269,7 @@ void CTexturePage::InitFromFile(int id, TEXPAGE_POS& tp, IVirtualStream* pFile)
 }
 
 
-void CTexturePage::LoadCompressedTexture(IVirtualStream* pFile)
+bool CTexturePage::LoadCompressedTexture(IVirtualStream* pFile)
 {
 	pFile->Read( &m_bitmap.numPalettes, 1, sizeof(int) );
 
@@ -172,22 +282,43 @@ void CTexturePage::LoadCompressedTexture(IVirtualStream* pFile)
 		pFile->Read(&m_bitmap.clut[i].colors, 16, sizeof(ushort));
 	}
 
-	int imageStart = pFile->Tell();
+	const int imageStart = pFile->Tell();
+	int packedSize = Math::min((int)pFile->GetSize() - imageStart, TEXPAGE_4BIT_PACKED_MAX_SIZE);
 
-	// read compression data
-	ubyte* compressedData = new ubyte[TEXPAGE_4BIT_SIZE];
-	pFile->Read(compressedData, 1, TEXPAGE_4BIT_SIZE);
+	int unpackedSize;
 
-	char* unpackEnd = unpackTexture((char*)compressedData, (char*)m_bitmap.data);
+	if (pFile->GetType() == VS_TYPE_MEMORY)
+	{
+		// decode straight from memory
+		ubyte* compressedData = ((CMemoryStream*)pFile)->GetCurrentPointer();
+		unpackedSize = UnpackTexture(compressedData, packedSize, m_bitmap.data);
+	}
+	else
+	{
+		// read compression data
+		ubyte* compressedData = new ubyte[packedSize];
+		packedSize = pFile->Read(compressedData, 1, packedSize);
 
-	delete[] compressedData;
-	
-	// unpack
-	m_bitmap.rsize = (char*)unpackEnd - (char*)compressedData;
+		unpackedSize = UnpackTexture(compressedData, packedSize, m_bitmap.data);
+
+		delete[] compressedData;
+	}
+
+	const bool result = unpackedSize >= 0;
+
+	if (!result)
+	{
+		MsgError("Texture page %d compressed data is corrupt!\n", m_id);
+		unpackedSize = packedSize;
+	}
+
+	m_bitmap.rsize = unpackedSize;
 
 	// seek to the right position
 	// this is necessary because it's aligned to CD block size
 	pFile->Seek(imageStart + m_bitmap.rsize, VS_SEEK_SET);
+
+	return result;
 }
 
 //-------------------------------------------------------------------------------
@@ -206,6 +337,8 @@ bool CTexturePage::LoadTPageAndCluts(IVirtualStream* pFile, bool isSpooled)
 
 	m_bitmap.data = new ubyte[TEXPAGE_4BIT_SIZE];
 
+	bool result = true;
+
 	if( isSpooled )
 	{
 		// non-compressed textures loads different way, with a fixed size
@@ -226,15 +359,17 @@ bool CTexturePage::LoadTPageAndCluts(IVirtualStream* pFile, bool isSpooled)
 	else
 	{
 		// non-spooled are compressed
-		LoadCompressedTexture(pFile);
+		result = LoadCompressedTexture(pFile);
 	}
 
+	InitPalettes();
+
 	m_bitmap.rsize = pFile->Tell() - rStart;
 	DevMsg(SPEW_NORM, "PAGE %d (%s) datasize=%d\n", m_id, isSpooled ? "spooled" : "compressed", m_bitmap.rsize);
 
 	m_owner->OnTexturePageLoaded(this);
 	
-	return true;
+	return result;
 }
 
 //-------------------------------------------------------------------------------
@@ -382,6 +517,7 @@ void CDriverLevelTextures::LoadTextureLumpD1Demo(IVirtualStream* pFile)
 			detailInfo.detailNum = j;
 			detailInfo.numExtraCLUTs = 0;
 			memset(detailInfo.extraCLUTs, 0, sizeof(detailInfo.extraCLUTs));
+			memset(detailInfo.extraPalettes, 0, sizeof(detailInfo.extraPalettes));
 
 			pFile->Read(&detailInfo.info, 1, sizeof(detailInfo.info));
 			totalTexturesRead++;
@@ -469,6 +605,9 @@ void CDriverLevelTextures::LoadOverlayMapLump(IVirtualStream* pFile, int lumpSiz
 {
 	m_overlayMapData = new char[lumpSize];
 	pFile->Read(m_overlayMapData, 1, lumpSize);
+
+	const int clut_offset = (m_format >= LEV_FORMAT_DRIVER2_ALPHA16) ? 512 : 328;
+	m_overlayMapPalette.Init(*(TEXCLUT*)(m_overlayMapData + clut_offset));
 }
 
 //-------------------------------------------------------------
@@ -526,12 +665,14 @@ void CDriverLevelTextures::LoadPalletLump(IVirtualStream* pFile)
 			clutTablePtr = data.clut.colors;
 
 			pFile->Read(clutTablePtr, 16, sizeof(ushort));
+			data.expanded.Init(data.clut);
 
 			// reference
 			if(info.texnum < m_texPages[data.tpage].GetDetailCount())
 			{
 				TexDetailInfo_t& detail = m_texPages[data.tpage].m_details[info.texnum];
 				detail.extraCLUTs[data.palette] = &data.clut;
+				detail.extraPalettes[data.palette] = &data.expanded;
 				detail.numExtraCLUTs = Math::max(detail.numExtraCLUTs, data.palette + 1);
 			}
 
@@ -556,6 +697,7 @@ void CDriverLevelTextures::LoadPalletLump(IVirtualStream* pFile)
 			{
 				TexDetailInfo_t& detail = m_texPages[data.tpage].m_details[info.texnum];
 				detail.extraCLUTs[data.palette] = &data.clut;
+				detail.extraPalettes[data.palette] = &data.expanded;
 				detail.numExtraCLUTs = Math::max(detail.numExtraCLUTs, data.palette + 1);
 			}
 		}
@@ -586,41 +728,134 @@ const char* CDriverLevelTextures::GetTextureDetailName(TEXINF* info) const
 	return m_textureNamesData + info->nameoffset;
 }
 
-// unpacks RNC2 overlay map segment into RGBA buffer (32x32)
-void CDriverLevelTextures::GetOverlayMapSegmentRGBA(TVec4D<ubyte>* destination, int index, bool bgra /*= false*/) const
+// unpacks RNC2 overlay map segment and converts it using precomputed palette
+void CDriverLevelTextures::DecodeOverlayMapSegment(uint* destination, int destPitch, int index, const uint* palette) const
 {
-	// 8 bit texture so...
+	// 4 bit texture so...
 	char mapBuffer[16 * 32];
 
-	int clut_offset;
+	ushort* offsets = (ushort*)m_overlayMapData;
+	char* rncData = m_overlayMapData + offsets[index];
 
-	if (m_format >= LEV_FORMAT_DRIVER2_ALPHA16)
-		clut_offset = 512;
+	if (rncData[0] == 'R' && rncData[1] == 'N' && rncData[2] == 'C')
+		UnpackRNC(rncData, mapBuffer);
 	else
-		clut_offset = 328;
+		memset(mapBuffer, 0, sizeof(mapBuffer));
 
-	ushort* offsets = (ushort*)m_overlayMapData;
-	ushort* clut = (ushort*)(m_overlayMapData + clut_offset);
+	ConvertIndexed4RectToRGBA8(destination, destPitch, (ubyte*)mapBuffer, 16, 0, 0, 32, 32, palette);
+}
+
+// unpacks RNC2 overlay map segment into RGBA buffer (32x32)
+void CDriverLevelTextures::GetOverlayMapSegmentRGBA(TVec4D<ubyte>* destination, int index, bool bgra /*= false*/) const
+{
+	DecodeOverlayMapSegment((uint*)destination, 32, index, m_overlayMapPalette.Get(bgra, true));
+}
 
-	UnpackRNC(m_overlayMapData + offsets[index], mapBuffer);
+//-------------------------------------------------------------------------------
+// Parallel overlay map decoding
+//-------------------------------------------------------------------------------
+
+#define OVERLAYMAP_MAX_THREADS		16
+
+struct OverlayMapWork_t
+{
+	const CDriverLevelTextures*	textures;
+	const uint*					palette;
+
+	uint*						mapData;
+	int							wide;
+	int							firstRow;
+	int							numRows;
+
+	volatile int				nextSegment;
+};
 
-	// convert to RGBA
-	for (int y = 0; y < 32; y++)
+static uint OverlayMapThreadFunc(void* param)
+{
+	OverlayMapWork_t* work = (OverlayMapWork_t*)param;
+
+	const int width = work->wide * 32;
+	const int numSegments = work->wide * work->numRows;
+
+	while (true)
 	{
-		for (int x = 0; x < 32; x++)
-		{
-			int px, py;
+		const int idx = Atomic::increment(work->nextSegment) - 1;
 
-			ubyte colorIndex = (ubyte)mapBuffer[y * 16 + x / 2];
+		if (idx >= numSegments)
+			break;
 
-			if (0 != (x & 1))
-				colorIndex >>= 4;
+		const int x = idx % work->wide;
+		const int y = idx / work->wide;
 
-			colorIndex &= 0xf;
+		// first segment row goes to the top of bottom-up image
+		uint* dest = work->mapData + x * 32 + ((work->numRows - 1 - y) * 32 + 31) * width;
 
-			destination[y * 32 + x] = bgra ? rgb5a1_ToBGRA8(clut[colorIndex]) : rgb5a1_ToRGBA8(clut[colorIndex]);
-		}
+		work->textures->DecodeOverlayMapSegment(dest, -width, (work->firstRow + y) * work->wide + x, work->palette);
 	}
+
+	return 0;
+}
+
+// decodes segment rows in parallel into bottom-up image (segmentsWide * 32) x (numRows * 32)
+void CDriverLevelTextures::DecodeOverlayMapRows(uint* destination, int segmentsWide, int firstRow, int numRows, bool bgra, int numThreads) const
+{
+	OverlayMapWork_t work;
+	work.textures = this;
+	work.palette = m_overlayMapPalette.Get(bgra, true);
+	work.mapData = destination;
+	work.wide = segmentsWide;
+	work.firstRow = firstRow;
+	work.numRows = numRows;
+	work.nextSegment = 0;
+
+	if (numThreads <= 0)
+		numThreads = System::getProcessorCount();
+
+	numThreads = Math::max(1, Math::min(numThreads, Math::min(OVERLAYMAP_MAX_THREADS, segmentsWide * numRows)));
+
+	if (numThreads > 1)
+	{
+		Thread threads[OVERLAYMAP_MAX_THREADS];
+
+		for (int i = 0; i < numThreads; i++)
+			threads[i].start(OverlayMapThreadFunc, &work);
+
+		for (int i = 0; i < numThreads; i++)
+			threads[i].join();
+	}
+	else
+	{
+		OverlayMapThreadFunc(&work);
+	}
+}
+
+// returns overlay map segment row count for given width
+int CDriverLevelTextures::GetOverlayMapRowCount(int segmentsWide) const
+{
+	if (!m_overlayMapData || segmentsWide <= 0)
+		return 0;
+
+	return GetOverlayMapSegmentCount() / segmentsWide;
+}
+
+// decodes all segments in parallel into single map image
+TVec4D<ubyte>* CDriverLevelTextures::GetOverlayMapRGBA(int segmentsWide, int& width, int& height, bool bgra /*= false*/, int numThreads /*= 0*/) const
+{
+	const int tall = GetOverlayMapRowCount(segmentsWide);
+
+	width = 0;
+	height = 0;
+
+	if (!tall)
+		return nullptr;
+
+	width = segmentsWide * 32;
+	height = tall * 32;
+
+	TVec4D<ubyte>* mapData = new TVec4D<ubyte>[width * height];
+	DecodeOverlayMapRows((uint*)mapData, segmentsWide, 0, tall, bgra, numThreads);
+
+	return mapData;
 }
 
 // computes overlay map segment count
@@ -18,12 +18,22 @@ class CTexturePage;
 typedef void (*OnTexturePageLoaded_t)(CTexturePage* tp);
 typedef void (*OnTexturePageFreed_t)(CTexturePage* tp);
 
+// CLUT expanded to 32 bit colors in all output modes
+struct TexPalette_t
+{
+	uint			colors[4][16];		// [bgra * 2 + originalTransparencyKey]
+
+	void			Init(const TEXCLUT& clut);
+	const uint*		Get(bool bgra, bool originalTransparencyKey) const { return colors[bgra * 2 + originalTransparencyKey]; }
+};
+
 struct TexBitmap_t
 {
 	ubyte*			data { nullptr };	// 4 bit texture data
 	int				rsize{ 0 };
 
 	TEXCLUT*		clut {nullptr};
+	TexPalette_t*	palettes{ nullptr };	// expanded clut
 	int				numPalettes{ 0 };
 };
 
@@ -34,12 +44,14 @@ struct ExtClutData_t
 	int texcnt;
 	int palette;
 	int tpage;
+	TexPalette_t expanded;
 };
 
 struct TexDetailInfo_t
 {
 	TEXINF			info;
 	TEXCLUT*		extraCLUTs[32];
+	TexPalette_t*	extraPalettes[32];	// expanded extraCLUTs
 	int				numExtraCLUTs;
 	int				pageNum;
 	int				detailNum;			// index on texture page
@@ -68,6 +80,15 @@ public:
 												int detail, TEXCLUT* clut = nullptr,
 												bool outputBGR = false, bool originalTransparencyKey = true);
 
+	// dumps whole page indexes (index * 32) to 32 bit color buffer
+	void					ConvertIndexesToRGBA(uint* dest_color_data) const;
+
+	// returns expanded palette of detail CLUT (default or extra), nullptr if clut is not from this page
+	const TexPalette_t*		GetDetailPalette(int detail, const TEXCLUT* clut = nullptr) const;
+
+	// hash of detail image made with CLUT (nullptr is default), equal hashes produce equal images
+	uint64					GetDetailHash(int detail, const TEXCLUT* clut = nullptr) const;
+
 	// searches for detail in this TPAGE
 	TexDetailInfo_t*		FindTextureDetail(const char* name) const;
 	TexDetailInfo_t*		GetTextureDetail(int num) const;
@@ -80,7 +101,8 @@ public:
 	int						GetFlags() const;
 protected:
 
-	void					LoadCompressedTexture(IVirtualStream* pFile);
+	bool					LoadCompressedTexture(IVirtualStream* pFile);
+	void					InitPalettes();
 
 	TexBitmap_t				m_bitmap;
 	TEXPAGE_POS				m_tp;
@@ -131,6 +153,17 @@ public:
 	void					GetOverlayMapSegmentRGBA(TVec4D<ubyte>* destination, int index, bool bgra = false) const;
 	int						GetOverlayMapSegmentCount() const;
 
+	// decodes all segments in parallel into single map image segmentsWide segments wide
+	// rows are stored bottom-up as for SaveTGA. Returns nullptr if there is no map, free with delete[]
+	TVec4D<ubyte>*			GetOverlayMapRGBA(int segmentsWide, int& width, int& height, bool bgra = false, int numThreads = 0) const;
+
+	// decodes segment rows in parallel into bottom-up image (segmentsWide * 32) x (numRows * 32)
+	void					DecodeOverlayMapRows(uint* destination, int segmentsWide, int firstRow, int numRows, bool bgra = false, int numThreads = 0) const;
+	int						GetOverlayMapRowCount(int segmentsWide) const;
+
+	// unpacks segment and converts it to destination with pitch in pixels
+	void					DecodeOverlayMapSegment(uint* destination, int destPitch, int index, const uint* palette) const;
+
 protected:
 	void					OnTexturePageLoaded(CTexturePage* tp);
 	void					OnTexturePageFreed(CTexturePage* tp);
@@ -152,6 +185,7 @@ protected:
 	int						m_numExtraPalettes{ 0 };
 
 	char*					m_overlayMapData{ nullptr };
+	TexPalette_t			m_overlayMapPalette;
 
 	OnTexturePageLoaded_t	m_onTPageLoaded{ nullptr };
 	OnTexturePageFreed_t	m_onTPageFreed{ nullptr };
@@ -0,0 +1,372 @@
+#include "driver_level.h"
+#include "core/cmdlib.h"
+
+#include "util/image.h"
+#include "util/image_convert.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nstd/Array.hpp>
+#include <nstd/Math.hpp>
+
+extern String	g_levname_texdir;
+extern bool		g_export_worldUnityScript;
+
+//-------------------------------------------------------------
+// Texture atlas
+//
+// Every texture detail with each of its palettes gets a slot in
+// one of the atlas images. Slots are packed into shelves sorted by
+// height and padded with repeated edge texels so filtering does not
+// bleed between details. Default palette slots are used for OBJ UVs,
+// all slots are listed in ATLAS.ini for use by other tools.
+//-------------------------------------------------------------
+
+#define TEXTURE_ATLAS_PADDING		2
+#define TEXTURE_ATLAS_MIN_SIZE		512
+#define TEXTURE_ATLAS_MAX_SIZE		8192
+
+struct TexAtlasSlot_t
+{
+	int		page;
+	int		detail;
+	int		palette;		// 0 for default, extra palette + 1
+
+	int		atlas;
+	int		x, y;			// detail position in atlas, without padding
+	int		w, h;
+};
+
+static Array<TexAtlasSlot_t>	s_atlasSlots;
+static Array<int>				s_atlasPageSlots;	// default palette slot of each page first detail
+static int						s_atlasSize = 0;
+static int						s_numAtlases = 0;
+
+static void GetDetailSize(const TEXINF& info, int& w, int& h)
+{
+	w = info.width ? info.width : 256;	// 0 means full size
+	h = info.height ? info.height : 256;
+
+	// don't read outside the page
+	w = Math::min(w, TEXPAGE_SIZE_Y - info.x);
+	h = Math::min(h, TEXPAGE_SIZE_Y - info.y);
+}
+
+static int CompareAtlasSlots(const void* a, const void* b)
+{
+	const TexAtlasSlot_t& slotA = *(const TexAtlasSlot_t*)a;
+	const TexAtlasSlot_t& slotB = *(const TexAtlasSlot_t*)b;
+
+	if (slotA.h != slotB.h)
+		return slotB.h - slotA.h;
+
+	if (slotA.w != slotB.w)
+		return slotB.w - slotA.w;
+
+	// stable order for equally sized slots
+	if (slotA.page != slotB.page)
+		return slotA.page - slotB.page;
+
+	if (slotA.palette != slotB.palette)
+		return slotA.palette - slotB.palette;
+
+	return slotA.detail - slotB.detail;
+}
+
+//-------------------------------------------------------------
+// Places slots into atlas shelves
+//-------------------------------------------------------------
+static void PackAtlasSlots(Array<TexAtlasSlot_t>& slots)
+{
+	if (!slots.size())
+		return;
+
+	qsort(&slots[0], slots.size(), sizeof(TexAtlasSlot_t), CompareAtlasSlots);
+
+	int atlas = 0;
+	int shelfX = 0;
+	int shelfY = 0;
+	int shelfHeight = 0;
+
+	for (usize i = 0; i < slots.size(); i++)
+	{
+		TexAtlasSlot_t& slot = slots[i];
+
+		const int paddedW = slot.w + TEXTURE_ATLAS_PADDING * 2;
+		const int paddedH = slot.h + TEXTURE_ATLAS_PADDING * 2;
+
+		// new shelf
+		if (shelfX + paddedW > s_atlasSize)
+		{
+			shelfY += shelfHeight;
+			shelfX = 0;
+			shelfHeight = 0;
+		}
+
+		// new atlas
+		if (shelfY + paddedH > s_atlasSize)
+		{
+			atlas++;
+			shelfX = 0;
+			shelfY = 0;
+			shelfHeight = 0;
+		}
+
+		slot.atlas = atlas;
+		slot.x = shelfX + TEXTURE_ATLAS_PADDING;
+		slot.y = shelfY + TEXTURE_ATLAS_PADDING;
+
+		shelfX += paddedW;
+		shelfHeight = Math::max(shelfHeight, paddedH);
+	}
+
+	s_numAtlases = atlas + 1;
+}
+
+//-------------------------------------------------------------
+// Makes slot lists and default palette lookup
+//-------------------------------------------------------------
+static void LayoutTextureAtlas()
+{
+	const int numPages = g_levTextures.GetTPageCount();
+
+	for (int i = 0; i < numPages; i++)
+	{
+		CTexturePage* tpage = g_levTextures.GetTPage(i);
+
+		for (int j = 0; j < tpage->GetDetailCount(); j++)
+		{
+			TexDetailInfo_t* detail = tpage->GetTextureDetail(j);
+
+			TexAtlasSlot_t slot;
+			slot.page = i;
+			slot.detail = j;
+			slot.palette = 0;
+			slot.atlas = 0;
+			slot.x = slot.y = 0;
+			GetDetailSize(detail->info, slot.w, slot.h);
+
+			s_atlasSlots.append(slot);
+
+			for (int pal = 0; pal < detail->numExtraCLUTs; pal++)
+			{
+				if (!detail->extraCLUTs[pal])
+					continue;
+
+				slot.palette = pal + 1;
+				s_atlasSlots.append(slot);
+			}
+		}
+	}
+
+	PackAtlasSlots(s_atlasSlots);
+
+	// reorder slots so default palette ones are indexed by page and detail
+	s_atlasPageSlots.resize(numPages);
+
+	int numDetailsTotal = 0;
+	for (int i = 0; i < numPages; i++)
+	{
+		s_atlasPageSlots[i] = numDetailsTotal;
+		numDetailsTotal += g_levTextures.GetTPage(i)->GetDetailCount();
+	}
+
+	Array<int> detailSlots;
+	detailSlots.resize(numDetailsTotal);
+
+	for (usize i = 0; i < s_atlasSlots.size(); i++)
+	{
+		const TexAtlasSlot_t& slot = s_atlasSlots[i];
+
+		if (slot.palette == 0)
+			detailSlots[s_atlasPageSlots[slot.page] + slot.detail] = i;
+	}
+
+	Array<TexAtlasSlot_t> sortedSlots;
+	sortedSlots.reserve(s_atlasSlots.size());
+
+	for (int i = 0; i < numDetailsTotal; i++)
+		sortedSlots.append(s_atlasSlots[detailSlots[i]]);
+
+	for (usize i = 0; i < s_atlasSlots.size(); i++)
+	{
+		if (s_atlasSlots[i].palette != 0)
+			sortedSlots.append(s_atlasSlots[i]);
+	}
+
+	s_atlasSlots = sortedSlots;
+}
+
+//-------------------------------------------------------------
+// Draws slot into atlas image. Image rows are stored bottom-up
+//-------------------------------------------------------------
+static void DrawAtlasSlot(uint* image, const TexAtlasSlot_t& slot)
+{
+	CTexturePage* tpage = g_levTextures.GetTPage(slot.page);
+	const TexBitmap_t& bitmap = tpage->GetBitmap();
+
+	if (!bitmap.data)
+		return;
+
+	TexDetailInfo_t* detail = tpage->GetTextureDetail(slot.detail);
+	const TEXCLUT* clut = slot.palette ? detail->extraCLUTs[slot.palette - 1] : nullptr;
+
+	const TexPalette_t* expanded = tpage->GetDetailPalette(slot.detail, clut);
+
+	uint palette[16];
+	if (expanded)
+		memcpy(palette, expanded->Get(true, !g_export_worldUnityScript), sizeof(palette));
+	else
+		MakePalette_RGBA8(palette, (clut ? clut : &bitmap.clut[slot.detail])->colors, true, !g_export_worldUnityScript);
+
+	const int size = s_atlasSize;
+
+	uint* dest = image + (size - slot.y - 1) * size + slot.x;
+	ConvertIndexed4RectToRGBA8(dest, -size, bitmap.data, TEXPAGE_SIZE_X, detail->info.x, detail->info.y, slot.w, slot.h, palette);
+
+	// extend edges into padding
+	for (int y = 0; y < slot.h; y++)
+	{
+		uint* row = image + (size - slot.y - y - 1) * size;
+
+		for (int p = 1; p <= TEXTURE_ATLAS_PADDING; p++)
+		{
+			row[slot.x - p] = row[slot.x];
+			row[slot.x + slot.w - 1 + p] = row[slot.x + slot.w - 1];
+		}
+	}
+
+	const int rowStart = slot.x - TEXTURE_ATLAS_PADDING;
+	const int rowSize = (slot.w + TEXTURE_ATLAS_PADDING * 2) * sizeof(uint);
+
+	for (int p = 1; p <= TEXTURE_ATLAS_PADDING; p++)
+	{
+		const uint* topRow = image + (size - slot.y - 1) * size + rowStart;
+		const uint* bottomRow = image + (size - slot.y - slot.h) * size + rowStart;
+
+		memcpy(image + (size - slot.y + p - 1) * size + rowStart, topRow, rowSize);
+		memcpy(image + (size - slot.y - slot.h - p) * size + rowStart, bottomRow, rowSize);
+	}
+}
+
+static void WriteTextureAtlasInfo()
+{
+	FILE* pIniFile = fopen(String::fromPrintf("%s/ATLAS.ini", (char*)g_levname_texdir), "wb");
+
+	if (!pIniFile)
+		return;
+
+	fprintf(pIniFile, "[atlas]\r\n");
+	fprintf(pIniFile, "count=%d\r\n", s_numAtlases);
+	fprintf(pIniFile, "size=%d\r\n", s_atlasSize);
+	fprintf(pIniFile, "slots=%d\r\n", (int)s_atlasSlots.size());
+	fprintf(pIniFile, "\r\n");
+
+	for (usize i = 0; i < s_atlasSlots.size(); i++)
+	{
+		const TexAtlasSlot_t& slot = s_atlasSlots[i];
+		TexDetailInfo_t* detail = g_levTextures.GetTPage(slot.page)->GetTextureDetail(slot.detail);
+
+		fprintf(pIniFile, "[slot_%d]\r\n", (int)i);
+		fprintf(pIniFile, "page=%d\r\n", slot.page);
+		fprintf(pIniFile, "detail=%d\r\n", slot.detail);
+		fprintf(pIniFile, "name=%s\r\n", g_levTextures.GetTextureDetailName(&detail->info));
+		fprintf(pIniFile, "palette=%d\r\n", slot.palette);
+		fprintf(pIniFile, "atlas=%d\r\n", slot.atlas);
+		fprintf(pIniFile, "xywh=%d,%d,%d,%d\r\n", slot.x, slot.y, slot.w, slot.h);
+		fprintf(pIniFile, "\r\n");
+	}
+
+	fclose(pIniFile);
+}
+
+//-------------------------------------------------------------
+// Packs all texture details and writes ATLAS_n images
+//-------------------------------------------------------------
+void BuildTextureAtlas(int atlasSize)
+{
+	FreeTextureAtlas();
+
+	s_atlasSize = TEXTURE_ATLAS_MIN_SIZE;
+	while (s_atlasSize < atlasSize && s_atlasSize < TEXTURE_ATLAS_MAX_SIZE)
+		s_atlasSize <<= 1;
+
+	// slot images come from bitmaps
+	PreloadAreaTPages();
+
+	LayoutTextureAtlas();
+
+	MsgInfo("Packed %d texture slots into %d atlases (%dx%d)\n", (int)s_atlasSlots.size(), s_numAtlases, s_atlasSize, s_atlasSize);
+
+	const int imgSize = s_atlasSize * s_atlasSize * sizeof(uint);
+	uint* image = (uint*)malloc(imgSize);
+
+	for (int i = 0; i < s_numAtlases; i++)
+	{
+		memset(image, 0, imgSize);
+
+		for (usize j = 0; j < s_atlasSlots.size(); j++)
+		{
+			if (s_atlasSlots[j].atlas == i)
+				DrawAtlasSlot(image, s_atlasSlots[j]);
+		}
+
+		MsgInfo("Writing texture atlas '%s/ATLAS_%d.%s'\n", (char*)g_levname_texdir, i, GetExportTextureExt());
+		SaveExportTexture(String::fromPrintf("%s/ATLAS_%d", (char*)g_levname_texdir, i), image, s_atlasSize, s_atlasSize);
+	}
+
+	free(image);
+
+	WriteTextureAtlasInfo();
+}
+
+void FreeTextureAtlas()
+{
+	s_atlasSlots.clear();
+	s_atlasPageSlots.clear();
+	s_numAtlases = 0;
+}
+
+int GetTextureAtlasCount()
+{
+	return s_numAtlases;
+}
+
+//-------------------------------------------------------------
+// Maps texture page coordinate to atlas coordinate of detail
+// returns atlas index, -1 if detail has no slot
+//-------------------------------------------------------------
+int MapToTextureAtlas(int page, int detail, int u, int v, float& outU, float& outV)
+{
+	if (page < 0 || page >= (int)s_atlasPageSlots.size())
+		return -1;
+
+	if (detail < 0 || detail >= g_levTextures.GetTPage(page)->GetDetailCount())
+		return -1;
+
+	const TexAtlasSlot_t& slot = s_atlasSlots[s_atlasPageSlots[page] + detail];
+	const TEXINF& info = g_levTextures.GetTPage(page)->GetTextureDetail(detail)->info;
+
+	// keep inside slot so neighbours are never sampled
+	const int x = Math::max(0, Math::min(u - info.x, slot.w - 1));
+	const int y = Math::max(0, Math::min(v - info.y, slot.h - 1));
+
+	outU = ((float)(slot.x + x) + 0.5f) / (float)s_atlasSize;
+	outV = ((float)(slot.y + y) + 0.5f) / (float)s_atlasSize;
+
+	return slot.atlas;
+}
+
+//-------------------------------------------------------------
+// Adds atlas materials to MTL file
+//-------------------------------------------------------------
+void WriteTextureAtlasMaterials(FILE* pMtlFile, const char* textureDir)
+{
+	for (int i = 0; i < s_numAtlases; i++)
+	{
+		fprintf(pMtlFile, "newmtl atlas_%d\r\n", i);
+		fprintf(pMtlFile, "map_Kd ../%s/ATLAS_%d.%s\r\n", textureDir, i, GetExportTextureExt());
+	}
+}
@@ -112,35 +112,35 @@ void WriteMDLToObjStream(IVirtualStream* pStream, MODEL* model, int modelSize, i
 
 	bool prevSmooth = false;
 	int prev_tpage = -1;
+	int prev_atlas = -1;
 
-	int face_ofs = 0;
-	dpoly_t dec_face;
+	const bool useAtlas = GetTextureAtlasCount() > 0;
 
-	// go through all polygons
-	for (int i = 0; i < model->num_polys; i++)
-	{
-		char* facedata = model->pPolyAt(face_ofs);
+	// level models have polygons decoded once, others are decoded here
+	Array<dpoly_t> tempPolys;
+	const dpoly_t* polys;
+	int numPolys;
 
-		// check offset
-		if ((ubyte*)facedata >= (ubyte*)model + modelSize)
-		{
-			MsgError("MDL %d poly id=%d type=%d ofs=%d bad offset!\n", model_index, i, *facedata & 31, model->poly_block + face_ofs);
-			break;
-		}
-		
-		int poly_size = decode_poly(facedata, &dec_face);
+	ModelRef_t* modelRef = g_levModels.GetModelByIndex(model_index);
 
-		// check poly size
-		if (poly_size == 0)
-		{
-			MsgError("MDL %d poly id=%d type=%d ofs=%d zero size!\n", model_index, i, *facedata & 31, model->poly_block + face_ofs);
-			break;
-		}
+	if (modelRef && modelRef->model == model)
+	{
+		polys = GetModelPolys(modelRef, numPolys);
+	}
+	else
+	{
+		tempPolys.resize(model->num_polys);
+		numPolys = decode_model_polys(model, modelSize, (dpoly_t*)tempPolys, -1, model_index);
+		polys = (dpoly_t*)tempPolys;
+	}
+
+	// go through all polygons
+	for (int i = 0; i < numPolys; i++)
+	{
+		const dpoly_t& dec_face = polys[i];
 
-		face_ofs += poly_size;
-		
 		if (debugInfo)
-			pStream->Print("# ft=%d ofs=%d size=%d\r\n", *facedata & 31, model->poly_block + face_ofs, poly_size);
+			pStream->Print("# ft=%d ofs=%d\r\n", dec_face.type, model->poly_block + dec_face.ofs);
 
 		int numPolyVerts = (dec_face.flags & FACE_IS_QUAD) ? 4 : 3;
 		bool bad_face = false;
@@ -168,24 +168,46 @@ void WriteMDLToObjStream(IVirtualStream* pStream, MODEL* model, int modelSize, i
 
 		if (bad_face)
 		{
-			MsgError("MDL %d poly id=%d type=%d ofs=%d has invalid indices (or format is unknown)\n", model_index, i, *facedata & 31, model->poly_block + face_ofs);
+			MsgError("MDL %d poly id=%d type=%d ofs=%d has invalid indices (or format is unknown)\n", model_index, i, dec_face.type, model->poly_block + dec_face.ofs);
 
 			continue;
 		}
 
-		if (dec_face.flags & FACE_TEXTURED)
+		int atlas = -1;
+		float atlasU[4], atlasV[4];
+
+		if ((dec_face.flags & FACE_TEXTURED) && useAtlas)
+		{
+			for (int v = 0; v < numPolyVerts; v++)
+			{
+				UV_INFO uv = *(UV_INFO*)dec_face.uv[v];
+				atlas = MapToTextureAtlas(dec_face.page, dec_face.detail, uv.u, uv.v, atlasU[v], atlasV[v]);
+			}
+		}
+
+		if (atlas != -1)
+		{
+			if (prev_atlas != atlas)
+				pStream->Print("usemtl atlas_%d\r\n", atlas);
+
+			prev_atlas = atlas;
+			prev_tpage = -1;
+		}
+		else if (dec_face.flags & FACE_TEXTURED)
 		{
 			if(prev_tpage != dec_face.page)
 				pStream->Print("usemtl page_%d\r\n", dec_face.page);
 
 			prev_tpage = dec_face.page;
+			prev_atlas = -1;
 		}
 		else
 		{
-			if(prev_tpage != -1)
+			if(prev_tpage != -1 || prev_atlas != -1)
 				pStream->Print("usemtl none\r\n");
 
 			prev_tpage = -1;
+			prev_atlas = -1;
 		}
 
 		bool smooth = (dec_face.flags & FACE_VERT_NORMAL);
@@ -222,9 +244,17 @@ void WriteMDLToObjStream(IVirtualStream* pStream, MODEL* model, int modelSize, i
 
 				float fsU, fsV;
 				
-				// map to 0..1
-				fsU = ((float)uv.u + 0.5f) / 256.0f;
-				fsV = ((float)uv.v + 0.5f) / 256.0f;
+				if (atlas != -1)
+				{
+					fsU = atlasU[VERT_IDX];
+					fsV = atlasV[VERT_IDX];
+				}
+				else
+				{
+					// map to 0..1
+					fsU = ((float)uv.u + 0.5f) / 256.0f;
+					fsV = ((float)uv.v + 0.5f) / 256.0f;
+				}
 
 				pStream->Print("vt %g %g\r\n", fsU, 1.0f - fsV);
 
@@ -356,9 +386,11 @@ void SaveModelPagesMTL()
 		for (int i = 0; i < g_levTextures.GetTPageCount(); i++)
 		{
 			fprintf(pMtlFile, "newmtl page_%d\r\n", i);
-			fprintf(pMtlFile, "map_Kd ../%s/PAGE_%d.tga\r\n", (char*)justLevFilename, i);
+			fprintf(pMtlFile, "map_Kd ../%s/PAGE_%d.%s\r\n", (char*)justLevFilename, i, GetExportTextureExt());
 		}
 
+		WriteTextureAtlasMaterials(pMtlFile, justLevFilename);
+
 		fclose(pMtlFile);
 	}
 }
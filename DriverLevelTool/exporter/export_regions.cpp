@@ -235,9 +235,11 @@ void ExportRegions(const ModelExportFilters& filters, bool* regionsToExport)
 			for (int i = 0; i < g_levTextures.GetTPageCount(); i++)
 			{
 				fprintf(pMtlFile, "newmtl page_%d\r\n", i);
-				fprintf(pMtlFile, "map_Kd ../%s_textures/PAGE_%d.tga\r\n", (char*)justLevFilename, i);
+				fprintf(pMtlFile, "map_Kd ../%s_textures/PAGE_%d.%s\r\n", (char*)justLevFilename, i, GetExportTextureExt());
 			}
 
+			WriteTextureAtlasMaterials(pMtlFile, String::fromPrintf("%s_textures", (char*)justLevFilename));
+
 			fclose(pMtlFile);
 		}
 	}
@@ -0,0 +1,403 @@
+#include "driver_level.h"
+#include "driver_routines/level.h"
+
+#include "core/cmdlib.h"
+#include "core/VirtualStream.h"
+#include "math/isin.h"
+
+#include "driver_routines/regions_d2.h"
+#include "driver_routines/roadroute_d2.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <nstd/Atomic.hpp>
+#include <nstd/File.hpp>
+#include <nstd/String.hpp>
+#include <nstd/System.hpp>
+#include <nstd/Thread.hpp>
+#include <nstd/Time.hpp>
+
+static const char* s_roadNodeTypeNames[] = {
+	"straight",
+	"curve",
+	"junction",
+};
+
+//-------------------------------------------------------------
+// Computes route between two world points and prints it
+//-------------------------------------------------------------
+void PrintRoadRoute(const XZPAIR& from, const XZPAIR& to, int routeFlags, bool useContractionHierarchy)
+{
+	if (g_levMap->GetFormat() < LEV_FORMAT_DRIVER2_ALPHA16)
+	{
+		MsgError("Routing is only supported for Driver 2 levels\n");
+		return;
+	}
+
+	CDriver2LevelMap* levMapDriver2 = (CDriver2LevelMap*)g_levMap;
+	const CDriver2RoadGraph& graph = levMapDriver2->GetRoadGraph();
+
+	if (!graph.IsBuilt())
+	{
+		MsgError("Level has no road data\n");
+		return;
+	}
+
+	CDriver2RoadRouter router;
+	router.Init(&graph, routeFlags);
+	router.SetSpatialIndex(&levMapDriver2->GetRoadGrid());
+
+	if (useContractionHierarchy)
+		router.BuildContractionHierarchy();
+
+	Msg("Route from [%d %d] to [%d %d]%s\n", from.x, from.z, to.x, to.z, (routeFlags & ROAD_ROUTE_AI_LANES_ONLY) ? " (AI lanes only)" : "");
+
+	Array<RoadRouteStep_t> route;
+	RoadRouteStats_t stats = {};
+
+	if (!router.FindRoute(from, to, route, &stats))
+	{
+		MsgError("No route found (%d states settled, %d us)\n", stats.settledStates, stats.queryTimeUs);
+		return;
+	}
+
+	for (usize i = 0; i < route.size(); i++)
+	{
+		const RoadRouteStep_t& step = route[i];
+		const RoadGraphNode_t& node = graph.GetNode(step.node);
+		const XZPAIR& exitPos = node.ends[step.exitEnd];
+
+		Msg("  %d: %s %d -> [%d %d], distance %d\n", (int)i, s_roadNodeTypeNames[node.type], step.surfId & 0x1FFF, exitPos.x, exitPos.z, step.distance);
+	}
+
+	MsgAccept("Route length %d, %d roads, %d states settled in %d us\n",
+		route[route.size() - 1].distance, (int)route.size(), stats.settledStates, stats.queryTimeUs);
+}
+
+//-------------------------------------------------------------
+// Road network report
+//-------------------------------------------------------------
+
+#define ROAD_REPORT_MAX_THREADS			16
+#define ROAD_REPORT_MAX_LISTED_ISSUES	16
+#define ROAD_REPORT_SAMPLE_STEP			256
+
+extern String g_levname;
+
+struct RoadSpoolWork_t
+{
+	volatile int32	nextRegion;
+	volatile int32	numSpooled;
+	int				numRegions;
+};
+
+struct RoadReportStats_t
+{
+	int64	laneLength;
+	int64	aiLaneLength;
+	int		numRoadsWithoutAI;
+
+	int		numDangling;
+	int		numMismatched;
+	int		numHeightIssues;
+};
+
+static uint RoadSpoolThreadFunc(void* param)
+{
+	RoadSpoolWork_t* work = (RoadSpoolWork_t*)param;
+
+	// each thread needs it's own file position
+	FILE* fp = fopen(g_levname, "rb");
+	if (!fp)
+		return 0;
+
+	CFileStream stream(fp);
+
+	SPOOL_CONTEXT spoolContext;
+	spoolContext.dataStream = &stream;
+	spoolContext.lumpInfo = &g_levInfo;
+
+	while (true)
+	{
+		const int regionIdx = Atomic::increment(work->nextRegion) - 1;
+
+		if (regionIdx >= work->numRegions)
+			break;
+
+		if (g_levMap->SpoolRegionRoads(spoolContext, regionIdx))
+			Atomic::increment(work->numSpooled);
+	}
+
+	fclose(fp);
+
+	return 0;
+}
+
+//-------------------------------------------------------------
+// Loads road data of all regions using all CPU cores
+//-------------------------------------------------------------
+static int SpoolAllRegionRoads()
+{
+	RoadSpoolWork_t work;
+	work.nextRegion = 0;
+	work.numSpooled = 0;
+	work.numRegions = g_levMap->GetRegionsAcross() * g_levMap->GetRegionsDown();
+
+	const int numThreads = Math::max(1, Math::min((int)System::getProcessorCount(), ROAD_REPORT_MAX_THREADS));
+
+	Thread* threads = new Thread[numThreads];
+
+	for (int i = 0; i < numThreads; i++)
+		threads[i].start(RoadSpoolThreadFunc, &work);
+
+	for (int i = 0; i < numThreads; i++)
+		threads[i].join();
+
+	delete[] threads;
+
+	return work.numSpooled;
+}
+
+static bool RoadConnectsTo(const short* connectIdx, int surfId)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		if (connectIdx[i] == surfId)
+			return true;
+	}
+
+	return false;
+}
+
+static const short* GetSurfaceConnections(const CDriver2LevelMap* levMap, const RoadGraphNode_t& node)
+{
+	if (node.type == ROAD_NODE_STRAIGHT)
+		return levMap->GetStraight(node.surfId)->ConnectIdx;
+	else if (node.type == ROAD_NODE_CURVE)
+		return levMap->GetCurve(node.surfId)->ConnectIdx;
+
+	return levMap->GetJunction(node.surfId)->ExitIdx;
+}
+
+//-------------------------------------------------------------
+// Checks ConnectIdx/ExitIdx references and that they are mutual
+//-------------------------------------------------------------
+static void CheckRoadConnections(const CDriver2LevelMap* levMap, RoadReportStats_t& stats)
+{
+	const CDriver2RoadGraph& graph = levMap->GetRoadGraph();
+
+	for (int i = 0; i < graph.GetNodeCount(); i++)
+	{
+		const RoadGraphNode_t& node = graph.GetNode(i);
+		const short* connectIdx = GetSurfaceConnections(levMap, node);
+
+		for (int j = 0; j < 4; j++)
+		{
+			const int target = connectIdx[j];
+
+			if (target == -1)
+				continue;
+
+			const int targetNode = graph.SurfaceIdToNode(target);
+
+			if (targetNode == -1)
+			{
+				if (stats.numDangling++ < ROAD_REPORT_MAX_LISTED_ISSUES)
+					MsgWarning("  dangling: %s %d connection %d refers to invalid surface %d\n", s_roadNodeTypeNames[node.type], node.surfId & 0x1FFF, j, target);
+
+				continue;
+			}
+
+			const RoadGraphNode_t& other = graph.GetNode(targetNode);
+
+			// only junction links are expected to be mutual
+			if (node.type != ROAD_NODE_JUNCTION && other.type != ROAD_NODE_JUNCTION)
+				continue;
+
+			if (RoadConnectsTo(GetSurfaceConnections(levMap, other), node.surfId))
+				continue;
+
+			if (stats.numMismatched++ < ROAD_REPORT_MAX_LISTED_ISSUES)
+			{
+				MsgWarning("  mismatched: %s %d connects to %s %d which does not connect back\n",
+					s_roadNodeTypeNames[node.type], node.surfId & 0x1FFF,
+					s_roadNodeTypeNames[other.type], other.surfId & 0x1FFF);
+			}
+		}
+	}
+}
+
+//-------------------------------------------------------------
+// Sums lane lengths and AI lane lengths of straights and curves
+//-------------------------------------------------------------
+static void CountLaneLengths(const CDriver2LevelMap* levMap, RoadReportStats_t& stats)
+{
+	for (int i = 0; i < levMap->GetNumStraights(); i++)
+	{
+		const DRIVER2_STRAIGHT* straight = levMap->GetStraight(i);
+		const int numLanes = ROAD_WIDTH_IN_LANES(straight);
+
+		int numAILanes = 0;
+		for (int j = 0; j < numLanes; j++)
+			numAILanes += ROAD_IS_AI_LANE(straight, j);
+
+		stats.laneLength += (int64)straight->length * numLanes;
+		stats.aiLaneLength += (int64)straight->length * numAILanes;
+
+		if (numLanes && !numAILanes)
+			stats.numRoadsWithoutAI++;
+	}
+
+	for (int i = 0; i < levMap->GetNumCurves(); i++)
+	{
+		const DRIVER2_CURVE* curve = levMap->GetCurve(i | 0x4000);
+		const int numLanes = ROAD_WIDTH_IN_LANES(curve);
+		const int curveAngle = curve->end - curve->start & 4095;
+
+		int numAILanes = 0;
+		for (int j = 0; j < numLanes; j++)
+		{
+			const int radius = curve->inside * 1024 + 256 + 512 * j;
+			const int64 length = (int64)((float)radius * (float)curveAngle * (2.0f * 3.14159265f) / 4096.0f);
+
+			stats.laneLength += length;
+
+			if (ROAD_IS_AI_LANE(curve, j))
+			{
+				stats.aiLaneLength += length;
+				numAILanes++;
+			}
+		}
+
+		if (numLanes && !numAILanes)
+			stats.numRoadsWithoutAI++;
+	}
+}
+
+//-------------------------------------------------------------
+// Samples heightmap along road center and reports height jumps
+//-------------------------------------------------------------
+static void CheckRoadHeights(const CDriver2LevelMap* levMap, int heightThreshold, RoadReportStats_t& stats)
+{
+	const CDriver2RoadGraph& graph = levMap->GetRoadGraph();
+
+	const int numRoads = levMap->GetNumStraights() + levMap->GetNumCurves();
+
+	for (int i = 0; i < numRoads; i++)
+	{
+		const RoadGraphNode_t& node = graph.GetNode(i);
+		const int numSamples = node.length / ROAD_REPORT_SAMPLE_STEP + 1;
+
+		int prevHeight = 0;
+		bool hasPrev = false;
+
+		for (int j = 0; j <= numSamples; j++)
+		{
+			VECTOR_NOPAD samplePos;
+
+			if (node.type == ROAD_NODE_STRAIGHT)
+			{
+				samplePos.vx = node.ends[0].x + (node.ends[1].x - node.ends[0].x) * j / numSamples;
+				samplePos.vz = node.ends[0].z + (node.ends[1].z - node.ends[0].z) * j / numSamples;
+			}
+			else
+			{
+				const DRIVER2_CURVE* curve = levMap->GetCurve(node.surfId);
+				const int radius = curve->inside * 1024 + 256 * ROAD_WIDTH_IN_LANES(curve);
+				const int angle = curve->start + (curve->end - curve->start & 4095) * j / numSamples;
+
+				samplePos.vx = curve->Midx + (radius * isin(angle)) / ONE;
+				samplePos.vz = curve->Midz + (radius * icos(angle)) / ONE;
+			}
+
+			// keep walking on the same level
+			samplePos.vy = prevHeight;
+
+			// skip samples outside of map or spooled regions
+			VECTOR_NOPAD surfacePoint = samplePos;
+			sdPlane surfacePlane;
+
+			if (!levMap->FindSurface(samplePos, surfacePoint, surfacePlane))
+			{
+				hasPrev = false;
+				continue;
+			}
+
+			if (hasPrev && abs(surfacePoint.vy - prevHeight) > heightThreshold)
+			{
+				if (stats.numHeightIssues++ < ROAD_REPORT_MAX_LISTED_ISSUES)
+				{
+					MsgWarning("  height: %s %d at [%d %d] jumps by %d\n", s_roadNodeTypeNames[node.type], node.surfId & 0x1FFF,
+						samplePos.vx, samplePos.vz, surfacePoint.vy - prevHeight);
+				}
+
+				// one report per road is enough
+				break;
+			}
+
+			prevHeight = surfacePoint.vy;
+			hasPrev = true;
+		}
+	}
+}
+
+static void PrintMoreIssues(const char* name, int count)
+{
+	if (count > ROAD_REPORT_MAX_LISTED_ISSUES)
+		MsgWarning("  ... and %d more %s\n", count - ROAD_REPORT_MAX_LISTED_ISSUES, name);
+}
+
+//-------------------------------------------------------------
+// Prints road network statistics and validation results
+//-------------------------------------------------------------
+void PrintRoadReport(int heightThreshold)
+{
+	if (g_levMap->GetFormat() < LEV_FORMAT_DRIVER2_ALPHA16)
+	{
+		MsgError("Road report is only supported for Driver 2 levels\n");
+		return;
+	}
+
+	CDriver2LevelMap* levMapDriver2 = (CDriver2LevelMap*)g_levMap;
+	const CDriver2RoadGraph& graph = levMapDriver2->GetRoadGraph();
+
+	if (!graph.IsBuilt())
+	{
+		MsgError("Level has no road data\n");
+		return;
+	}
+
+	const int64 startTime = Time::microTicks();
+
+	const int numSpooled = SpoolAllRegionRoads();
+
+	const int64 spoolTime = Time::microTicks();
+
+	RoadReportStats_t stats;
+	memset(&stats, 0, sizeof(stats));
+
+	Msg("Road report for '%s'\n", (char*)File::basename(g_levname));
+	Msg("  %d straights, %d curves, %d junctions, %d regions with heightmap\n",
+		levMapDriver2->GetNumStraights(), levMapDriver2->GetNumCurves(), levMapDriver2->GetNumJunctions(), numSpooled);
+
+	CountLaneLengths(levMapDriver2, stats);
+	CheckRoadConnections(levMapDriver2, stats);
+	PrintMoreIssues("dangling connections", stats.numDangling);
+	PrintMoreIssues("mismatched junction exits", stats.numMismatched);
+
+	CheckRoadHeights(levMapDriver2, heightThreshold, stats);
+	PrintMoreIssues("height discontinuities", stats.numHeightIssues);
+
+	const int64 endTime = Time::microTicks();
+
+	const float aiCoverage = stats.laneLength ? (float)stats.aiLaneLength * 100.0f / (float)stats.laneLength : 0.0f;
+
+	Msg("  total lane length: %lld\n", stats.laneLength);
+	Msg("  AI lane length: %lld, coverage %.1f%%, %d roads without AI lanes\n", stats.aiLaneLength, aiCoverage, stats.numRoadsWithoutAI);
+	Msg("  dangling connections: %d\n", stats.numDangling);
+	Msg("  mismatched junction exits: %d\n", stats.numMismatched);
+	Msg("  height discontinuities over %d: %d\n", heightThreshold, stats.numHeightIssues);
+
+	MsgAccept("Road report done in %d ms (spooling %d ms)\n", (int)((endTime - startTime) / 1000), (int)((spoolTime - startTime) / 1000));
+}
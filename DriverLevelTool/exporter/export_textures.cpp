@@ -3,14 +3,26 @@
 #include "core/VirtualStream.h"
 
 #include "util/image.h"
+#include "util/image_convert.h"
+#include "util/image_compress.h"
+#include "util/hash.h"
 #include "util/rnc2.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <nstd/File.hpp>
 #include <nstd/Directory.hpp>
 #include <nstd/Array.hpp>
+#include <nstd/HashMap.hpp>
+#include <nstd/Math.hpp>
+#include <nstd/Time.hpp>
+#include <nstd/Thread.hpp>
+#include <nstd/Process.hpp>
+#include <nstd/Atomic.hpp>
+#include <nstd/Semaphore.hpp>
+#include <nstd/System.hpp>
 
 extern String	g_levname_moddir;
 extern String	g_levname_texdir;
@@ -22,6 +34,12 @@ extern int g_overlaymap_width;
 extern bool g_explode_tpages;
 extern bool g_export_world;
 extern bool	g_export_worldUnityScript;
+extern int	g_export_jobs;
+extern bool	g_export_texdedup;
+extern int	g_export_texformat;
+extern bool	g_export_texbc3;
+extern String	g_export_texcache;
+extern bool	g_export_tgarle;
 
 void GetTPageDetailPalettes(Array<TEXCLUT*>& out, CTexturePage* tpage, TexDetailInfo_t* detail)
 {
@@ -34,6 +52,198 @@ void GetTPageDetailPalettes(Array<TEXCLUT*>& out, CTexturePage* tpage, TexDetail
 		out.append(detail->extraCLUTs[i]);
 }
 
+//-------------------------------------------------------------
+// Texture cache
+//
+// Exported files are stored in -texcache directory by hash of
+// their source: 4 bit data, CLUTs and export options. Same pages
+// in other levels are copied from cache instead of conversion.
+//-------------------------------------------------------------
+
+#define TEXTURE_CACHE_VERSION	1
+
+static bool IsTextureCacheEnabled()
+{
+	return g_export_texcache.length() > 0;
+}
+
+static uint64 GetTextureCacheKeyBase(int kind)
+{
+	const int options[6] = { TEXTURE_CACHE_VERSION, kind, g_export_texformat, g_export_texbc3, g_export_worldUnityScript, g_export_tgarle };
+	return Hash64(options, sizeof(options));
+}
+
+static String GetTextureCacheFileName(uint64 key, const char* ext)
+{
+	return String::fromPrintf("%s/%08x%08x.%s", (char*)g_export_texcache, (uint)(key >> 32), (uint)key, ext);
+}
+
+static ubyte* ReadFileData(const char* fileName, int& size)
+{
+	FILE* pFile = fopen(fileName, "rb");
+	if (!pFile)
+		return nullptr;
+
+	fseek(pFile, 0, SEEK_END);
+	size = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+
+	if (size <= 0)
+	{
+		fclose(pFile);
+		return nullptr;
+	}
+
+	ubyte* data = new ubyte[size];
+
+	if (fread(data, 1, size, pFile) != (size_t)size)
+	{
+		delete[] data;
+		data = nullptr;
+	}
+
+	fclose(pFile);
+
+	return data;
+}
+
+static volatile int s_tempFileCounter = 0;
+
+// writes to temporary file first and renames it, so interrupted
+// or failed write never leaves partial file under destination name.
+// Temporary name is unique per process and call as cache directory may be shared
+static bool WriteFileData(const char* fileName, const ubyte* data, int size)
+{
+	String tempFileName = String::fromPrintf("%s.%u_%d.tmp", fileName, (uint)Process::getCurrentProcessId(), Atomic::increment(s_tempFileCounter));
+
+	FILE* pFile = fopen(tempFileName, "wb");
+	if (!pFile)
+		return false;
+
+	bool result = fwrite(data, 1, size, pFile) == (size_t)size;
+	result = (fclose(pFile) == 0) && result;
+
+	if (result)
+	{
+		remove(fileName);
+		result = rename(tempFileName, fileName) == 0;
+	}
+
+	if (!result)
+	{
+		MsgWarning("Failed to write '%s'\n", fileName);
+		remove(tempFileName);
+	}
+
+	return result;
+}
+
+static bool CopyFileData(const char* fromFileName, const char* toFileName)
+{
+	int size;
+	ubyte* data = ReadFileData(fromFileName, size);
+
+	if (!data)
+		return false;
+
+	const bool result = WriteFileData(toFileName, data, size);
+	delete[] data;
+
+	return result;
+}
+
+// checks header of cached file so truncated or foreign files are treated as cache miss
+static bool IsValidTextureCacheFile(const ubyte* data, int size, const char* ext)
+{
+	if (!data || size <= 0)
+		return false;
+
+	if (!stricmp(ext, "TIM"))
+	{
+		// magic, flags, CLUT block header
+		return size > 8 + 12 && *(const uint*)data == 0x10;
+	}
+
+	if (!stricmp(ext, "dds"))
+	{
+		// magic + 124 byte header
+		return size > 128 && *(const uint*)data == 0x20534444;
+	}
+
+	if (!stricmp(ext, "ktx"))
+	{
+		static const ubyte ktxIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+		return size > 64 && !memcmp(data, ktxIdentifier, sizeof(ktxIdentifier));
+	}
+
+	if (!stricmp(ext, "tga"))
+	{
+		// 18 byte header and some pixels
+		if (size <= 18)
+			return false;
+
+		const int imageType = data[2];
+		const int width = data[12] | (data[13] << 8);
+		const int height = data[14] | (data[15] << 8);
+		const int bpp = data[16];
+
+		if (width <= 0 || height <= 0 || (bpp != 24 && bpp != 32))
+			return false;
+
+		if (imageType == 2)
+			return size >= 18 + data[0] + width * height * (bpp / 8);
+
+		return imageType == 10;
+	}
+
+	return false;
+}
+
+// reads cached file, returns nullptr on miss or invalid entry
+static ubyte* ReadTextureCacheFile(uint64 key, const char* ext, int& size)
+{
+	String cacheFileName = GetTextureCacheFileName(key, ext);
+
+	ubyte* data = ReadFileData(cacheFileName, size);
+
+	if (data && !IsValidTextureCacheFile(data, size, ext))
+	{
+		MsgWarning("Invalid texture cache entry '%s', ignored\n", (char*)cacheFileName);
+
+		delete[] data;
+		data = nullptr;
+	}
+
+	return data;
+}
+
+// copies cached file to destination
+static bool FetchFromTextureCache(uint64 key, const char* ext, const char* fileName)
+{
+	if (!IsTextureCacheEnabled())
+		return false;
+
+	int size;
+	ubyte* data = ReadTextureCacheFile(key, ext, size);
+
+	if (!data)
+		return false;
+
+	const bool result = WriteFileData(fileName, data, size);
+	delete[] data;
+
+	return result;
+}
+
+// stores written file in cache
+static void StoreInTextureCache(uint64 key, const char* ext, const char* fileName)
+{
+	if (!IsTextureCacheEnabled())
+		return;
+
+	CopyFileData(fileName, GetTextureCacheFileName(key, ext));
+}
+
 //-------------------------------------------------------------
 // writes 4-bit TIM image file from TPAGE
 //-------------------------------------------------------------
@@ -74,8 +284,8 @@ void ExportTIM(CTexturePage* tpage, int detail)
 
 	half_w -= half_w & 1;
 
-	// copy image
-	ubyte* image_data = new ubyte[img_size];
+	// copy image, padding column is cleared so cache key and TIM are deterministic
+	ubyte* image_data = new ubyte[img_size]();
 	TEXCLUT* clut_data = new TEXCLUT[palettes.size()];
 
 	for (int y = oy; y < tp_hy; y++)
@@ -116,15 +326,206 @@ void ExportTIM(CTexturePage* tpage, int detail)
 		clut_data[i] = *palettes[i];
 	}
 
+	String timFileName = String::fromPrintf("%s/PAGE_%d/%s_%d.TIM", (char*)g_levname_texdir, tpage->GetId(), textureName, detail);
+
+	const int timInfo[5] = { ox, oy, w, h, (int)palettes.size() };
+
+	uint64 cacheKey = GetTextureCacheKeyBase(0);
+	cacheKey = Hash64(timInfo, sizeof(timInfo), cacheKey);
+	cacheKey = Hash64(image_data, img_size, cacheKey);
+	cacheKey = Hash64(clut_data, sizeof(TEXCLUT) * palettes.size(), cacheKey);
+
 	// compose TIMs
-	SaveTIM_4bit(String::fromPrintf("%s/PAGE_%d/%s_%d.TIM", (char*)g_levname_texdir, tpage->GetId(), textureName, detail),
-		image_data, img_size, ox, oy, w, h, 
-		(ubyte*)clut_data, palettes.size() );
+	if (!FetchFromTextureCache(cacheKey, "TIM", timFileName))
+	{
+		SaveTIM_4bit(timFileName,
+			image_data, img_size, ox, oy, w, h, 
+			(ubyte*)clut_data, palettes.size() );
+
+		StoreInTextureCache(cacheKey, "TIM", timFileName);
+	}
 
 	delete[] image_data;
 	delete[] clut_data;
 }
 
+//-------------------------------------------------------------
+// Writes an INI file with texture page info
+//-------------------------------------------------------------
+static void WriteTexturePageInfo(CTexturePage* tpage)
+{
+	FILE* pIniFile = fopen(String::fromPrintf("%s/PAGE_%d.ini", (char*)g_levname_texdir, tpage->GetId()), "wb");
+
+	if (!pIniFile)
+		return;
+
+	int numDetails = tpage->GetDetailCount();
+
+	fprintf(pIniFile, "[tpage]\r\n");
+	fprintf(pIniFile, "details=%d\r\n", numDetails);
+	fprintf(pIniFile, "\r\n");
+
+	for (int i = 0; i < numDetails; i++)
+	{
+		TexDetailInfo_t* detail = tpage->GetTextureDetail(i);
+		
+		int x = detail->info.x;
+		int y = detail->info.y;
+		int w = detail->info.width;
+		int h = detail->info.height;
+
+		if (w == 0)
+			w = 256;
+
+		if (h == 0)
+			h = 256;
+
+		fprintf(pIniFile, "[detail_%d]\r\n", i);
+		fprintf(pIniFile, "id=%d\r\n", detail->info.id);
+		fprintf(pIniFile, "name=%s\r\n", g_levTextures.GetTextureDetailName(&detail->info));
+		fprintf(pIniFile, "xywh=%d,%d,%d,%d\r\n",x, y, w, h);
+		fprintf(pIniFile, "\r\n");
+	}
+
+	fclose(pIniFile);
+}
+
+//-------------------------------------------------------------
+// Makes TIM files of each detail in PAGE_* folder
+//-------------------------------------------------------------
+static void ExplodeTexturePage(CTexturePage* tpage)
+{
+	MsgInfo("Exploding texture '%s/PAGE_%d'\n", (char*)g_levname_texdir, tpage->GetId());
+
+	// make folder and place all tims in there
+	Directory::create(String::fromPrintf("%s/PAGE_%d", (char*)g_levname_texdir, tpage->GetId()));
+
+	for (int i = 0; i < tpage->GetDetailCount(); i++)
+	{
+		ExportTIM(tpage, i);
+	}
+}
+
+static bool IsExtraPaletteUsed(CTexturePage* tpage, int pal)
+{
+	for (int j = 0; j < tpage->GetDetailCount(); j++)
+	{
+		if (tpage->GetTextureDetail(j)->extraCLUTs[pal])
+			return true;
+	}
+
+	return false;
+}
+
+//-------------------------------------------------------------
+// Applies extra palette to page details that have it
+//-------------------------------------------------------------
+static void ApplyExtraPalette(uint* color_data, CTexturePage* tpage, int pal)
+{
+	for (int j = 0; j < tpage->GetDetailCount(); j++)
+	{
+		TexDetailInfo_t* detail = tpage->GetTextureDetail(j);
+
+		if (detail->extraCLUTs[pal])
+			tpage->ConvertIndexedTextureToRGBA(color_data, j, detail->extraCLUTs[pal], true, !g_export_worldUnityScript);
+	}
+}
+
+//-------------------------------------------------------------
+// Converts page with default palettes
+//-------------------------------------------------------------
+static void ConvertTexturePageDefault(uint* color_data, CTexturePage* tpage)
+{
+	memset(color_data, 0, TEXPAGE_SIZE * sizeof(uint));
+
+	// Dump whole TPAGE indexes
+	tpage->ConvertIndexesToRGBA(color_data);
+
+	for (int i = 0; i < tpage->GetDetailCount(); i++)
+	{
+		tpage->ConvertIndexedTextureToRGBA(color_data, i, nullptr, true, !g_export_worldUnityScript);
+	}
+}
+
+#define TEX_CHANNELS 4
+
+//-------------------------------------------------------------
+// Exported texture file format, -texformat
+//-------------------------------------------------------------
+const char* GetExportTextureExt()
+{
+	switch (g_export_texformat)
+	{
+		case TEXFILE_DDS:
+			return "dds";
+		case TEXFILE_KTX:
+			return "ktx";
+	}
+
+	return "tga";
+}
+
+// saves BGRA image, rows are bottom-up. Extension is added
+void SaveExportTexture(const char* fileName, uint* color_data, int w, int h)
+{
+	String fullName = String::fromPrintf("%s.%s", fileName, GetExportTextureExt());
+
+	if (g_export_texformat == TEXFILE_TGA)
+		SaveTGA(fullName, (ubyte*)color_data, w, h, TEX_CHANNELS, g_export_tgarle);
+	else
+		SaveCompressedTexture(fullName, color_data, w, h, g_export_texformat, g_export_texbc3 ? BLOCK_BC3 : BLOCK_BC1);
+}
+
+static String GetTexturePageFileName(CTexturePage* tpage, int outIndex)
+{
+	if (outIndex < 0)
+		return String::fromPrintf("%s/PAGE_%d", (char*)g_levname_texdir, tpage->GetId());
+
+	return String::fromPrintf("%s/PAGE_%d_%d", (char*)g_levname_texdir, tpage->GetId(), outIndex);
+}
+
+static void SaveTexturePageImage(CTexturePage* tpage, int outIndex, uint* color_data)
+{
+	String fileName = GetTexturePageFileName(tpage, outIndex);
+
+	MsgInfo("Writing texture '%s.%s'\n", (char*)fileName, GetExportTextureExt());
+	SaveExportTexture(fileName, color_data, TEXPAGE_SIZE_Y, TEXPAGE_SIZE_Y);
+}
+
+//-------------------------------------------------------------
+// Cache key of page image with extra palettes up to 'palette' applied
+//-------------------------------------------------------------
+static uint64 GetTexturePageImageKey(CTexturePage* tpage, int palette)
+{
+	const TexBitmap_t& bitmap = tpage->GetBitmap();
+
+	uint64 key = GetTextureCacheKeyBase(1);
+	key = Hash64(bitmap.data, TEXPAGE_4BIT_SIZE, key);
+
+	for (int i = 0; i < tpage->GetDetailCount(); i++)
+	{
+		TexDetailInfo_t* detail = tpage->GetTextureDetail(i);
+
+		key = Hash64(&detail->info, sizeof(TEXINF), key);
+		key = Hash64(&bitmap.clut[i], sizeof(TEXCLUT), key);
+	}
+
+	for (int pal = 0; pal <= palette; pal++)
+	{
+		for (int i = 0; i < tpage->GetDetailCount(); i++)
+		{
+			TEXCLUT* clut = tpage->GetTextureDetail(i)->extraCLUTs[pal];
+
+			if (clut)
+				key = Hash64(clut, sizeof(TEXCLUT), key);
+		}
+
+		key = Hash64(&pal, sizeof(pal), key);
+	}
+
+	return key;
+}
+
 //-------------------------------------------------------------
 // Exports entire texture page
 //-------------------------------------------------------------
@@ -143,118 +544,399 @@ void ExportTexturePage(CTexturePage* tpage)
 	if (!bitmap.data)
 		return;		// NO DATA
 
-	int numDetails = tpage->GetDetailCount();
+	WriteTexturePageInfo(tpage);
 
-	// Write an INI file with texture page info
+	if (g_explode_tpages)
 	{
-		FILE* pIniFile = fopen(String::fromPrintf("%s/PAGE_%d.ini", (char*)g_levname_texdir, tpage->GetId()), "wb");
+		ExplodeTexturePage(tpage);
+		return;
+	}
 
-		if (pIniFile)
+	uint* color_data = (uint*)malloc(TEXPAGE_SIZE * TEX_CHANNELS);
+
+	// last palette drawn into color_data, -2 if nothing converted yet (cached)
+	int convertedPalette = -2;
+
+	// each palette image is drawn over previous one
+	int numPalettes = 0;
+	for (int pal = -1; pal < 16; pal++)
+	{
+		int outIndex = -1;
+
+		if (pal >= 0)
 		{
-			fprintf(pIniFile, "[tpage]\r\n");
-			fprintf(pIniFile, "details=%d\r\n", numDetails);
-			fprintf(pIniFile, "\r\n");
+			// written as variants
+			if (g_export_texdedup)
+				break;
 
-			for (int i = 0; i < numDetails; i++)
-			{
-				TexDetailInfo_t* detail = tpage->GetTextureDetail(i);
-				
-				int x = detail->info.x;
-				int y = detail->info.y;
-				int w = detail->info.width;
-				int h = detail->info.height;
-
-				if (w == 0)
-					w = 256;
-
-				if (h == 0)
-					h = 256;
-
-				fprintf(pIniFile, "[detail_%d]\r\n", i);
-				fprintf(pIniFile, "id=%d\r\n", detail->info.id);
-				fprintf(pIniFile, "name=%s\r\n", g_levTextures.GetTextureDetailName(&detail->info));
-				fprintf(pIniFile, "xywh=%d,%d,%d,%d\r\n",x, y, w, h);
-				fprintf(pIniFile, "\r\n");
-			}
+			if (!IsExtraPaletteUsed(tpage, pal))
+				continue;
+
+			outIndex = numPalettes++;
+		}
+
+		const uint64 cacheKey = GetTexturePageImageKey(tpage, pal);
+		String fileName = String::fromPrintf("%s.%s", (char*)GetTexturePageFileName(tpage, outIndex), GetExportTextureExt());
+
+		if (FetchFromTextureCache(cacheKey, GetExportTextureExt(), fileName))
+		{
+			MsgInfo("Copied texture '%s' from cache\n", (char*)fileName);
+			continue;
+		}
 
-			fclose(pIniFile);
+		if (convertedPalette == -2)
+		{
+			ConvertTexturePageDefault(color_data, tpage);
+			convertedPalette = -1;
 		}
+
+		while (convertedPalette < pal)
+			ApplyExtraPalette(color_data, tpage, ++convertedPalette);
+
+		SaveTexturePageImage(tpage, outIndex, color_data);
+		StoreInTextureCache(cacheKey, GetExportTextureExt(), fileName);
 	}
 
-	if (g_explode_tpages)
+	free(color_data);
+}
+
+//-------------------------------------------------------------
+// Parallel texture export
+//
+// Main thread loads pages and makes a job for every image to be
+// written, workers convert them and main thread writes results in
+// job order. Number of converted images waiting for writer is
+// limited so memory usage does not grow with page count.
+//-------------------------------------------------------------
+
+#define TEXTURE_EXPORT_MAX_THREADS		32
+#define TEXTURE_EXPORT_QUEUED_PER_THREAD	2
+
+struct TexExportJob_t
+{
+	CTexturePage*	tpage;
+	int				palette;		// -1 for default palettes
+	int				outIndex;		// PAGE_N_<outIndex>.tga, -1 for PAGE_N.tga
+
+	uint*			colorData;
+	ubyte*			fileData;		// compressed or cached texture file
+	int				fileSize;
+
+	uint64			cacheKey;
+	bool			cached;
+
+	Semaphore		done;
+};
+
+struct TexExportWork_t
+{
+	TexExportJob_t*	jobs;
+	int				numJobs;
+	volatile int	nextJob;
+
+	Semaphore		freeSlots;
+};
+
+static void ConvertTexExportJob(TexExportJob_t& job)
+{
+	if (IsTextureCacheEnabled())
 	{
-		MsgInfo("Exploding texture '%s/PAGE_%d'\n", (char*)g_levname_texdir, tpage->GetId());
+		job.cacheKey = GetTexturePageImageKey(job.tpage, job.palette);
+		job.fileData = ReadTextureCacheFile(job.cacheKey, GetExportTextureExt(), job.fileSize);
+		job.cached = job.fileData != nullptr;
+
+		if (job.cached)
+			return;
+	}
 
-		// make folder and place all tims in there
-		Directory::create(String::fromPrintf("%s/PAGE_%d", (char*)g_levname_texdir, tpage->GetId()));
+	job.colorData = (uint*)malloc(TEXPAGE_SIZE * TEX_CHANNELS);
 
-		for (int i = 0; i < numDetails; i++)
+	ConvertTexturePageDefault(job.colorData, job.tpage);
+
+	// repeat sequential export where palette images are drawn over each other
+	for (int pal = 0; pal <= job.palette; pal++)
+		ApplyExtraPalette(job.colorData, job.tpage, pal);
+
+	if (g_export_texformat != TEXFILE_TGA)
+	{
+		job.fileSize = MakeCompressedTextureFile(job.fileData, job.colorData, TEXPAGE_SIZE_Y, TEXPAGE_SIZE_Y, g_export_texformat, g_export_texbc3 ? BLOCK_BC3 : BLOCK_BC1);
+
+		free(job.colorData);
+		job.colorData = nullptr;
+	}
+}
+
+static uint TexExportThreadFunc(void* param)
+{
+	TexExportWork_t* work = (TexExportWork_t*)param;
+
+	while (true)
+	{
+		work->freeSlots.wait();
+
+		const int jobIdx = Atomic::increment(work->nextJob) - 1;
+
+		if (jobIdx >= work->numJobs)
 		{
-			ExportTIM(tpage, i);
+			work->freeSlots.signal();
+			break;
 		}
 
-		return;
+		TexExportJob_t& job = work->jobs[jobIdx];
+
+		ConvertTexExportJob(job);
+		job.done.signal();
 	}
 
-#define TEX_CHANNELS 4
+	return 0;
+}
 
-	int imgSize = TEXPAGE_SIZE * TEX_CHANNELS;
+static void ExportTexturePagesParallel(int numThreads)
+{
+	// loader stage. Pages are loaded already, count images
+	int numJobs = 0;
 
-	uint* color_data = (uint*)malloc(imgSize);
+	for (int i = 0; i < g_levTextures.GetTPageCount(); i++)
+	{
+		CTexturePage* tpage = g_levTextures.GetTPage(i);
 
-	memset(color_data, 0, imgSize);
+		if (!tpage->GetBitmap().data)
+			continue;
 
-	// Dump whole TPAGE indexes
-	for (int y = 0; y < 256; y++)
-	{
-		for (int x = 0; x < 256; x++)
+		numJobs++;
+
+		for (int pal = 0; pal < 16 && !g_export_texdedup; pal++)
 		{
-			ubyte clindex = bitmap.data[y * 128 + (x >> 1)];
+			if (IsExtraPaletteUsed(tpage, pal))
+				numJobs++;
+		}
+	}
 
-			if (0 != (x & 1))
-				clindex >>= 4;
+	TexExportWork_t work;
+	work.jobs = new TexExportJob_t[numJobs];
+	work.numJobs = 0;
+	work.nextJob = 0;
 
-			clindex &= 0xF;
+	for (int i = 0; i < g_levTextures.GetTPageCount(); i++)
+	{
+		CTexturePage* tpage = g_levTextures.GetTPage(i);
 
-			int ypos = (TEXPAGE_SIZE_Y - y - 1) * TEXPAGE_SIZE_Y;
+		if (!tpage->GetBitmap().data)
+			continue;
 
-			color_data[ypos + x] = clindex * 32;
+		TexExportJob_t& pageJob = work.jobs[work.numJobs++];
+		pageJob.tpage = tpage;
+		pageJob.palette = -1;
+		pageJob.outIndex = -1;
+		pageJob.colorData = nullptr;
+		pageJob.fileData = nullptr;
+		pageJob.fileSize = 0;
+		pageJob.cacheKey = 0;
+		pageJob.cached = false;
+
+		int numPalettes = 0;
+		for (int pal = 0; pal < 16 && !g_export_texdedup; pal++)
+		{
+			if (!IsExtraPaletteUsed(tpage, pal))
+				continue;
+
+			TexExportJob_t& palJob = work.jobs[work.numJobs++];
+			palJob.tpage = tpage;
+			palJob.palette = pal;
+			palJob.outIndex = numPalettes++;
+			palJob.colorData = nullptr;
+			palJob.fileData = nullptr;
+			palJob.fileSize = 0;
+			palJob.cacheKey = 0;
+			palJob.cached = false;
 		}
 	}
 
-	for (int i = 0; i < numDetails; i++)
+	for (int i = 0; i < numThreads * TEXTURE_EXPORT_QUEUED_PER_THREAD; i++)
+		work.freeSlots.signal();
+
+	// conversion stage
+	Thread* threads = new Thread[numThreads];
+
+	for (int i = 0; i < numThreads; i++)
+		threads[i].start(TexExportThreadFunc, &work);
+
+	// writer stage
+	for (int i = 0; i < work.numJobs; i++)
 	{
-		tpage->ConvertIndexedTextureToRGBA(color_data, i, nullptr, true, !g_export_worldUnityScript);
+		TexExportJob_t& job = work.jobs[i];
+
+		if (job.palette == -1)
+			WriteTexturePageInfo(job.tpage);
+
+		job.done.wait();
+
+		String fileName = String::fromPrintf("%s.%s", (char*)GetTexturePageFileName(job.tpage, job.outIndex), GetExportTextureExt());
+
+		if (job.fileData)
+		{
+			MsgInfo(job.cached ? "Copied texture '%s' from cache\n" : "Writing texture '%s'\n", (char*)fileName);
+
+			WriteFileData(fileName, job.fileData, job.fileSize);
+
+			delete[] job.fileData;
+			job.fileData = nullptr;
+		}
+		else
+		{
+			SaveTexturePageImage(job.tpage, job.outIndex, job.colorData);
+
+			free(job.colorData);
+			job.colorData = nullptr;
+		}
+
+		if (!job.cached)
+			StoreInTextureCache(job.cacheKey, GetExportTextureExt(), fileName);
+
+		work.freeSlots.signal();
 	}
 
-	MsgInfo("Writing texture '%s/PAGE_%d.tga'\n", (char*)g_levname_texdir, tpage->GetId());
-	SaveTGA(String::fromPrintf("%s/PAGE_%d.tga", (char*)g_levname_texdir, tpage->GetId()), (ubyte*)color_data, TEXPAGE_SIZE_Y, TEXPAGE_SIZE_Y, TEX_CHANNELS);
+	for (int i = 0; i < numThreads; i++)
+		threads[i].join();
 
-	int numPalettes = 0;
-	for (int pal = 0; pal < 16; pal++)
+	delete[] threads;
+	delete[] work.jobs;
+}
+
+//-------------------------------------------------------------
+// Palette variant export
+//
+// Instead of whole page per extra palette only details are written,
+// once per unique image. Image is identified by hash of detail pixels
+// and CLUT, so every entry refers to detail-sized image, including
+// variants equal to default palette.
+// PALETTE_VARIANTS.ini maps page details and palettes to files.
+//-------------------------------------------------------------
+static void SaveDetailVariantTGA(CTexturePage* tpage, int detail, const TEXCLUT* clut, const char* fileName)
+{
+	const TexBitmap_t& bitmap = tpage->GetBitmap();
+	const TEXINF& info = tpage->GetTextureDetail(detail)->info;
+
+	const int w = Math::min(info.width ? (int)info.width : TEXPAGE_SIZE_Y, TEXPAGE_SIZE_Y - info.x);
+	const int h = Math::min(info.height ? (int)info.height : TEXPAGE_SIZE_Y, TEXPAGE_SIZE_Y - info.y);
+
+	const TexPalette_t* expanded = tpage->GetDetailPalette(detail, clut);
+
+	uint palette[16];
+	if (expanded)
+		memcpy(palette, expanded->Get(true, !g_export_worldUnityScript), sizeof(palette));
+	else
+		MakePalette_RGBA8(palette, clut->colors, true, !g_export_worldUnityScript);
+
+	uint* color_data = (uint*)malloc(w * h * TEX_CHANNELS);
+
+	// flip texture by Y
+	ConvertIndexed4RectToRGBA8(color_data + (h - 1) * w, -w, bitmap.data, TEXPAGE_SIZE_X, info.x, info.y, w, h, palette);
+
+	SaveExportTexture(fileName, color_data, w, h);
+
+	free(color_data);
+}
+
+static void ExportPaletteVariants()
+{
+	FILE* pIniFile = fopen(String::fromPrintf("%s/PALETTE_VARIANTS.ini", (char*)g_levname_texdir), "wb");
+
+	if (!pIniFile)
+		return;
+
+	HashMap<uint64, String> uniqueVariants;
+	int numVariants = 0;
+	int numDefault = 0;
+
+	for (int i = 0; i < g_levTextures.GetTPageCount(); i++)
 	{
-		bool anyMatched = false;
+		CTexturePage* tpage = g_levTextures.GetTPage(i);
+
+		if (!tpage->GetBitmap().data)
+			continue;
+
+		bool pageHeader = false;
 
-		for (int j = 0; j < numDetails; j++)
+		for (int j = 0; j < tpage->GetDetailCount(); j++)
 		{
 			TexDetailInfo_t* detail = tpage->GetTextureDetail(j);
-			
-			if(detail->extraCLUTs[pal])
+			const uint64 defaultHash = tpage->GetDetailHash(j);
+
+			for (int pal = 0; pal < detail->numExtraCLUTs; pal++)
 			{
-				tpage->ConvertIndexedTextureToRGBA(color_data, j, detail->extraCLUTs[pal], true, !g_export_worldUnityScript);
-				anyMatched = true;
+				if (!detail->extraCLUTs[pal])
+					continue;
+
+				if (!pageHeader)
+				{
+					fprintf(pIniFile, "[PAGE_%d]\r\n", tpage->GetId());
+					pageHeader = true;
+				}
+
+				numVariants++;
+
+				const uint64 hash = tpage->GetDetailHash(j, detail->extraCLUTs[pal]);
+
+				if (hash == defaultHash)
+					numDefault++;
+
+				String fileName;
+				HashMap<uint64, String>::Iterator it = uniqueVariants.find(hash);
+
+				if (it != uniqueVariants.end())
+				{
+					fileName = *it;
+				}
+				else
+				{
+					fileName = String::fromPrintf("VARIANT_%d", (int)uniqueVariants.size());
+					uniqueVariants.append(hash, fileName);
+
+					SaveDetailVariantTGA(tpage, j, detail->extraCLUTs[pal], String::fromPrintf("%s/%s", (char*)g_levname_texdir, (char*)fileName));
+				}
+
+				fprintf(pIniFile, "detail_%d_pal_%d=%s.%s\r\n", j, pal, (char*)fileName, GetExportTextureExt());
 			}
 		}
 
-		if (anyMatched)
+		if (pageHeader)
+			fprintf(pIniFile, "\r\n");
+	}
+
+	fclose(pIniFile);
+
+	MsgInfo("Palette variants: %d total, %d unique images, %d same as default\n", numVariants, (int)uniqueVariants.size(), numDefault);
+}
+
+//-------------------------------------------------------------
+// Loads spooled texture pages of all areas
+//-------------------------------------------------------------
+void PreloadAreaTPages()
+{
+	MsgInfo("Preloading area TPages (%d)\n", g_levMap->GetAreaDataCount());
+
+	// Open file stream
+	FILE* fp = fopen(g_levname, "rb");
+	if (fp)
+	{
+		CFileStream stream(fp);
+
+		SPOOL_CONTEXT spoolContext;
+		spoolContext.dataStream = &stream;
+		spoolContext.lumpInfo = &g_levInfo;
+
+		int numAreas = g_levMap->GetAreaDataCount();
+
+		for (int i = 0; i < numAreas; i++)
 		{
-			MsgInfo("Writing texture %s/PAGE_%d_%d.tga\n", (char*)g_levname_texdir, tpage->GetId(), numPalettes);
-			SaveTGA(String::fromPrintf("%s/PAGE_%d_%d.tga", (char*)g_levname_texdir, tpage->GetId(), numPalettes), (ubyte*)color_data, TEXPAGE_SIZE_Y, TEXPAGE_SIZE_Y, TEX_CHANNELS);
-			numPalettes++;
+			g_levMap->LoadInAreaTPages(spoolContext, i);
 		}
-	}
 
-	free(color_data);
+		fclose(fp);
+	}
+	else
+		MsgError("Unable to preload spooled area TPages!\n");
 }
 
 //-------------------------------------------------------------
@@ -264,96 +946,254 @@ void ExportAllTextures()
 {
 	// preload region data if needed
 	if (!g_export_world)
+		PreloadAreaTPages();
+
+	if (IsTextureCacheEnabled())
 	{
-		MsgInfo("Preloading area TPages (%d)\n", g_levMap->GetAreaDataCount());
+		MsgInfo("Using texture cache '%s'\n", (char*)g_export_texcache);
+		Directory::create(g_export_texcache);
+	}
 
-		// Open file stream
-		FILE* fp = fopen(g_levname, "rb");
-		if (fp)
-		{
-			CFileStream stream(fp);
+	int numThreads = g_export_jobs > 0 ? g_export_jobs : (int)System::getProcessorCount();
+	numThreads = Math::max(1, Math::min(numThreads, TEXTURE_EXPORT_MAX_THREADS));
 
-			SPOOL_CONTEXT spoolContext;
-			spoolContext.dataStream = &stream;
-			spoolContext.lumpInfo = &g_levInfo;
+	// TIMs are just copied, not worth threading
+	if (g_explode_tpages)
+		numThreads = 1;
 
-			int numAreas = g_levMap->GetAreaDataCount();
+	MsgInfo("Exporting texture data (%d threads)\n", numThreads);
 
-			for (int i = 0; i < numAreas; i++)
-			{
-				g_levMap->LoadInAreaTPages(spoolContext, i);
-			}
+	int64 startTime = Time::microTicks();
 
-			fclose(fp);
-		}
-		else
-			MsgError("Unable to preload spooled area TPages!\n");
+	if (numThreads > 1)
+	{
+		ExportTexturePagesParallel(numThreads);
 	}
-
-	MsgInfo("Exporting texture data\n");
-	for (int i = 0; i < g_levTextures.GetTPageCount(); i++)
+	else
 	{
-		ExportTexturePage(g_levTextures.GetTPage(i));
+		for (int i = 0; i < g_levTextures.GetTPageCount(); i++)
+		{
+			ExportTexturePage(g_levTextures.GetTPage(i));
+		}
 	}
+
+	if (g_export_texdedup && !g_explode_tpages)
+		ExportPaletteVariants();
+
+	MsgInfo("Texture export took %.2f ms\n", (Time::microTicks() - startTime) / 1000.0);
 }
 
 //-------------------------------------------------------------
 // converts and writes TGA file of overlay map
 //-------------------------------------------------------------
+
+// segment rows decoded at once
+#define OVERLAYMAP_EXPORT_BAND_ROWS		4
+
 void ExportOverlayMap()
 {
 	const int numValid = g_levTextures.GetOverlayMapSegmentCount();
 
 	MsgWarning("overlay map segment count: %d\n", numValid);
 
-	if (!numValid)
+	const int tall = g_levTextures.GetOverlayMapRowCount(g_overlaymap_width);
+
+	if (!tall)
 		return;
 
 	const int overmapWidth = g_overlaymap_width * 32;
-	const int overmapHeight = (numValid / g_overlaymap_width) * 32;
+	const int overmapHeight = tall * 32;
 
-	TVec4D<ubyte> tempSegment[32 * 32];
+	CTGAWriter writer;
+	if (!writer.Open(String::fromPrintf("%s/MAP.tga", (char*)g_levname_texdir), overmapWidth, overmapHeight, TEX_CHANNELS, g_export_tgarle))
+		return;
+
+	uint* band = new uint[overmapWidth * OVERLAYMAP_EXPORT_BAND_ROWS * 32];
 
-	TVec4D<ubyte>* rgba = new TVec4D<ubyte>[overmapWidth * overmapHeight];
+	// file starts with bottom rows
+	for (int lastRow = tall; lastRow > 0; lastRow -= OVERLAYMAP_EXPORT_BAND_ROWS)
+	{
+		const int firstRow = Math::max(0, lastRow - OVERLAYMAP_EXPORT_BAND_ROWS);
+		const int numRows = lastRow - firstRow;
 
-	int x, y, xx, yy;
-	int wide, tall;
+		g_levTextures.DecodeOverlayMapRows(band, g_overlaymap_width, firstRow, numRows, true, g_export_jobs);
+		writer.WriteRows((ubyte*)band, numRows * 32, overmapWidth * TEX_CHANNELS);
+	}
+
+	delete[] band;
+
+	if (!writer.Close())
+		MsgError("Unable to write overlay map\n");
+}
+
+//-------------------------------------------------------------
+// Compares 4 bit conversion kernels with reference conversion
+//-------------------------------------------------------------
 
-	wide = overmapWidth / 32;
-	tall = overmapHeight / 32;
+#define TEXCONV_BENCH_PALETTES		16
+#define TEXCONV_BENCH_RECTS			64
+#define TEXCONV_BENCH_ITERATIONS	50
 
-	int numTilesProcessed = 0;
+struct TexConvBenchRect_t
+{
+	int x, y, w, h;
+	int palette;
+};
 
-	for (x = 0; x < wide; x++)
+// per-pixel conversion as it was done before kernels
+static void ConvertIndexedRectReference(uint* dest, const ubyte* src, const TexConvBenchRect_t& rect, const TEXCLUT& clut, bool bgra)
+{
+	for (int y = rect.y; y < rect.y + rect.h; y++)
 	{
-		for (y = 0; y < tall; y++)
+		for (int x = rect.x; x < rect.x + rect.w; x++)
 		{
-			int idx = x + y * wide;
+			ubyte clindex = src[y * TEXPAGE_SIZE_X + x / 2];
 
-			g_levTextures.GetOverlayMapSegmentRGBA(tempSegment, x + y * wide, true);
+			if (0 != (x & 1))
+				clindex >>= 4;
 
-			numTilesProcessed++;
+			clindex &= 15;
 
-			// place segment
-			for (yy = 0; yy < 32; yy++)
-			{
-				for (xx = 0; xx < 32; xx++)
-				{
-					int px = x * 32 + xx;
-					int py = (tall - 1 - y) * 32 + (31-yy);
+			TVec4D<ubyte> color = bgra ? rgb5a1_ToBGRA8(clut.colors[clindex]) : rgb5a1_ToRGBA8(clut.colors[clindex]);
+			dest[(TEXPAGE_SIZE_Y - y - 1) * TEXPAGE_SIZE_Y + x] = *(uint*)&color;
+		}
+	}
+}
 
-					rgba[px + py * overmapWidth] = tempSegment[yy * 32 + xx];
-				}
+static void ConvertIndexedRect(uint* dest, const ubyte* src, const TexConvBenchRect_t& rect, const TEXCLUT& clut, bool bgra)
+{
+	uint palette[16];
+	MakePalette_RGBA8(palette, clut.colors, bgra, true);
+
+	ConvertIndexed4RectToRGBA8(dest + (TEXPAGE_SIZE_Y - rect.y - 1) * TEXPAGE_SIZE_Y + rect.x, -TEXPAGE_SIZE_Y,
+		src, TEXPAGE_SIZE_X, rect.x, rect.y, rect.w, rect.h, palette);
+}
+
+void BenchmarkTextureConversion()
+{
+	ubyte* indexes = new ubyte[TEXPAGE_4BIT_SIZE];
+	uint* reference = new uint[TEXPAGE_SIZE];
+	uint* result = new uint[TEXPAGE_SIZE];
+
+	TEXCLUT cluts[TEXCONV_BENCH_PALETTES];
+	TexConvBenchRect_t rects[TEXCONV_BENCH_RECTS];
+
+	// make reproducible random page
+	srand(1);
+
+	for (int i = 0; i < TEXPAGE_4BIT_SIZE; i++)
+		indexes[i] = rand() & 255;
+
+	for (int i = 0; i < TEXCONV_BENCH_PALETTES; i++)
+	{
+		for (int j = 0; j < 16; j++)
+			cluts[i].colors[j] = (j == 0) ? 0 : (rand() & 0xFFFF);
+	}
+
+	// first one is full page, others are details of any size and odd offsets
+	for (int i = 0; i < TEXCONV_BENCH_RECTS; i++)
+	{
+		TexConvBenchRect_t& rect = rects[i];
+
+		if (i == 0)
+		{
+			rect.x = rect.y = 0;
+			rect.w = rect.h = TEXPAGE_SIZE_Y;
+		}
+		else
+		{
+			rect.x = rand() % TEXPAGE_SIZE_Y;
+			rect.y = rand() % TEXPAGE_SIZE_Y;
+			rect.w = 1 + rand() % (TEXPAGE_SIZE_Y - rect.x);
+			rect.h = 1 + rand() % (TEXPAGE_SIZE_Y - rect.y);
+		}
+
+		rect.palette = i % TEXCONV_BENCH_PALETTES;
+	}
+
+	int64 numPixels = 0;
+	for (int i = 0; i < TEXCONV_BENCH_RECTS; i++)
+		numPixels += rects[i].w * rects[i].h;
+
+	numPixels *= TEXCONV_BENCH_ITERATIONS * 2;
+
+	const int defaultKernel = GetIndexedConvertKernel();
+
+	MsgInfo("Benchmarking 4 bit to RGBA8 conversion, %d Mpixels per run\n", (int)(numPixels / 1000000));
+
+	// reference timing
+	{
+		const int64 startTime = Time::microTicks();
+
+		for (int iter = 0; iter < TEXCONV_BENCH_ITERATIONS; iter++)
+		{
+			for (int i = 0; i < TEXCONV_BENCH_RECTS; i++)
+			{
+				ConvertIndexedRectReference(reference, indexes, rects[i], cluts[rects[i].palette], false);
+				ConvertIndexedRectReference(reference, indexes, rects[i], cluts[rects[i].palette], true);
 			}
 		}
+
+		const int64 time = Math::max(Time::microTicks() - startTime, (int64)1);
+		Msg("  %-10s: %6d us, %.1f Mpixels/s\n", "reference", (int)time, (float)numPixels / (float)time);
 	}
 
-	if(numTilesProcessed != numValid)
+	bool allExact = true;
+
+	for (int kernel = 0; kernel < INDEXED_KERNEL_COUNT; kernel++)
 	{
-		MsgWarning("Missed tiles: %d\n", numValid-numTilesProcessed);
+		if (!SetIndexedConvertKernel(kernel))
+		{
+			Msg("  %-10s: not supported by CPU\n", GetIndexedConvertKernelName(kernel));
+			continue;
+		}
+
+		// check output of every rectangle in both color orders
+		bool exact = true;
+
+		for (int i = 0; i < TEXCONV_BENCH_RECTS && exact; i++)
+		{
+			for (int bgra = 0; bgra < 2 && exact; bgra++)
+			{
+				memset(reference, 0, TEXPAGE_SIZE * sizeof(uint));
+				memset(result, 0, TEXPAGE_SIZE * sizeof(uint));
+
+				ConvertIndexedRectReference(reference, indexes, rects[i], cluts[rects[i].palette], bgra != 0);
+				ConvertIndexedRect(result, indexes, rects[i], cluts[rects[i].palette], bgra != 0);
+
+				exact = memcmp(reference, result, TEXPAGE_SIZE * sizeof(uint)) == 0;
+			}
+		}
+
+		const int64 startTime = Time::microTicks();
+
+		for (int iter = 0; iter < TEXCONV_BENCH_ITERATIONS; iter++)
+		{
+			for (int i = 0; i < TEXCONV_BENCH_RECTS; i++)
+			{
+				ConvertIndexedRect(result, indexes, rects[i], cluts[rects[i].palette], false);
+				ConvertIndexedRect(result, indexes, rects[i], cluts[rects[i].palette], true);
+			}
+		}
+
+		const int64 time = Math::max(Time::microTicks() - startTime, (int64)1);
+
+		if (exact)
+			Msg("  %-10s: %6d us, %.1f Mpixels/s, bit-exact\n", GetIndexedConvertKernelName(kernel), (int)time, (float)numPixels / (float)time);
+		else
+			MsgError("  %-10s: %6d us, %.1f Mpixels/s, OUTPUT MISMATCH\n", GetIndexedConvertKernelName(kernel), (int)time, (float)numPixels / (float)time);
+
+		allExact = allExact && exact;
 	}
 
-	SaveTGA(String::fromPrintf("%s/MAP.tga", (char*)g_levname_texdir), (ubyte*)rgba, overmapWidth, overmapHeight, TEX_CHANNELS);
+	SetIndexedConvertKernel(defaultKernel);
+
+	if (allExact)
+		MsgAccept("All kernels are bit-exact, using %s\n", GetIndexedConvertKernelName(defaultKernel));
+	else
+		MsgError("Kernel output mismatch!\n");
 
-	delete[] rgba;
-}
\ No newline at end of file
+	delete[] indexes;
+	delete[] reference;
+	delete[] result;
+}
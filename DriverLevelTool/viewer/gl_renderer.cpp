@@ -17,8 +17,21 @@ struct GrVAO
 	int numIndices;
 
 	int dynamic;
+
+	GR_VertexFormat format;
+	int vertexSize;
 };
 
+compile_time_assert(sizeof(GrPackedVertex) == 16);
+
+//-------------------------------------------------------------
+
+static bool				s_nullBackend = false;
+static GLuint			s_nullObjectCounter = 0;
+
+static GrFrameStats		s_frameStats;
+static GrResourceStats	s_resourceStats;
+
 //-------------------------------------------------------------
 
 SDL_Window* g_window = nullptr;
@@ -79,6 +92,9 @@ void GR_UpdateWindowSize(int width, int height)
 	g_windowWidth = width;
 	g_windowHeight = height;
 
+	if (s_nullBackend)
+		return;
+
 	SDL_GL_SetSwapInterval(g_swapInterval);
 }
 
@@ -217,8 +233,21 @@ int GR_InitSDL()
 //-------------------------------------------------------------
 // Initializes graphics system with SDL
 //-------------------------------------------------------------
-int GR_Init(char* windowName, int width, int height, int fullscreen)
+int GR_Init(char* windowName, int width, int height, int fullscreen, GR_Backend backend /*= GR_BACKEND_GL*/)
 {
+	s_nullBackend = (backend == GR_BACKEND_NULL);
+
+	if (s_nullBackend)
+	{
+		g_windowWidth = width;
+		g_windowHeight = height;
+
+		MsgInfo("Using null renderer\n");
+
+		GR_GenerateCommonTextures();
+		return 1;
+	}
+
 	if (!GR_InitSDL())
 		return 0;
 
@@ -235,10 +264,28 @@ void GR_Shutdown()
 {
 	GR_DestroyTexture(g_whiteTexture);
 
+	if (s_nullBackend)
+		return;
+
 	SDL_DestroyWindow(g_window);
 	SDL_Quit();
 }
 
+GR_Backend GR_GetBackend()
+{
+	return s_nullBackend ? GR_BACKEND_NULL : GR_BACKEND_GL;
+}
+
+const GrFrameStats& GR_GetFrameStats()
+{
+	return s_frameStats;
+}
+
+const GrResourceStats& GR_GetResourceStats()
+{
+	return s_resourceStats;
+}
+
 void GR_CheckShaderStatus(GLuint shader)
 {
 	char info[1024];
@@ -324,6 +371,11 @@ ShaderID GR_CompileShader(const char* source)
 	extra_vs_defines[0] = 0;
 	extra_fs_defines[0] = 0;
 
+	s_resourceStats.numShaders++;
+
+	if (s_nullBackend)
+		return ++s_nullObjectCounter;
+
 	const char* vs_list[] = { GLSL_HEADER_VERT, extra_vs_defines, source };
 	const char* fs_list[] = { GLSL_HEADER_FRAG, extra_fs_defines, source };
 
@@ -346,6 +398,7 @@ ShaderID GR_CompileShader(const char* source)
 	glBindAttribLocation(program, a_position_tu, "a_position_tu");
 	glBindAttribLocation(program, a_normal_tv, "a_normal_tv");
 	glBindAttribLocation(program, a_color, "a_color");
+	glBindAttribLocation(program, a_texcoord, "a_texcoord");
 
 	glLinkProgram(program);
 	GR_CheckProgramStatus(program);
@@ -364,6 +417,10 @@ void GR_SetShader(const ShaderID& shader)
 		return;
 
 	g_CurrentShader = shader;
+	s_frameStats.numShaderChanges++;
+
+	if (s_nullBackend)
+		return;
 	
 	glUseProgram(shader);
 	GR_GetWVPUniforms(shader);
@@ -374,11 +431,19 @@ typedef GLvoid(APIENTRY* UNIFORM_MAT_FUNC)(GLint location, GLsizei count, GLbool
 
 int GR_GetShaderConstantIndex(ShaderID shaderId, char* name)
 {
+	if (s_nullBackend)
+		return -1;
+
 	return glGetUniformLocation(shaderId, name);
 }
 
 void GR_SetShaderConstantvi(int index, GR_ConstantType constantType, int count, float* value)
 {
+	s_frameStats.numConstantUpdates++;
+
+	if (s_nullBackend)
+		return;
+
 	if (constantType >= CONSTANT_MATRIX2x2)
 		((UNIFORM_MAT_FUNC)s_uniformFuncs[constantType])(index, count, GL_TRUE, value);
 	else
@@ -421,6 +486,11 @@ void GR_UpdateMatrixUniforms()
 {
 	// rebuild WVP
 	g_matrices[MATRIX_WORLDVIEWPROJECTION] = identity4() * g_matrices[MATRIX_PROJECTION] * (g_matrices[MATRIX_VIEW] * g_matrices[MATRIX_WORLD]);
+
+	s_frameStats.numConstantUpdates += MATRIX_MODES;
+
+	if (s_nullBackend)
+		return;
 	
 	for(int i = 0; i < MATRIX_MODES; i++)
 		glUniformMatrix4fv(u_MatrixUniforms[i], 1, GL_TRUE, g_matrices[i]);
@@ -432,6 +502,14 @@ void GR_GenerateCommonTextures()
 {
 	unsigned int pixelData = 0xFFFFFFFF;
 
+	s_resourceStats.numTextures++;
+
+	if (s_nullBackend)
+	{
+		g_whiteTexture = ++s_nullObjectCounter;
+		return;
+	}
+
 	glGenTextures(1, &g_whiteTexture);
 	
 	glBindTexture(GL_TEXTURE_2D, g_whiteTexture);
@@ -444,6 +522,12 @@ void GR_GenerateCommonTextures()
 
 TextureID GR_CreateRGBATexture(int width, int height, ubyte* data)
 {
+	s_resourceStats.numTextures++;
+	s_frameStats.uploadedBytes += data ? width * height * 4 : 0;
+
+	if (s_nullBackend)
+		return ++s_nullObjectCounter;
+
 	TextureID newTexture;
 	glGenTextures(1, &newTexture);
 
@@ -460,6 +544,11 @@ TextureID GR_CreateRGBATexture(int width, int height, ubyte* data)
 
 void GR_DestroyTexture(TextureID texture)
 {
+	s_resourceStats.numTextures--;
+
+	if (s_nullBackend)
+		return;
+
 	glDeleteTextures(1, &texture);
 }
 
@@ -470,10 +559,14 @@ void GR_SetTexture(TextureID texture)
 
 	if (g_lastBoundTexture == texture)
 		return;
-	
-	glBindTexture(GL_TEXTURE_2D, texture);
 
 	g_lastBoundTexture = texture;
+	s_frameStats.numTextureChanges++;
+
+	if (s_nullBackend)
+		return;
+	
+	glBindTexture(GL_TEXTURE_2D, texture);
 }
 
 
@@ -481,12 +574,18 @@ void GR_SetTexture(TextureID texture)
 
 void GR_ClearColor(float r, float g, float b)
 {
+	if (s_nullBackend)
+		return;
+
 	glClearColor(r, g, b, 0.0f);
 	glClear(GL_COLOR_BUFFER_BIT);
 }
 
 void GR_ClearDepth(float depth)
 {
+	if (s_nullBackend)
+		return;
+
 	glClearDepth(depth);
 
 	glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
@@ -494,6 +593,8 @@ void GR_ClearDepth(float depth)
 
 void GR_BeginScene()
 {
+	memset(&s_frameStats, 0, sizeof(s_frameStats));
+
 	GR_SetViewPort(0, 0, g_windowWidth, g_windowHeight);
 }
 
@@ -504,12 +605,18 @@ void GR_EndScene()
 
 void GR_SwapWindow()
 {
+	if (s_nullBackend)
+		return;
+
 	SDL_GL_SwapWindow(g_window);
 	glFinish();
 }
 
 void GR_SetViewPort(int x, int y, int width, int height)
 {
+	if (s_nullBackend)
+		return;
+
 	glViewport(x, y, width, height);
 }
 
@@ -517,6 +624,11 @@ void GR_SetViewPort(int x, int y, int width, int height)
 
 void GR_SetPolygonOffset(float ofs)
 {
+	s_frameStats.numStateChanges++;
+
+	if (s_nullBackend)
+		return;
+
 	if (ofs == 0.0f)
 	{
 		glDisable(GL_POLYGON_OFFSET_FILL);
@@ -534,6 +646,10 @@ void GR_SetDepth(int enable)
 		return;
 
 	g_CurrentDepthMode = enable;
+	s_frameStats.numStateChanges++;
+
+	if (s_nullBackend)
+		return;
 
 	if (enable)
 		glEnable(GL_DEPTH_TEST);
@@ -546,6 +662,14 @@ void GR_SetBlendMode(GR_BlendMode blendMode)
 	if (g_CurrentBlendMode == blendMode)
 		return;
 
+	s_frameStats.numStateChanges++;
+
+	if (s_nullBackend)
+	{
+		g_CurrentBlendMode = blendMode;
+		return;
+	}
+
 	if (g_CurrentBlendMode == BM_NONE)
 		glEnable(GL_BLEND);
 
@@ -584,6 +708,14 @@ void GR_SetCullMode(GR_CullMode cullMode)
 	if (g_CurrentCullMode == cullMode)
 		return;
 
+	s_frameStats.numStateChanges++;
+
+	if (s_nullBackend)
+	{
+		g_CurrentCullMode = cullMode;
+		return;
+	}
+
 	if(cullMode == CULL_NONE)
 	{
 		glDisable(GL_CULL_FACE);
@@ -602,6 +734,14 @@ void GR_SetFillMode(GR_FillMode fillMode, GR_FrontFace frontFace)
 	if (g_CurrentFillMode[frontFace] == fillMode)
 		return;
 
+	s_frameStats.numStateChanges++;
+
+	if (s_nullBackend)
+	{
+		g_CurrentFillMode[frontFace] = fillMode;
+		return;
+	}
+
 	GLuint frontFaceMode[] = {
 		GL_FRONT_AND_BACK,
 		GL_FRONT,
@@ -625,13 +765,60 @@ void GR_SetFillMode(GR_FillMode fillMode, GR_FrontFace frontFace)
 
 //--------------------------------------------------------------------------
 
-GrVAO* GR_CreateVAO(int numVertices, GrVertex* verts /*= nullptr*/, int dynamic /*= 0*/)
+int GR_GetVertexSize(GR_VertexFormat format)
 {
-	return GR_CreateVAO(numVertices, 0, verts, nullptr, dynamic);
+	return format == VERTEX_FORMAT_PACKED ? sizeof(GrPackedVertex) : sizeof(GrVertex);
 }
 
-GrVAO* GR_CreateVAO(int numVertices, int numIndices, GrVertex* verts /*= nullptr*/, int* indices /*= nullptr*/, int dynamic /*= 0*/)
+GR_VertexFormat GR_GetVAOVertexFormat(GrVAO* vaoPtr)
+{
+	return vaoPtr->format;
+}
+
+// sets attribute pointers of bound vertex array
+static void GR_SetupVertexAttribs(GR_VertexFormat format)
+{
+	glEnableVertexAttribArray(a_position_tu);
+	glEnableVertexAttribArray(a_normal_tv);
+	glEnableVertexAttribArray(a_color);
+
+	if (format == VERTEX_FORMAT_PACKED)
+	{
+		glEnableVertexAttribArray(a_texcoord);
+
+		glVertexAttribPointer(a_position_tu, 3, GL_SHORT, GL_FALSE, sizeof(GrPackedVertex), &((GrPackedVertex*)nullptr)->vx);
+		glVertexAttribPointer(a_texcoord, 2, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(GrPackedVertex), &((GrPackedVertex*)nullptr)->tc_u);
+		glVertexAttribPointer(a_normal_tv, 4, GL_BYTE, GL_TRUE, sizeof(GrPackedVertex), &((GrPackedVertex*)nullptr)->nx);
+		glVertexAttribPointer(a_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GrPackedVertex), &((GrPackedVertex*)nullptr)->cr);
+		return;
+	}
+
+	glVertexAttribPointer(a_position_tu, 4, GL_FLOAT, GL_FALSE, sizeof(GrVertex), &((GrVertex*)nullptr)->vx);
+	glVertexAttribPointer(a_normal_tv, 4, GL_FLOAT, GL_FALSE, sizeof(GrVertex), &((GrVertex*)nullptr)->nx);
+	glVertexAttribPointer(a_color, 4, GL_FLOAT, GL_TRUE, sizeof(GrVertex), &((GrVertex*)nullptr)->cr);
+}
+
+static GrVAO* GR_CreateVAOFormat(GR_VertexFormat format, int numVertices, int numIndices, const void* verts, int* indices, int dynamic)
 {
+	const int vertexSize = GR_GetVertexSize(format);
+
+	s_resourceStats.numVAOs++;
+	s_resourceStats.bufferBytes += vertexSize * numVertices + sizeof(int) * numIndices;
+	s_frameStats.uploadedBytes += (verts ? vertexSize * numVertices : 0) + (indices ? sizeof(int) * numIndices : 0);
+
+	if (s_nullBackend)
+	{
+		GrVAO* newVAO = new GrVAO();
+		memset(newVAO, 0, sizeof(GrVAO));
+		newVAO->numVertices = numVertices;
+		newVAO->numIndices = numIndices;
+		newVAO->dynamic = dynamic;
+		newVAO->format = format;
+		newVAO->vertexSize = vertexSize;
+
+		return newVAO;
+	}
+
 	GLuint buffers[2] = { GL_NONE };
 	GLuint vertexArray;
 
@@ -643,15 +830,9 @@ GrVAO* GR_CreateVAO(int numVertices, int numIndices, GrVertex* verts /*= nullptr
 
 		glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
 
-		glEnableVertexAttribArray(a_position_tu);
-		glEnableVertexAttribArray(a_normal_tv);
-		glEnableVertexAttribArray(a_color);
-		
-		glVertexAttribPointer(a_position_tu, 4, GL_FLOAT, GL_FALSE, sizeof(GrVertex), &((GrVertex*)nullptr)->vx);
-		glVertexAttribPointer(a_normal_tv, 4, GL_FLOAT, GL_FALSE, sizeof(GrVertex), &((GrVertex*)nullptr)->nx);
-		glVertexAttribPointer(a_color, 4, GL_FLOAT, GL_TRUE, sizeof(GrVertex), &((GrVertex*)nullptr)->cr);
+		GR_SetupVertexAttribs(format);
 
-		glBufferData(GL_ARRAY_BUFFER, sizeof(GrVertex) * numVertices, verts, dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, vertexSize * numVertices, verts, dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
 		
 		if(numIndices)
 		{
@@ -671,6 +852,8 @@ GrVAO* GR_CreateVAO(int numVertices, int numIndices, GrVertex* verts /*= nullptr
 	newVAO->buffers[0] = buffers[0];
 	newVAO->buffers[1] = buffers[1];
 	newVAO->dynamic = dynamic;
+	newVAO->format = format;
+	newVAO->vertexSize = vertexSize;
 
 	// bind back and continue good life
 	if (g_CurrentVAO)
@@ -679,8 +862,33 @@ GrVAO* GR_CreateVAO(int numVertices, int numIndices, GrVertex* verts /*= nullptr
 	return newVAO;
 }
 
+GrVAO* GR_CreateVAO(int numVertices, GrVertex* verts /*= nullptr*/, int dynamic /*= 0*/)
+{
+	return GR_CreateVAOFormat(VERTEX_FORMAT_FLOAT, numVertices, 0, verts, nullptr, dynamic);
+}
+
+GrVAO* GR_CreateVAO(int numVertices, int numIndices, GrVertex* verts /*= nullptr*/, int* indices /*= nullptr*/, int dynamic /*= 0*/)
+{
+	return GR_CreateVAOFormat(VERTEX_FORMAT_FLOAT, numVertices, numIndices, verts, indices, dynamic);
+}
+
+GrVAO* GR_CreatePackedVAO(int numVertices, int numIndices, GrPackedVertex* verts /*= nullptr*/, int* indices /*= nullptr*/, int dynamic /*= 0*/)
+{
+	return GR_CreateVAOFormat(VERTEX_FORMAT_PACKED, numVertices, numIndices, verts, indices, dynamic);
+}
+
 void GR_UpdateVAO(GrVAO* vaoPtr, int numVertices, GrVertex* verts)
 {
+	assert(vaoPtr->format == VERTEX_FORMAT_FLOAT);
+
+	s_resourceStats.bufferBytes += sizeof(GrVertex) * (numVertices - vaoPtr->numVertices);
+	s_frameStats.uploadedBytes += sizeof(GrVertex) * numVertices;
+
+	vaoPtr->numVertices = numVertices;
+
+	if (s_nullBackend)
+		return;
+
 	// unbind vertex array or shiitty GL will crash
 	glBindVertexArray(0);
 
@@ -692,12 +900,56 @@ void GR_UpdateVAO(GrVAO* vaoPtr, int numVertices, GrVertex* verts)
 		glBindVertexArray(g_CurrentVAO->vertexArray);
 }
 
+static void GR_UpdateVAOVertices(GrVAO* vaoPtr, int firstVertex, int numVertices, const void* verts)
+{
+	s_frameStats.uploadedBytes += vaoPtr->vertexSize * numVertices;
+
+	if (!numVertices || s_nullBackend)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, vaoPtr->buffers[0]);
+	glBufferSubData(GL_ARRAY_BUFFER, vaoPtr->vertexSize * firstVertex, vaoPtr->vertexSize * numVertices, verts);
+}
+
+void GR_UpdateVAO(GrVAO* vaoPtr, int firstVertex, int numVertices, GrVertex* verts)
+{
+	assert(vaoPtr->format == VERTEX_FORMAT_FLOAT);
+	GR_UpdateVAOVertices(vaoPtr, firstVertex, numVertices, verts);
+}
+
+void GR_UpdateVAO(GrVAO* vaoPtr, int firstVertex, int numVertices, GrPackedVertex* verts)
+{
+	assert(vaoPtr->format == VERTEX_FORMAT_PACKED);
+	GR_UpdateVAOVertices(vaoPtr, firstVertex, numVertices, verts);
+}
+
+void GR_UpdateVAOIndices(GrVAO* vaoPtr, int firstIndex, int numIndices, int* indices)
+{
+	s_frameStats.uploadedBytes += sizeof(int) * numIndices;
+
+	if (!numIndices || s_nullBackend)
+		return;
+
+	// element buffer binding is part of vertex array state
+	glBindVertexArray(vaoPtr->vertexArray);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vaoPtr->buffers[1]);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(int) * firstIndex, sizeof(int) * numIndices, indices);
+
+	// bind back and continue good life
+	glBindVertexArray(g_CurrentVAO ? g_CurrentVAO->vertexArray : 0);
+}
+
 void GR_SetVAO(GrVAO* vaoPtr)
 {
 	if (g_CurrentVAO == vaoPtr)
 		return;
 
 	g_CurrentVAO = vaoPtr;
+	s_frameStats.numVAOChanges++;
+
+	if (s_nullBackend)
+		return;
 	
 	if (vaoPtr == nullptr)
 	{
@@ -713,6 +965,18 @@ void GR_DestroyVAO(GrVAO* vaoPtr)
 	if (!vaoPtr)
 		return;
 
+	s_resourceStats.numVAOs--;
+	s_resourceStats.bufferBytes -= vaoPtr->vertexSize * vaoPtr->numVertices + sizeof(int) * vaoPtr->numIndices;
+
+	if (g_CurrentVAO == vaoPtr)
+		g_CurrentVAO = nullptr;
+
+	if (s_nullBackend)
+	{
+		delete vaoPtr;
+		return;
+	}
+
 	glDeleteVertexArrays(1, &vaoPtr->vertexArray);
 	glDeleteBuffers(2, vaoPtr->buffers);
 	delete vaoPtr;
@@ -722,10 +986,35 @@ void GR_DestroyVAO(GrVAO* vaoPtr)
 
 void GR_DrawNonIndexed(GR_PrimitiveType primitivesType, int firstVertex, int numVertices)
 {
+	s_frameStats.numDrawCalls++;
+	s_frameStats.numInstances++;
+
+	if (s_nullBackend)
+		return;
+
 	glDrawArrays(glPrimitiveType[primitivesType], firstVertex, numVertices);
 }
 
 void GR_DrawIndexed(GR_PrimitiveType primitivesType, int firstIndex, int numIndices)
 {
+	s_frameStats.numDrawCalls++;
+	s_frameStats.numInstances++;
+	s_frameStats.numIndices += numIndices;
+
+	if (s_nullBackend)
+		return;
+
 	glDrawElements(glPrimitiveType[primitivesType], numIndices, GL_UNSIGNED_INT, (void*)(intptr_t)(firstIndex*sizeof(int)));
+}
+
+void GR_DrawIndexedInstanced(GR_PrimitiveType primitivesType, int firstIndex, int numIndices, int numInstances)
+{
+	s_frameStats.numDrawCalls++;
+	s_frameStats.numInstances += numInstances;
+	s_frameStats.numIndices += numIndices * numInstances;
+
+	if (s_nullBackend)
+		return;
+
+	glDrawElementsInstanced(glPrimitiveType[primitivesType], numIndices, GL_UNSIGNED_INT, (void*)(intptr_t)(firstIndex*sizeof(int)), numInstances);
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <glad/glad.h>
 #include "core/dktypes.h"
 #include "math/Matrix.h"
+#include "gr_vertexformat.h"
 
 #define RO_DOUBLE_BUFFERED
 
@@ -18,6 +19,15 @@ struct GrVertex
 	float cr, cg, cb, ca;
 };
 
+// quantised vertex, position scale and UV mapping are up to the shader
+struct GrPackedVertex
+{
+	short vx, vy, vz;
+	ubyte tc_u, tc_v;
+	signed char nx, ny, nz, nw;	// snorm8
+	ubyte cr, cg, cb, ca;		// unorm8
+};
+
 struct GrVAO;
 
 enum GR_ShaderAttrib
@@ -25,6 +35,7 @@ enum GR_ShaderAttrib
 	a_position_tu,
 	a_normal_tv,
 	a_color,
+	a_texcoord,			// only in packed vertex format
 };
 
 enum GR_BlendMode
@@ -103,9 +114,45 @@ enum GR_ConstantType
 	CONSTANT_TYPE_COUNT
 };
 
-int			GR_Init(char* windowName, int width, int height, int fullscreen);
+enum GR_Backend
+{
+	GR_BACKEND_GL = 0,
+	GR_BACKEND_NULL,		// no window or GPU, only records calls
+};
+
+// reset by GR_BeginScene
+struct GrFrameStats
+{
+	int		numDrawCalls;
+	int		numInstances;
+	int		numIndices;
+
+	int		numShaderChanges;
+	int		numTextureChanges;
+	int		numVAOChanges;
+	int		numStateChanges;		// depth, cull, fill and blend modes
+	int		numConstantUpdates;
+
+	int64	uploadedBytes;
+};
+
+struct GrResourceStats
+{
+	int		numVAOs;
+	int		numTextures;
+	int		numShaders;
+
+	int64	bufferBytes;
+};
+
+int			GR_Init(char* windowName, int width, int height, int fullscreen, GR_Backend backend = GR_BACKEND_GL);
 void		GR_Shutdown();
 
+GR_Backend	GR_GetBackend();
+
+const GrFrameStats&		GR_GetFrameStats();
+const GrResourceStats&	GR_GetResourceStats();
+
 void		GR_UpdateWindowSize(int width, int height);
 void		GR_SwapWindow();
 
@@ -130,9 +177,18 @@ void		GR_DestroyTexture(TextureID texture);
 
 GrVAO*		GR_CreateVAO(int numVertices, GrVertex* verts = nullptr, int dynamic = 0);
 GrVAO*		GR_CreateVAO(int numVertices, int numIndices, GrVertex* verts = nullptr, int* indices = nullptr, int dynamic = 0);
+GrVAO*		GR_CreatePackedVAO(int numVertices, int numIndices, GrPackedVertex* verts = nullptr, int* indices = nullptr, int dynamic = 0);
+
+int			GR_GetVertexSize(GR_VertexFormat format);
+GR_VertexFormat GR_GetVAOVertexFormat(GrVAO* vaoPtr);
 
 void		GR_UpdateVAO(GrVAO* vaoPtr, int numVertices, GrVertex* verts);
 
+// updates part of buffers, used by shared model buffers
+void		GR_UpdateVAO(GrVAO* vaoPtr, int firstVertex, int numVertices, GrVertex* verts);
+void		GR_UpdateVAO(GrVAO* vaoPtr, int firstVertex, int numVertices, GrPackedVertex* verts);
+void		GR_UpdateVAOIndices(GrVAO* vaoPtr, int firstIndex, int numIndices, int* indices);
+
 void		GR_DestroyVAO(GrVAO* vaoPtr);
 
 //--------------------------------------------------
@@ -164,5 +220,6 @@ void		GR_UpdateMatrixUniforms();
 
 void		GR_DrawNonIndexed(GR_PrimitiveType primitivesType, int firstVertex, int numVertices);
 void		GR_DrawIndexed(GR_PrimitiveType primitivesType, int firstIndex, int numIndices);
+void		GR_DrawIndexedInstanced(GR_PrimitiveType primitivesType, int firstIndex, int numIndices, int numInstances);
 
 #endif
\ No newline at end of file
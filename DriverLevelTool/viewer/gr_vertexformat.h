@@ -0,0 +1,12 @@
+#ifndef GR_VERTEXFORMAT_H
+#define GR_VERTEXFORMAT_H
+
+// vertex layouts of VAOs, kept apart from gl_renderer.h
+// so users don't need GL headers
+enum GR_VertexFormat
+{
+	VERTEX_FORMAT_FLOAT = 0,	// GrVertex
+	VERTEX_FORMAT_PACKED,		// GrPackedVertex
+};
+
+#endif // GR_VERTEXFORMAT_H
@@ -0,0 +1,142 @@
+#include "modellod.h"
+#include "driver_routines/models.h"
+
+#include <nstd/Math.hpp>
+
+#include <string.h>
+
+// object pointers are aligned, spread them over hash buckets
+// multiplying by odd number keeps keys unique
+static usize MakeLodStateKey(const void* key)
+{
+	return (usize)key * (usize)0x9E3779B97F4A7C15ULL;
+}
+
+//-------------------------------------------------------------------
+
+void CModelLodSelector::Init(CDriverLevelModels* models)
+{
+	m_lodModels.resize(MAX_MODELS * MODEL_LOD_COUNT);
+
+	for (int i = 0; i < MAX_MODELS; i++)
+	{
+		ushort* lods = &m_lodModels[i * MODEL_LOD_COUNT];
+		ModelRef_t* ref = models->GetModelByIndex(i);
+
+		// missing LODs fall back to base model
+		lods[MODEL_LOD_HIGH] = i;
+		lods[MODEL_LOD_NORMAL] = i;
+		lods[MODEL_LOD_LOW] = i;
+
+		if (!ref)
+			continue;
+
+		if (ref->highDetailId != 0xFFFF)
+			lods[MODEL_LOD_HIGH] = ref->highDetailId;
+
+		if (ref->lowDetailId != 0xFFFF)
+			lods[MODEL_LOD_LOW] = ref->lowDetailId;
+	}
+
+	m_lodStates[0].clear();
+	m_lodStates[1].clear();
+}
+
+void CModelLodSelector::Reset()
+{
+	m_lodModels.clear();
+	m_lodStates[0].clear();
+	m_lodStates[1].clear();
+
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void CModelLodSelector::Select(int* outModels, const int* models, const Vector3D* positions, const void* const* keys, int count,
+	const Vector3D& cameraPos, bool noLod /*= false*/)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_stats.numObjects = count;
+
+	if (noLod || !IsInitialized())
+	{
+		for (int i = 0; i < count; i++)
+			outModels[i] = models[i];
+
+		m_stats.numLods[MODEL_LOD_NORMAL] = count;
+		return;
+	}
+
+	m_distances.resize(count);
+	float* distances = m_distances;
+
+	// distances first, in separate loop so compiler can vectorize it
+	for (int i = 0; i < count; i++)
+	{
+		const float dx = positions[i].x - cameraPos.x;
+		const float dy = positions[i].y - cameraPos.y;
+		const float dz = positions[i].z - cameraPos.z;
+
+		distances[i] = dx * dx + dy * dy + dz * dz;
+	}
+
+	const float hysteresis = Math::max(m_settings.hysteresis, 0.0f);
+	const float highDist = Math::max(m_settings.highDistance, 0.0f);
+	const float lowDist = Math::max(m_settings.lowDistance, 0.0f);
+
+	// squared band edges. Switching into the band needs to pass edge by hysteresis,
+	// edge for new objects is in the middle
+	float highEdges[3], lowEdges[3];
+	highEdges[0] = highDist * highDist;
+	highEdges[1] = Math::max(highDist - hysteresis, 0.0f) * Math::max(highDist - hysteresis, 0.0f);
+	highEdges[2] = (highDist + hysteresis) * (highDist + hysteresis);
+
+	lowEdges[0] = lowDist * lowDist;
+	lowEdges[1] = (lowDist + hysteresis) * (lowDist + hysteresis);
+	lowEdges[2] = Math::max(lowDist - hysteresis, 0.0f) * Math::max(lowDist - hysteresis, 0.0f);
+
+	HashMap<usize, ubyte>& prevStates = m_lodStates[m_currentState];
+	HashMap<usize, ubyte>& curStates = m_lodStates[m_currentState ^ 1];
+	curStates.clear();
+
+	const ushort* lodModels = m_lodModels;
+
+	for (int i = 0; i < count; i++)
+	{
+		const usize key = MakeLodStateKey(keys[i]);
+		const float dist = distances[i];
+
+		int prevLod = -1;
+		HashMap<usize, ubyte>::Iterator it = prevStates.find(key);
+
+		if (it != prevStates.end())
+			prevLod = *it;
+
+		const int highEdge = prevLod == -1 ? 0 : (prevLod == MODEL_LOD_HIGH ? 2 : 1);
+		const int lowEdge = prevLod == -1 ? 0 : (prevLod == MODEL_LOD_LOW ? 2 : 1);
+
+		int lod = MODEL_LOD_NORMAL;
+
+		if (dist < highEdges[highEdge])
+			lod = MODEL_LOD_HIGH;
+		else if (dist > lowEdges[lowEdge])
+			lod = MODEL_LOD_LOW;
+
+		const int baseModel = models[i];
+		const int model = lodModels[baseModel * MODEL_LOD_COUNT + lod];
+
+		// model has no such LOD
+		if (model == baseModel)
+			lod = MODEL_LOD_NORMAL;
+
+		outModels[i] = model;
+
+		curStates.append(key, lod);
+
+		m_stats.numLods[lod]++;
+
+		if (prevLod != -1 && prevLod != lod)
+			m_stats.numSwitches++;
+	}
+
+	m_currentState ^= 1;
+}
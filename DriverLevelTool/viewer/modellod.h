@@ -0,0 +1,68 @@
+#ifndef MODELLOD_H
+#define MODELLOD_H
+
+#include "math/Vector.h"
+#include <nstd/Array.hpp>
+#include <nstd/HashMap.hpp>
+
+class CDriverLevelModels;
+
+//-------------------------------------------------------------------
+// Model LOD selection for whole visible object list.
+// Distance bands have hysteresis so objects near the band edge
+// do not switch models every frame
+//-------------------------------------------------------------------
+
+enum EModelLod
+{
+	MODEL_LOD_HIGH = 0,		// highDetailId
+	MODEL_LOD_NORMAL,		// base model
+	MODEL_LOD_LOW,			// lowDetailId
+
+	MODEL_LOD_COUNT,
+};
+
+struct modelLodSettings_t
+{
+	float	highDistance{ 1.0f };		// closer than this uses high detail model
+	float	lowDistance{ 5.0f };		// further than this uses low detail model
+	float	hysteresis{ 0.25f };		// distance to pass band edge before switching back
+};
+
+struct modelLodStats_t
+{
+	int		numObjects;
+	int		numLods[MODEL_LOD_COUNT];
+	int		numSwitches;				// objects that changed LOD since last frame
+};
+
+class CModelLodSelector
+{
+public:
+	// copies LOD model indices of all models
+	void					Init(CDriverLevelModels* models);
+
+	// must be called when level models are freed
+	void					Reset();
+
+	bool					IsInitialized() const		{ return m_lodModels.size() > 0; }
+
+	// picks model index for each object. Keys identify objects between frames
+	void					Select(int* outModels, const int* models, const Vector3D* positions, const void* const* keys, int count,
+								const Vector3D& cameraPos, bool noLod = false);
+
+	modelLodSettings_t&		GetSettings()				{ return m_settings; }
+	const modelLodStats_t&	GetStats() const			{ return m_stats; }
+
+protected:
+	Array<ushort>			m_lodModels;		// MODEL_LOD_COUNT per model
+	Array<float>			m_distances;
+
+	HashMap<usize, ubyte>	m_lodStates[2];		// previous and current frame, keyed by MakeLodStateKey
+	int						m_currentState{ 0 };
+
+	modelLodSettings_t		m_settings;
+	modelLodStats_t			m_stats;
+};
+
+#endif // MODELLOD_H
@@ -0,0 +1,286 @@
+#include "modelpool.h"
+#include "gl_renderer.h"
+
+#include "core/cmdlib.h"
+
+#include <nstd/Math.hpp>
+
+//-------------------------------------------------------------------
+// Range allocator
+//-------------------------------------------------------------------
+
+void CRangeAllocator::Init(int capacity)
+{
+	m_capacity = capacity;
+	m_freeSize = capacity;
+
+	m_freeBlocks.clear();
+
+	if (capacity > 0)
+		m_freeBlocks.append({ 0, capacity });
+}
+
+int CRangeAllocator::Alloc(int size)
+{
+	if (size <= 0 || size > m_freeSize)
+		return -1;
+
+	// first fit keeps allocations packed to the start
+	for (usize i = 0; i < m_freeBlocks.size(); i++)
+	{
+		rangeBlock_t& block = m_freeBlocks[i];
+
+		if (block.size < size)
+			continue;
+
+		const int offset = block.offset;
+
+		if (block.size == size)
+		{
+			m_freeBlocks.remove(i);
+		}
+		else
+		{
+			block.offset += size;
+			block.size -= size;
+		}
+
+		m_freeSize -= size;
+		return offset;
+	}
+
+	return -1;
+}
+
+void CRangeAllocator::Free(int offset, int size)
+{
+	if (size <= 0)
+		return;
+
+	// find first block after freed range
+	usize lo = 0;
+	usize hi = m_freeBlocks.size();
+
+	while (lo < hi)
+	{
+		const usize mid = (lo + hi) / 2;
+
+		if (m_freeBlocks[mid].offset < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	const bool mergePrev = lo > 0 && m_freeBlocks[lo - 1].offset + m_freeBlocks[lo - 1].size == offset;
+	const bool mergeNext = lo < m_freeBlocks.size() && offset + size == m_freeBlocks[lo].offset;
+
+	if (mergePrev && mergeNext)
+	{
+		m_freeBlocks[lo - 1].size += size + m_freeBlocks[lo].size;
+		m_freeBlocks.remove(lo);
+	}
+	else if (mergePrev)
+	{
+		m_freeBlocks[lo - 1].size += size;
+	}
+	else if (mergeNext)
+	{
+		m_freeBlocks[lo].offset = offset;
+		m_freeBlocks[lo].size += size;
+	}
+	else
+	{
+		m_freeBlocks.insert(lo, { offset, size });
+	}
+
+	m_freeSize += size;
+}
+
+int CRangeAllocator::GetLargestFreeBlock() const
+{
+	int largest = 0;
+
+	for (usize i = 0; i < m_freeBlocks.size(); i++)
+		largest = Math::max(largest, m_freeBlocks[i].size);
+
+	return largest;
+}
+
+bool CRangeAllocator::Validate() const
+{
+	int totalFree = 0;
+	int lastEnd = -1;
+
+	for (usize i = 0; i < m_freeBlocks.size(); i++)
+	{
+		const rangeBlock_t& block = m_freeBlocks[i];
+
+		// adjacent blocks must have been coalesced
+		if (block.size <= 0 || block.offset <= lastEnd)
+			return false;
+
+		lastEnd = block.offset + block.size;
+		totalFree += block.size;
+	}
+
+	return lastEnd <= m_capacity && totalFree == m_freeSize;
+}
+
+//-------------------------------------------------------------------
+// Model buffer pool
+//-------------------------------------------------------------------
+
+CModelBufferPool::~CModelBufferPool()
+{
+	FreeAll();
+}
+
+bool CModelBufferPool::Alloc(modelPoolAlloc_t& alloc, int numVertices, int numIndices)
+{
+	// range allocator can't place empty ranges, this would make new page forever
+	if (numVertices <= 0 || numIndices <= 0)
+		return false;
+
+	for (usize i = 0; i <= m_pages.size(); i++)
+	{
+		if (i == m_pages.size())
+		{
+			// all pages are full - make new one, large enough for any model
+			page_t* newPage = new page_t();
+			newPage->vertices.Init(Math::max(numVertices, MODEL_POOL_PAGE_VERTICES));
+			newPage->indices.Init(Math::max(numIndices, MODEL_POOL_PAGE_INDICES));
+			newPage->numAllocs = 0;
+
+			if (m_vertexFormat == VERTEX_FORMAT_PACKED)
+				newPage->vao = GR_CreatePackedVAO(newPage->vertices.GetCapacity(), newPage->indices.GetCapacity(), nullptr, nullptr, 0);
+			else
+				newPage->vao = GR_CreateVAO(newPage->vertices.GetCapacity(), newPage->indices.GetCapacity(), nullptr, nullptr, 0);
+
+			if (!newPage->vao)
+			{
+				delete newPage;
+				return false;
+			}
+
+			m_pages.append(newPage);
+		}
+
+		page_t* page = m_pages[i];
+
+		const int firstVertex = page->vertices.Alloc(numVertices);
+
+		if (firstVertex == -1)
+			continue;
+
+		const int firstIndex = page->indices.Alloc(numIndices);
+
+		if (firstIndex == -1)
+		{
+			page->vertices.Free(firstVertex, numVertices);
+			continue;
+		}
+
+		page->numAllocs++;
+
+		alloc.page = i;
+		alloc.firstVertex = firstVertex;
+		alloc.numVertices = numVertices;
+		alloc.firstIndex = firstIndex;
+		alloc.numIndices = numIndices;
+
+		return true;
+	}
+
+	return false;
+}
+
+void CModelBufferPool::Free(modelPoolAlloc_t& alloc)
+{
+	if (alloc.page < 0 || alloc.page >= (int)m_pages.size())
+		return;
+
+	page_t* page = m_pages[alloc.page];
+
+	page->vertices.Free(alloc.firstVertex, alloc.numVertices);
+	page->indices.Free(alloc.firstIndex, alloc.numIndices);
+	page->numAllocs--;
+
+	alloc = modelPoolAlloc_t();
+}
+
+void CModelBufferPool::Upload(const modelPoolAlloc_t& alloc, GrVertex* verts, int* indices)
+{
+	GrVAO* vao = GetVAO(alloc.page);
+
+	if (!vao)
+		return;
+
+	GR_UpdateVAO(vao, alloc.firstVertex, alloc.numVertices, verts);
+	GR_UpdateVAOIndices(vao, alloc.firstIndex, alloc.numIndices, indices);
+}
+
+void CModelBufferPool::Upload(const modelPoolAlloc_t& alloc, GrPackedVertex* verts, int* indices)
+{
+	GrVAO* vao = GetVAO(alloc.page);
+
+	if (!vao)
+		return;
+
+	GR_UpdateVAO(vao, alloc.firstVertex, alloc.numVertices, verts);
+	GR_UpdateVAOIndices(vao, alloc.firstIndex, alloc.numIndices, indices);
+}
+
+void CModelBufferPool::SetVertexFormat(GR_VertexFormat format)
+{
+	if (m_pages.size() && format != m_vertexFormat)
+	{
+		MsgError("Model pool vertex format can't be changed while it has pages\n");
+		return;
+	}
+
+	m_vertexFormat = format;
+}
+
+GrVAO* CModelBufferPool::GetVAO(int page) const
+{
+	if (page < 0 || page >= (int)m_pages.size())
+		return nullptr;
+
+	return m_pages[page]->vao;
+}
+
+void CModelBufferPool::FreeAll()
+{
+	for (usize i = 0; i < m_pages.size(); i++)
+	{
+		if (m_pages[i]->numAllocs)
+			MsgWarning("Model pool page %d still has %d models\n", (int)i, m_pages[i]->numAllocs);
+
+		GR_DestroyVAO(m_pages[i]->vao);
+		delete m_pages[i];
+	}
+
+	m_pages.clear();
+}
+
+void CModelBufferPool::PrintStats() const
+{
+	const int vertexSize = GR_GetVertexSize(m_vertexFormat);
+	int64 totalBytes = 0;
+
+	for (usize i = 0; i < m_pages.size(); i++)
+		totalBytes += (int64)m_pages[i]->vertices.GetCapacity() * vertexSize + (int64)m_pages[i]->indices.GetCapacity() * sizeof(int);
+
+	MsgInfo("Model pool: %d pages, %s vertices (%d bytes), %.2f MB\n", (int)m_pages.size(),
+		m_vertexFormat == VERTEX_FORMAT_PACKED ? "packed" : "float", vertexSize, totalBytes / (1024.0 * 1024.0));
+
+	for (usize i = 0; i < m_pages.size(); i++)
+	{
+		const page_t* page = m_pages[i];
+
+		Msg("  page %d: %d models, vertices %d/%d (%d free blocks, largest %d), indices %d/%d\n", (int)i, page->numAllocs,
+			page->vertices.GetCapacity() - page->vertices.GetFreeSize(), page->vertices.GetCapacity(),
+			page->vertices.GetNumFreeBlocks(), page->vertices.GetLargestFreeBlock(),
+			page->indices.GetCapacity() - page->indices.GetFreeSize(), page->indices.GetCapacity());
+	}
+}
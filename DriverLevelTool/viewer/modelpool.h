@@ -0,0 +1,105 @@
+#ifndef MODELPOOL_H
+#define MODELPOOL_H
+
+#include "core/dktypes.h"
+#include "gr_vertexformat.h"
+#include <nstd/Array.hpp>
+
+struct GrVAO;
+struct GrVertex;
+struct GrPackedVertex;
+
+//-------------------------------------------------------------------
+// Range allocator over [0, capacity) with coalescing free list.
+// Has no renderer dependency
+//-------------------------------------------------------------------
+
+struct rangeBlock_t
+{
+	int offset;
+	int size;
+};
+
+class CRangeAllocator
+{
+public:
+	void				Init(int capacity);
+
+	// returns offset or -1 if no block is large enough
+	int					Alloc(int size);
+	void				Free(int offset, int size);
+
+	int					GetCapacity() const			{ return m_capacity; }
+	int					GetFreeSize() const			{ return m_freeSize; }
+	int					GetNumFreeBlocks() const	{ return m_freeBlocks.size(); }
+	int					GetLargestFreeBlock() const;
+
+	bool				IsEmpty() const				{ return m_freeSize == m_capacity; }
+
+	// checks that free blocks are sorted, not overlapping and coalesced
+	bool				Validate() const;
+
+protected:
+	Array<rangeBlock_t>	m_freeBlocks;		// sorted by offset
+	int					m_capacity{ 0 };
+	int					m_freeSize{ 0 };
+};
+
+//-------------------------------------------------------------------
+// Shared vertex/index buffers for world models.
+// Indices stored in pages are relative to page vertex buffer
+//-------------------------------------------------------------------
+
+#define MODEL_POOL_PAGE_VERTICES	(256 * 1024)
+#define MODEL_POOL_PAGE_INDICES		(512 * 1024)
+
+struct modelPoolAlloc_t
+{
+	int page{ -1 };
+
+	int firstVertex{ 0 };
+	int numVertices{ 0 };
+
+	int firstIndex{ 0 };
+	int numIndices{ 0 };
+};
+
+class CModelBufferPool
+{
+public:
+						~CModelBufferPool();
+
+	// finds space in existing pages or creates new one
+	bool				Alloc(modelPoolAlloc_t& alloc, int numVertices, int numIndices);
+	void				Free(modelPoolAlloc_t& alloc);
+
+	// indices must be already offset by alloc.firstVertex
+	void				Upload(const modelPoolAlloc_t& alloc, GrVertex* verts, int* indices);
+	void				Upload(const modelPoolAlloc_t& alloc, GrPackedVertex* verts, int* indices);
+
+	// format of new pages, must be set while pool is empty
+	void				SetVertexFormat(GR_VertexFormat format);
+	GR_VertexFormat		GetVertexFormat() const		{ return m_vertexFormat; }
+
+	GrVAO*				GetVAO(int page) const;
+	int					GetNumPages() const			{ return m_pages.size(); }
+
+	// destroys all pages, all allocations must be freed
+	void				FreeAll();
+
+	void				PrintStats() const;
+
+protected:
+	struct page_t
+	{
+		GrVAO*			vao;
+		CRangeAllocator	vertices;
+		CRangeAllocator	indices;
+		int				numAllocs;
+	};
+
+	Array<page_t*>		m_pages;
+	GR_VertexFormat		m_vertexFormat{ VERTEX_FORMAT_FLOAT };
+};
+
+#endif // MODELPOOL_H
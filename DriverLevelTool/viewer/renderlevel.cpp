@@ -3,6 +3,8 @@
 
 #include <string.h>
 
+#include <nstd/Time.hpp>
+
 #include "core/VirtualStream.h"
 #include "driver_routines/models.h"
 #include "driver_routines/regions_d1.h"
@@ -11,6 +13,8 @@
 #include "math/Volume.h"
 #include "math/isin.h"
 #include "rendermodel.h"
+#include "renderlist.h"
+#include "modellod.h"
 #include "renderheightmap.h"
 #include "core/cmdlib.h"
 
@@ -35,59 +39,31 @@ extern bool g_displayAllCellLevels;
 extern bool g_displayRoads;
 extern bool g_displayRoadConnections;
 extern bool g_noLod;
+extern bool g_instancedDrawing;
 extern int g_cellsDrawDistance;
 
 //-----------------------------------------------------------------
 
-const float MODEL_LOD_HIGH_MIN_DISTANCE = 1.0f;
-const float MODEL_LOD_LOW_MIN_DISTANCE = 5.0f;
-
-//-------------------------------------------------------
-// returns specific model or LOD model
-// based on the distance from camera
-//-------------------------------------------------------
-ModelRef_t* GetModelCheckLods(int index, float distSqr)
-{
-	ModelRef_t* baseRef = g_levModels.GetModelByIndex(index);
-
-	if (g_noLod)
-		return baseRef;
-
-	ModelRef_t* retRef = baseRef;
-	if (baseRef->highDetailId != 0xFFFF)
-	{
-		if (distSqr < MODEL_LOD_HIGH_MIN_DISTANCE * MODEL_LOD_HIGH_MIN_DISTANCE)
-			return g_levModels.GetModelByIndex(baseRef->highDetailId);
-	}
-
-	if (baseRef->lowDetailId != 0xFFFF)
-	{
-		if (distSqr > MODEL_LOD_LOW_MIN_DISTANCE * MODEL_LOD_LOW_MIN_DISTANCE)
-			return g_levModels.GetModelByIndex(baseRef->lowDetailId);
-	}
-
-	return retRef;
-}
+// LOD selection of visible objects
+CModelLodSelector g_modelLods;
 
 // stats counters
 int g_drawnCells;
 int g_drawnModels;
 int g_drawnPolygons;
+int g_culledModels;
 
-void DrawCellObject(const CELL_OBJECT& co, const Vector3D& cameraPos, float cameraAngleY, const Volume& frustrumVolume, bool buildingLighting)
-{
-	if (co.type >= MAX_MODELS)
-	{
-		// WHAT THE FUCK?
-		return;
-	}
-
-	Vector3D absCellPosition = FromFixedVector(co.pos);
-	absCellPosition.y *= -1.0f;
+// CPU time of the current frame in microseconds
+int64 g_spoolTime;
+int64 g_meshUploadTime;
 
-	const float distanceFromCamera = lengthSqr(absCellPosition - cameraPos);
+// visible objects of current frame
+CRenderList g_levelRenderList;
 
-	ModelRef_t* ref = GetModelCheckLods(co.type, distanceFromCamera);
+// modelIndex is co.type or its LOD model
+void DrawCellObject(const CELL_OBJECT& co, int modelIndex, const Vector3D& absCellPosition, float cameraAngleY, const Volume& frustrumVolume, bool buildingLighting, CRenderList* renderList = nullptr)
+{
+	ModelRef_t* ref = g_levModels.GetModelByIndex(modelIndex);
 
 	if (!ref->model)
 		return;
@@ -103,7 +79,10 @@ void DrawCellObject(const CELL_OBJECT& co, const Vector3D& cameraPos, float came
 	const float boundSphere = model->bounding_sphere * RENDER_SCALING * 2.0f;
 
 	if (!frustrumVolume.IsSphereInside(absCellPosition, boundSphere))
+	{
+		g_culledModels++;
 		return;
+	}
 
 	bool isGround = false;
 
@@ -113,63 +92,123 @@ void DrawCellObject(const CELL_OBJECT& co, const Vector3D& cameraPos, float came
 		isGround = true;
 	}
 
-	// compute world matrix
-	{
-		Matrix4x4 objectMatrix;
+	float objectAngle;
 
-		if (model->shape_flags & SHAPE_FLAG_SPRITE)
-		{
-			objectMatrix = rotateY4(DEG2RAD(cameraAngleY));
-		}
-		else 
-		{
-			const float cellRotationRad = -co.yang / 64.0f * PI_F * 2.0f;
-			objectMatrix = rotateY4(cellRotationRad);
-		}
-			
+	if (model->shape_flags & SHAPE_FLAG_SPRITE)
+		objectAngle = DEG2RAD(cameraAngleY);
+	else
+		objectAngle = -co.yang / 64.0f * PI_F * 2.0f;
+
+	const int lighting = ((isGround || !buildingLighting) && g_nightMode) ? LIGHTING_NIGHT_GROUND : LIGHTING_DEFAULT;
+
+	if (renderList)
+	{
+		// drawn later with other instances
+		renderList->AddInstance(renderModel, lighting, absCellPosition, objectAngle);
+	}
+	else
+	{
+		// compute world matrix
+		Matrix4x4 objectMatrix = rotateY4(objectAngle);
 		objectMatrix.setTranslationTransposed(absCellPosition);
 
 		GR_SetMatrix(MATRIX_WORLD, objectMatrix);
 		GR_UpdateMatrixUniforms();
-	}
 
-	const float nightAmbientScale = 0.35f;
-	const float nightLightScale = 0.0f;
+		// apply lighting
+		float ambientScale, lightScale;
+		GetRenderLightingScale(lighting, ambientScale, lightScale);
 
-	const float ambientScale = 1.0f;
-	const float lightScale = 1.0;
-
-	// apply lighting
-	if ((isGround || !buildingLighting) && g_nightMode)
-		CRenderModel::SetupLightingProperties(nightAmbientScale, nightLightScale);
-	else
 		CRenderModel::SetupLightingProperties(ambientScale, lightScale);
 
-	renderModel->SetupModelShader();
-	renderModel->SetDrawBuffer();
-	renderModel->DrawBatchs();
+		renderModel->SetupModelShader();
+		renderModel->SetDrawBuffer();
+		renderModel->DrawBatchs();
+
+		extern TextureID g_whiteTexture;
+		extern bool g_displayWireframeBackfaces;
+
+		if (g_displayWireframeBackfaces)
+		{
+			GR_SetFillMode(FILL_WIREFRAME);
+			GR_SetCullMode(CULL_BACK);
+
+			GR_SetTexture(g_whiteTexture);
+			renderModel->DrawBatchs(true);
+
+			GR_SetFillMode(FILL_SOLID);
+			GR_SetCullMode(CULL_FRONT);
+		}
+	}
+
+	g_drawnModels++;
+	g_drawnPolygons += ref->model->num_polys;
 
+	// debug
+	if (g_displayCollisionBoxes)
+		CRenderModel::DrawModelCollisionBox(ref, co.pos, co.yang);
+}
+
+//-------------------------------------------------------
+// Draws objects collected by DrawCellObject
+//-------------------------------------------------------
+void DrawRenderList(CRenderList& renderList)
+{
 	extern TextureID g_whiteTexture;
 	extern bool g_displayWireframeBackfaces;
 
+	renderList.Build();
+	renderList.Draw();
+
 	if (g_displayWireframeBackfaces)
 	{
 		GR_SetFillMode(FILL_WIREFRAME);
 		GR_SetCullMode(CULL_BACK);
 
 		GR_SetTexture(g_whiteTexture);
-		renderModel->DrawBatchs(true);
+		renderList.Draw(true);
 
 		GR_SetFillMode(FILL_SOLID);
 		GR_SetCullMode(CULL_FRONT);
 	}
+}
 
-	g_drawnModels++;
-	g_drawnPolygons += ref->model->num_polys;
+//-------------------------------------------------------
+// Selects LODs for all visible cell objects and draws them
+// keys identify objects between frames for LOD hysteresis
+//-------------------------------------------------------
+void DrawCellObjectList(const CELL_OBJECT* objects, const void* const* keys, int count, float cameraAngleY, const Vector3D& cameraPos, const Volume& frustrumVolume)
+{
+	static Array<int> objectModels;
+	static Array<int> lodModels;
+	static Array<Vector3D> objectPositions;
 
-	// debug
-	if (g_displayCollisionBoxes)
-		CRenderModel::DrawModelCollisionBox(ref, co.pos, co.yang);
+	objectModels.resize(count);
+	lodModels.resize(count);
+	objectPositions.resize(count);
+
+	if (!g_modelLods.IsInitialized())
+		g_modelLods.Init(&g_levModels);
+
+	for (int i = 0; i < count; i++)
+	{
+		Vector3D& position = objectPositions[i];
+		position = FromFixedVector(objects[i].pos);
+		position.y *= -1.0f;
+
+		objectModels[i] = objects[i].type;
+	}
+
+	g_modelLods.Select(lodModels, objectModels, objectPositions, keys, count, cameraPos, g_noLod);
+
+	CRenderList* renderList = (g_instancedDrawing && CRenderModel::IsInstancingSupported()) ? &g_levelRenderList : nullptr;
+	g_levelRenderList.Clear();
+
+	for (int i = 0; i < count; i++)
+		DrawCellObject(objects[i], lodModels[i], objectPositions[i], cameraAngleY, frustrumVolume, true, renderList);
+
+	if (renderList)
+		DrawRenderList(*renderList);
 }
 
 //-------------------------------------------------------
@@ -182,6 +221,8 @@ void DrawLevelDriver2(const Vector3D& cameraPos, float cameraAngleY, const Volum
 	g_drawnCells = 0;
 	g_drawnModels = 0;
 	g_drawnPolygons = 0;
+	g_culledModels = 0;
+	g_spoolTime = 0;
 
 	VECTOR_NOPAD cameraPosition = ToFixedVector(cameraPos);
 
@@ -234,7 +275,9 @@ void DrawLevelDriver2(const Vector3D& cameraPos, float cameraAngleY, const Volum
 				ci.cache = &iteratorCache;
 				PACKED_CELL_OBJECT* ppco;
 
+				const int64 spoolStartTime = Time::microTicks();
 				levMapDriver2->SpoolRegion(spoolContext, icell);
+				g_spoolTime += Time::microTicks() - spoolStartTime;
 
 				ppco = levMapDriver2->GetFirstPackedCop(&ci, icell);
 
@@ -284,18 +327,37 @@ void DrawLevelDriver2(const Vector3D& cameraPos, float cameraAngleY, const Volum
 		}
 	}
 
+	// build buffers of models spooled this frame
+	const int64 uploadStartTime = Time::microTicks();
+	CRenderModel::UploadPendingModels();
+	g_meshUploadTime = Time::microTicks() - uploadStartTime;
+
 	// at least once we should do that
 	CRenderModel::SetupModelShader();
 
+	static Array<CELL_OBJECT> cellObjects;
+	static Array<const void*> cellObjectKeys;
+	cellObjects.clear();
+	cellObjectKeys.clear();
+
 	// draw object list
 	for (uint i = 0; i < drawObjects.size(); i++)
 	{
 		CELL_OBJECT co;
 		CDriver2LevelMap::UnpackCellObject(co, drawObjects[i].pco, drawObjects[i].nearCell);
 
-		DrawCellObject(co, cameraPos, cameraAngleY, frustrumVolume, true);
+		if (co.type >= MAX_MODELS)
+		{
+			// WHAT THE FUCK?
+			continue;
+		}
+
+		cellObjects.append(co);
+		cellObjectKeys.append(drawObjects[i].pco);
 	}
 
+	DrawCellObjectList(cellObjects, cellObjectKeys, cellObjects.size(), cameraAngleY, cameraPos, frustrumVolume);
+
 	if (g_displayHeightMap)
 	{
 		for (int i = 8192, dir = 0, hloop = 0, vloop = 0; i >= 0; --i)
@@ -590,6 +652,8 @@ void DrawLevelDriver1(const Vector3D& cameraPos, float cameraAngleY, const Volum
 	g_drawnCells = 0;
 	g_drawnModels = 0;
 	g_drawnPolygons = 0;
+	g_culledModels = 0;
+	g_spoolTime = 0;
 
 	VECTOR_NOPAD cameraPosition = ToFixedVector(cameraPos);
 
@@ -631,7 +695,9 @@ void DrawLevelDriver1(const Vector3D& cameraPos, float cameraAngleY, const Volum
 			if (icell.x > -1 && icell.x < levMapDriver1->GetCellsAcross() &&
 				icell.z > -1 && icell.z < levMapDriver1->GetCellsDown())
 			{
+				const int64 spoolStartTime = Time::microTicks();
 				levMapDriver1->SpoolRegion(spoolContext, icell);
+				g_spoolTime += Time::microTicks() - spoolStartTime;
 
 				pco = levMapDriver1->GetFirstCop(&ci, icell);
 
@@ -678,14 +744,30 @@ void DrawLevelDriver1(const Vector3D& cameraPos, float cameraAngleY, const Volum
 		i--;
 	}
 
+	// build buffers of models spooled this frame
+	const int64 uploadStartTime = Time::microTicks();
+	CRenderModel::UploadPendingModels();
+	g_meshUploadTime = Time::microTicks() - uploadStartTime;
+
 	// at least once we should do that
 	CRenderModel::SetupModelShader();
 
+	static Array<CELL_OBJECT> cellObjects;
+	static Array<const void*> cellObjectKeys;
+	cellObjects.clear();
+	cellObjectKeys.clear();
+
 	for (uint i = 0; i < drawObjects.size(); i++)
 	{
-		DrawCellObject(*drawObjects[i], cameraPos, cameraAngleY, frustrumVolume, true);
+		if (drawObjects[i]->type >= MAX_MODELS)
+			continue;
+
+		cellObjects.append(*drawObjects[i]);
+		cellObjectKeys.append(drawObjects[i]);
 	}
 
+	DrawCellObjectList(cellObjects, cellObjectKeys, cellObjects.size(), cameraAngleY, cameraPos, frustrumVolume);
+
 	if (g_displayRoads)
 	{
 		ROUTE_DATA route;
@@ -0,0 +1,198 @@
+#include "driver_routines/models.h"
+#include "renderlist.h"
+#include "rendermodel.h"
+#include "gl_renderer.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//-------------------------------------------------------------------
+
+void GetRenderLightingScale(int lighting, float& ambientScale, float& lightScale)
+{
+	if (lighting == LIGHTING_NIGHT_GROUND)
+	{
+		ambientScale = 0.35f;
+		lightScale = 0.0f;
+		return;
+	}
+
+	ambientScale = 1.0f;
+	lightScale = 1.0f;
+}
+
+template <typename T>
+static int CompareValues(const T a, const T b)
+{
+	return (a < b) ? -1 : (a > b ? 1 : 0);
+}
+
+// order so instances of one model and lighting are together
+static int CompareRenderInstances(const void* a, const void* b)
+{
+	const renderInstance_t* ia = (const renderInstance_t*)a;
+	const renderInstance_t* ib = (const renderInstance_t*)b;
+
+	int cmp = CompareValues(ia->lighting, ib->lighting);
+
+	if (!cmp)
+		cmp = CompareValues((uintptr_t)ia->model->GetVAO(), (uintptr_t)ib->model->GetVAO());
+
+	if (!cmp)
+		cmp = CompareValues((uintptr_t)ia->model, (uintptr_t)ib->model);
+
+	return cmp;
+}
+
+// order by state change cost: lighting (shader uniforms), texture, buffers
+static int CompareRenderBuckets(const void* a, const void* b)
+{
+	const renderBucket_t* ba = (const renderBucket_t*)a;
+	const renderBucket_t* bb = (const renderBucket_t*)b;
+
+	int cmp = CompareValues(ba->lighting, bb->lighting);
+
+	if (!cmp)
+		cmp = CompareValues(ba->tpage, bb->tpage);
+
+	if (!cmp)
+		cmp = CompareValues((uintptr_t)ba->model->GetVAO(), (uintptr_t)bb->model->GetVAO());
+
+	if (!cmp)
+		cmp = CompareValues((uintptr_t)ba->model, (uintptr_t)bb->model);
+
+	if (!cmp)
+		cmp = CompareValues(ba->batch, bb->batch);
+
+	return cmp;
+}
+
+//-------------------------------------------------------------------
+
+void CRenderList::Clear()
+{
+	m_instances.clear();
+	m_transforms.clear();
+	m_buckets.clear();
+
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void CRenderList::AddInstance(CRenderModel* model, int lighting, const Vector3D& position, float angle)
+{
+	renderInstance_t& instance = m_instances.append(renderInstance_t());
+	instance.model = model;
+	instance.lighting = lighting;
+	instance.transform = Vector4D(position, angle);
+}
+
+void CRenderList::Build()
+{
+	m_transforms.clear();
+	m_buckets.clear();
+
+	// Draw accumulates, so wireframe pass adds to the same frame stats
+	memset(&m_stats, 0, sizeof(m_stats));
+
+	if (m_instances.size())
+		qsort(&m_instances[0], m_instances.size(), sizeof(renderInstance_t), CompareRenderInstances);
+
+	m_transforms.reserve(m_instances.size());
+
+	// each run of same model and lighting makes bucket per model batch
+	for (usize i = 0; i < m_instances.size(); )
+	{
+		const renderInstance_t& first = m_instances[i];
+		const int firstInstance = m_transforms.size();
+
+		for (; i < m_instances.size(); i++)
+		{
+			const renderInstance_t& instance = m_instances[i];
+
+			if (instance.model != first.model || instance.lighting != first.lighting)
+				break;
+
+			m_transforms.append(instance.transform);
+		}
+
+		const int numBatches = first.model->GetNumBatches();
+
+		for (int j = 0; j < numBatches; j++)
+		{
+			renderBucket_t& bucket = m_buckets.append(renderBucket_t());
+			bucket.model = first.model;
+			bucket.batch = j;
+			bucket.tpage = first.model->GetBatch(j).tpage;
+			bucket.lighting = first.lighting;
+			bucket.firstInstance = firstInstance;
+			bucket.numInstances = m_transforms.size() - firstInstance;
+		}
+	}
+
+	if (m_buckets.size())
+		qsort(&m_buckets[0], m_buckets.size(), sizeof(renderBucket_t), CompareRenderBuckets);
+
+	m_stats.numInstances = m_instances.size();
+	m_stats.numBuckets = m_buckets.size();
+}
+
+void CRenderList::Draw(bool skipTextures)
+{
+	extern TextureID GetHWTexture(int tpage, int pal);
+
+	int lastLighting = -1;
+	int lastTpage = -1;
+	GrVAO* lastVAO = nullptr;
+
+	// instances are already in world space
+	GR_SetMatrix(MATRIX_WORLD, identity4());
+
+	for (usize i = 0; i < m_buckets.size(); i++)
+	{
+		const renderBucket_t& bucket = m_buckets[i];
+
+		if (bucket.lighting != lastLighting)
+		{
+			float ambientScale, lightScale;
+			GetRenderLightingScale(bucket.lighting, ambientScale, lightScale);
+
+			CRenderModel::SetupLightingProperties(ambientScale, lightScale);
+			CRenderModel::SetupInstancedModelShader();
+			GR_UpdateMatrixUniforms();
+
+			lastLighting = bucket.lighting;
+			m_stats.numShaderChanges++;
+		}
+
+		if (!skipTextures && bucket.tpage != lastTpage)
+		{
+			GR_SetTexture(GetHWTexture(bucket.tpage, 0));
+
+			lastTpage = bucket.tpage;
+			m_stats.numTextureChanges++;
+		}
+
+		GrVAO* vao = bucket.model->GetVAO();
+
+		if (vao != lastVAO)
+		{
+			GR_SetVAO(vao);
+
+			lastVAO = vao;
+			m_stats.numBufferChanges++;
+		}
+
+		const modelBatch_t& batch = bucket.model->GetBatch(bucket.batch);
+
+		for (int j = 0; j < bucket.numInstances; j += MODEL_MAX_INSTANCES)
+		{
+			const int numInstances = MIN(bucket.numInstances - j, MODEL_MAX_INSTANCES);
+
+			CRenderModel::SetInstanceTransforms(&m_transforms[bucket.firstInstance + j], numInstances);
+			GR_DrawIndexedInstanced(PRIM_TRIANGLES, batch.startIndex, batch.numIndices, numInstances);
+
+			m_stats.numDrawCalls++;
+		}
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef RENDERLIST_H
+#define RENDERLIST_H
+
+#include "math/Vector.h"
+#include <nstd/Array.hpp>
+
+class CRenderModel;
+
+//-------------------------------------------------------------------
+// Draw list of visible world objects.
+// Instances are bucketed by (model, tpage, lighting mode) and
+// each bucket is drawn with instanced draws
+//-------------------------------------------------------------------
+
+enum ERenderLightingMode
+{
+	LIGHTING_DEFAULT = 0,
+	LIGHTING_NIGHT_GROUND,		// ground and non-building objects at night
+
+	LIGHTING_MODES,
+};
+
+struct renderInstance_t
+{
+	CRenderModel*	model;
+	int				lighting;
+	Vector4D		transform;		// position and Y rotation angle
+};
+
+struct renderBucket_t
+{
+	CRenderModel*	model;
+	int				batch;
+	int				tpage;
+	int				lighting;
+
+	int				firstInstance;	// in sorted transforms
+	int				numInstances;
+};
+
+struct renderListStats_t
+{
+	int				numInstances;
+	int				numBuckets;
+	int				numDrawCalls;
+
+	// draws and state changes, accumulated by all Draw calls since Build
+	int				numShaderChanges;
+	int				numTextureChanges;
+	int				numBufferChanges;
+};
+
+class CRenderList
+{
+public:
+	void						Clear();
+
+	void						AddInstance(CRenderModel* model, int lighting, const Vector3D& position, float angle);
+
+	// sorts instances and makes buckets, no renderer calls
+	void						Build();
+
+	// issues one instanced draw per bucket (split by MODEL_MAX_INSTANCES)
+	void						Draw(bool skipTextures = false);
+
+	const renderListStats_t&	GetStats() const { return m_stats; }
+	int							GetNumBuckets() const { return m_buckets.size(); }
+
+protected:
+	Array<renderInstance_t>		m_instances;
+	Array<Vector4D>				m_transforms;
+	Array<renderBucket_t>		m_buckets;
+
+	renderListStats_t			m_stats;
+};
+
+// gets ambient and light scale for lighting mode
+void GetRenderLightingScale(int lighting, float& ambientScale, float& lightScale);
+
+#endif // RENDERLIST_H
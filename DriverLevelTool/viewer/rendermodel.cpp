@@ -3,25 +3,68 @@
 #include "rendermodel.h"
 #include "gl_renderer.h"
 #include "core/cmdlib.h"
+#include "core/VirtualStream.h"
 #include "debug_overlay.h"
+#include "driver_level.h"
 
 #include <assert.h>
+#include <string.h>
+
+#include <nstd/HashMap.hpp>
+#include <nstd/Time.hpp>
+#include <nstd/Math.hpp>
+#include <nstd/Thread.hpp>
+#include <nstd/Atomic.hpp>
+#include <nstd/System.hpp>
 
 #include "convert.h"
 
-#define MODEL_VERTEX_SHADER \
+// packed vertices have fixed point position and 8 bit UVs
+#define MODEL_VERTEX_ATTRIBUTES \
 	"	attribute vec4 a_position_tu;\n"\
 	"	attribute vec4 a_normal_tv;\n"\
 	"	attribute vec4 a_color;\n"\
+	"#ifdef PACKED_VERTEX\n"\
+	"	attribute vec2 a_texcoord;\n"\
+	"	#define VERTEX_POSITION (a_position_tu.xyz * (1.0 / 4096.0))\n"\
+	"	#define VERTEX_TEXCOORD ((a_texcoord + 0.5) / 256.0)\n"\
+	"#else\n"\
+	"	#define VERTEX_POSITION a_position_tu.xyz\n"\
+	"	#define VERTEX_TEXCOORD vec2(a_position_tu.w, a_normal_tv.w)\n"\
+	"#endif\n"
+
+#define MODEL_VERTEX_SHADER \
+	MODEL_VERTEX_ATTRIBUTES\
 	"	uniform mat4 u_View;\n"\
 	"	uniform mat4 u_Projection;\n"\
 	"	uniform mat4 u_World;\n"\
 	"	uniform mat4 u_WorldViewProj;\n"\
 	"	void main() {\n"\
-	"		v_texcoord = vec2(a_position_tu.w, 1.0-a_normal_tv.w);\n"\
+	"		v_texcoord = vec2(VERTEX_TEXCOORD.x, 1.0-VERTEX_TEXCOORD.y);\n"\
 	"		v_normal = mat3(u_World) * a_normal_tv.xyz;\n"\
 	"		v_color = a_color;\n"\
-	"		gl_Position = u_WorldViewProj * vec4(a_position_tu.xyz, 1.0);\n"\
+	"		gl_Position = u_WorldViewProj * vec4(VERTEX_POSITION, 1.0);\n"\
+	"	}\n"
+
+#define _MODEL_SHADER_STR(x) #x
+#define MODEL_SHADER_STR(x) _MODEL_SHADER_STR(x)
+
+// instance is position and Y rotation angle
+#define MODEL_INSTANCED_VERTEX_SHADER \
+	MODEL_VERTEX_ATTRIBUTES\
+	"	uniform mat4 u_WorldViewProj;\n"\
+	"	uniform vec4 u_instances[" MODEL_SHADER_STR(MODEL_MAX_INSTANCES) "];\n"\
+	"	vec3 rotateY(vec3 v, float s, float c) {\n"\
+	"		return vec3(c * v.x - s * v.z, v.y, s * v.x + c * v.z);\n"\
+	"	}\n"\
+	"	void main() {\n"\
+	"		vec4 instance = u_instances[gl_InstanceID];\n"\
+	"		float s = sin(instance.w);\n"\
+	"		float c = cos(instance.w);\n"\
+	"		v_texcoord = vec2(VERTEX_TEXCOORD.x, 1.0-VERTEX_TEXCOORD.y);\n"\
+	"		v_normal = rotateY(a_normal_tv.xyz, s, c);\n"\
+	"		v_color = a_color;\n"\
+	"		gl_Position = u_WorldViewProj * vec4(rotateY(VERTEX_POSITION, s, c) + instance.xyz, 1.0);\n"\
 	"	}\n"
 
 #define MODEL_FRAGMENT_SHADER \
@@ -39,15 +82,21 @@
 	"		fragColor = lighting;\n"\
 	"	}\n"
 
-const char* model_shader =
-	"varying vec2 v_texcoord;\n"
-	"varying vec3 v_normal;\n"
-	"varying vec4 v_color;\n"
-	"#ifdef VERTEX\n"
-	MODEL_VERTEX_SHADER
-	"#else\n"
-	MODEL_FRAGMENT_SHADER
-	"#endif\n";
+#define MODEL_SHADER(vertexShader) \
+	"varying vec2 v_texcoord;\n"\
+	"varying vec3 v_normal;\n"\
+	"varying vec4 v_color;\n"\
+	"#ifdef VERTEX\n"\
+	vertexShader\
+	"#else\n"\
+	MODEL_FRAGMENT_SHADER\
+	"#endif\n"
+
+const char* model_shader = MODEL_SHADER(MODEL_VERTEX_SHADER);
+const char* model_instanced_shader = MODEL_SHADER(MODEL_INSTANCED_VERTEX_SHADER);
+
+const char* model_packed_shader = "#define PACKED_VERTEX\n" MODEL_SHADER(MODEL_VERTEX_SHADER);
+const char* model_packed_instanced_shader = "#define PACKED_VERTEX\n" MODEL_SHADER(MODEL_INSTANCED_VERTEX_SHADER);
 
 //-------------------------------------------------------------------
 
@@ -98,9 +147,20 @@ bool CRenderModel::Initialize(ModelRef_t* model)
 	return true;
 }
 
+// shared buffers for world models
+static CModelBufferPool s_modelPool;
+
+// selected by InitModelShader
+static GR_VertexFormat s_vertexFormat = VERTEX_FORMAT_FLOAT;
+
 void CRenderModel::Destroy()
 {
-	GR_DestroyVAO(m_vao);
+	if (m_pooled)
+		s_modelPool.Free(m_poolAlloc);
+	else
+		GR_DestroyVAO(m_vao);
+
+	m_pooled = false;
 	m_vao = nullptr;
 	m_sourceModel = nullptr;
 	m_batches.clear();
@@ -117,6 +177,7 @@ struct vertexTuple_t
 	ushort	uvs;
 };
 
+// reference linear search, used by benchmark
 int FindGrVertexIndex(const Array<vertexTuple_t>& whereFind, int flags, int vertexIndex, int normalIndex, ushort uvs)
 {
 	for(usize i = 0; i < whereFind.size(); i++)
@@ -147,6 +208,15 @@ int FindGrVertexIndex(const Array<vertexTuple_t>& whereFind, int flags, int vert
 	return -1;
 }
 
+// only vertices of gouraud shaded faces are shared, others get face normal
+static uint64 MakeVertexKey(int flags, int vertexIndex, int normalIndex, ushort uvs)
+{
+	if (!(flags & FACE_TEXTURED))
+		uvs = 0;
+
+	return (uint64)flags | ((uint64)vertexIndex << 8) | ((uint64)normalIndex << 24) | ((uint64)uvs << 40);
+}
+
 struct genBatch_t
 {
 	Array<int>				indices;
@@ -164,56 +234,63 @@ genBatch_t* FindBatch(Array<genBatch_t*>& batches, int tpageId)
 	return nullptr;
 }
 
-void CRenderModel::GenerateBuffers()
+//-------------------------------------------------------------------
+// Builds vertices, indices and batches from decoded model polygons
+// linearSearch uses old O(n^2) vertex and batch search for comparison
+//-------------------------------------------------------------------
+void CRenderModel::BuildMeshData(modelMeshData_t& mesh, ModelRef_t* ref, bool linearSearch /*= false*/)
 {
 	Array<genBatch_t*>		batches;
-	Array<GrVertex>			vertices;
 	Array<vertexTuple_t>	verticesMap;
 
-	MODEL* model = m_sourceModel->model;
+	HashMap<uint64, int>	vertexLookup;
+	HashMap<int, genBatch_t*> batchLookup;
+
+	Array<GrVertex>&		vertices = mesh.vertices;
+
+	mesh.vertices.clear();
+	mesh.packedVertices.clear();
+	mesh.indices.clear();
+	mesh.batches.clear();
+
+	mesh.format = VERTEX_FORMAT_FLOAT;
+
+	mesh.extMin = Vector3D(V_MAX_COORD);
+	mesh.extMax = Vector3D(-V_MAX_COORD);
+
+	MODEL* model = ref->model;
 	MODEL* vertex_ref = model;
 
-	if (m_sourceModel->baseInstance) // car models have vertex_ref=0
+	if (ref->baseInstance) // car models have vertex_ref=0
 	{
-		vertex_ref = m_sourceModel->baseInstance->model;
+		vertex_ref = ref->baseInstance->model;
 	}
 
 	genBatch_t* batch = nullptr;
 
-	const int modelSize = m_sourceModel->size;
-	int face_ofs = 0;
-	dpoly_t dec_face;
+	// [A] HACK: is sky? force POLYFT4. This fixes VEGAS skies
+	// such models are not using decoded polygons cache
+	Array<dpoly_t> skyPolys;
+	const dpoly_t* polys;
+	int numPolys;
+
+	if (ref->index < 4)
+	{
+		skyPolys.resize(model->num_polys);
+		numPolys = decode_model_polys(model, ref->size, (dpoly_t*)skyPolys, 21, ref->index);
+		polys = (dpoly_t*)skyPolys;
+	}
+	else
+	{
+		polys = GetModelPolys(ref, numPolys);
+	}
 
 	vertices.reserve(model->num_vertices);
 
 	// go through all polygons
-	for (int i = 0; i < model->num_polys; i++)
+	for (int i = 0; i < numPolys; i++)
 	{
-		char* facedata = model->pPolyAt(face_ofs);
-
-		// check offset
-		if ((ubyte*)facedata >= (ubyte*)model + modelSize)
-		{
-			MsgError("MDL %d poly id=%d type=%d ofs=%d bad offset!\n", m_sourceModel->index, i, *facedata & 31, model->poly_block + face_ofs);
-			break;
-		}
-
-		int forcePolyType = -1;
-
-		// [A] HACK: is sky? force POLYFT4. This fixes VEGAS skies
-		if (m_sourceModel->index < 4)
-			forcePolyType = 21;
-
-		int poly_size = decode_poly(facedata, &dec_face, forcePolyType);
-
-		// check poly size
-		if (poly_size == 0)
-		{
-			MsgError("MDL %d poly id=%d type=%d ofs=%d zero size!\n", m_sourceModel->index, i, *facedata & 31, model->poly_block + face_ofs);
-			break;
-		}
-
-		face_ofs += poly_size;
+		const dpoly_t& dec_face = polys[i];
 
 		int numPolyVerts = (dec_face.flags & FACE_IS_QUAD) ? 4 : 3;
 		bool bad_face = false;
@@ -241,7 +318,7 @@ void CRenderModel::GenerateBuffers()
 
 		if (bad_face)
 		{
-			MsgError("MDL %d poly id=%d type=%d ofs=%d has invalid indices (or format is unknown)\n", m_sourceModel->index,  i, *facedata & 31, model->poly_block + face_ofs);
+			MsgError("MDL %d poly id=%d type=%d ofs=%d has invalid indices (or format is unknown)\n", ref->index,  i, dec_face.type, model->poly_block + dec_face.ofs);
 
 			continue;
 		}
@@ -253,7 +330,17 @@ void CRenderModel::GenerateBuffers()
 			tpageId = -1;
 
 		if (batch && batch->tpage != tpageId)
-			batch = FindBatch(batches, tpageId);
+		{
+			if (linearSearch)
+			{
+				batch = FindBatch(batches, tpageId);
+			}
+			else
+			{
+				HashMap<int, genBatch_t*>::Iterator it = batchLookup.find(tpageId);
+				batch = (it != batchLookup.end()) ? *it : nullptr;
+			}
+		}
 
 		if (!batch)
 		{
@@ -261,6 +348,7 @@ void CRenderModel::GenerateBuffers()
 			batch->tpage = tpageId;
 
 			batches.append(batch);
+			batchLookup.append(tpageId, batch);
 		}
 
 		// Gouraud-shaded poly smoothing
@@ -275,27 +363,37 @@ void CRenderModel::GenerateBuffers()
 #define VERT_IDX v//numPolyVerts - 1 - v
 
 			int vflags = dec_face.flags & ~(FACE_IS_QUAD | FACE_RGB);
+			const ushort uvs = *(ushort*)dec_face.uv[VERT_IDX];
 
 			// try searching for vertex
-			int index = FindGrVertexIndex(verticesMap,
-				vflags,
-				dec_face.vindices[VERT_IDX],
-				dec_face.nindices[VERT_IDX],
-				*(ushort*)dec_face.uv[VERT_IDX]);
+			int index = -1;
 
-			//if (vertexModCb)
-			//	index = -1;
+			if (linearSearch)
+			{
+				index = FindGrVertexIndex(verticesMap,
+					vflags,
+					dec_face.vindices[VERT_IDX],
+					dec_face.nindices[VERT_IDX],
+					uvs);
+			}
+			else if (vflags & FACE_VERT_NORMAL)
+			{
+				HashMap<uint64, int>::Iterator it = vertexLookup.find(MakeVertexKey(vflags, dec_face.vindices[VERT_IDX], dec_face.nindices[VERT_IDX], uvs));
+
+				if (it != vertexLookup.end())
+					index = *it;
+			}
 
 			// add new vertex
 			if (index == -1)
 			{
-				GrVertex newVert;
+				GrVertex newVert = { 0 };
 				vertexTuple_t vertMap;
 
 				vertMap.flags = vflags;
 				vertMap.normalIndex = -1;
 				vertMap.vertexIndex = dec_face.vindices[VERT_IDX];
-				vertMap.uvs = *(ushort*)dec_face.uv[VERT_IDX];
+				vertMap.uvs = uvs;
 
 				// get the vertex
 				SVECTOR* vert = vertex_ref->pVertex(dec_face.vindices[VERT_IDX]);
@@ -307,7 +405,7 @@ void CRenderModel::GenerateBuffers()
 				newVert.cr = newVert.cg = newVert.cb = newVert.ca = 1.0f;
 
 				// add bounding box stuff
-				AddExtentVertex(m_extMin, m_extMax, fVert);
+				AddExtentVertex(mesh.extMin, mesh.extMax, fVert);
 
 				if (smooth && !bad_normals)
 				{
@@ -338,10 +436,17 @@ void CRenderModel::GenerateBuffers()
 				vertices.append(newVert);
 
 				// add vertex and a map
-				verticesMap.append(vertMap);
+				if (linearSearch)
+				{
+					verticesMap.append(vertMap);
 
-				// vertices and verticesMap should be equal
-				assert(verticesMap.size() == vertices.size());
+					// vertices and verticesMap should be equal
+					assert(verticesMap.size() == vertices.size());
+				}
+				else if (vertMap.normalIndex != -1)
+				{
+					vertexLookup.append(MakeVertexKey(vflags, vertMap.vertexIndex, vertMap.normalIndex, uvs), index);
+				}
 			}
 
 			// add index
@@ -383,16 +488,13 @@ void CRenderModel::GenerateBuffers()
 		}
 	}
 
-	Array<int> indices;
+	Array<int>& indices = mesh.indices;
 
 	// merge batches
 	for (usize i = 0; i < batches.size(); i++)
 	{
-		//int startVertex = vertices.numElem();
 		int startIndex = indices.size();
 
-		//vertices.append(batches[i]->vertices);
-
 		for (usize j = 0; j < batches[i]->indices.size(); j++)
 			indices.append(batches[i]->indices[j]);
 
@@ -401,16 +503,83 @@ void CRenderModel::GenerateBuffers()
 		batch.numIndices = batches[i]->indices.size();
 		batch.tpage = batches[i]->tpage;
 
-		m_batches.append(batch);
+		mesh.batches.append(batch);
 
 		delete batches[i];
 	}
+}
+
+template <typename T>
+static T QuantiseValue(float value, float scale, int minValue, int maxValue)
+{
+	const float rounded = floorf(value * scale + 0.5f);
+	return (T)Math::max((float)minValue, Math::min((float)maxValue, rounded));
+}
+
+//-------------------------------------------------------------------
+// Converts float vertices to packed format. Positions come from
+// SVECTOR so they are exact, UVs are exact for texel centers
+//-------------------------------------------------------------------
+void CRenderModel::PackMeshVertices(modelMeshData_t& mesh)
+{
+	if (mesh.format == VERTEX_FORMAT_PACKED)
+		return;
+
+	mesh.packedVertices.resize(mesh.vertices.size());
+
+	for (usize i = 0; i < mesh.vertices.size(); i++)
+	{
+		const GrVertex& src = mesh.vertices[i];
+		GrPackedVertex& dst = mesh.packedVertices[i];
+
+		dst.vx = QuantiseValue<short>(src.vx, ONE_F, -32768, 32767);
+		dst.vy = QuantiseValue<short>(src.vy, ONE_F, -32768, 32767);
+		dst.vz = QuantiseValue<short>(src.vz, ONE_F, -32768, 32767);
+
+		// undo texel center offset
+		dst.tc_u = QuantiseValue<ubyte>(src.tc_u - 0.5f / TEXPAGE_SIZE_Y, TEXPAGE_SIZE_Y, 0, 255);
+		dst.tc_v = QuantiseValue<ubyte>(src.tc_v - 0.5f / TEXPAGE_SIZE_Y, TEXPAGE_SIZE_Y, 0, 255);
+
+		dst.nx = QuantiseValue<signed char>(src.nx, 127.0f, -127, 127);
+		dst.ny = QuantiseValue<signed char>(src.ny, 127.0f, -127, 127);
+		dst.nz = QuantiseValue<signed char>(src.nz, 127.0f, -127, 127);
+		dst.nw = 0;
+
+		dst.cr = QuantiseValue<ubyte>(src.cr, 255.0f, 0, 255);
+		dst.cg = QuantiseValue<ubyte>(src.cg, 255.0f, 0, 255);
+		dst.cb = QuantiseValue<ubyte>(src.cb, 255.0f, 0, 255);
+		dst.ca = QuantiseValue<ubyte>(src.ca, 255.0f, 0, 255);
+	}
+
+	mesh.vertices.clear();
+	mesh.format = VERTEX_FORMAT_PACKED;
+}
+
+void CRenderModel::GenerateBuffers()
+{
+	modelMeshData_t mesh;
+	BuildMeshData(mesh, m_sourceModel);
+
+	if (s_vertexFormat == VERTEX_FORMAT_PACKED)
+		PackMeshVertices(mesh);
+
+	CreateBuffers(mesh);
+}
+
+void CRenderModel::CreateBuffers(const modelMeshData_t& mesh)
+{
+	m_extMin = mesh.extMin;
+	m_extMax = mesh.extMax;
+	m_batches = mesh.batches;
 
 	// if has existing one - regenerate
 	if (m_vao)
 		GR_DestroyVAO(m_vao);
 
-	m_vao = GR_CreateVAO(vertices.size(), indices.size(), (GrVertex*)vertices, (int*)indices, 0);
+	if (mesh.format == VERTEX_FORMAT_PACKED)
+		m_vao = GR_CreatePackedVAO(mesh.packedVertices.size(), mesh.indices.size(), (GrPackedVertex*)mesh.packedVertices, (int*)mesh.indices, 0);
+	else
+		m_vao = GR_CreateVAO(mesh.vertices.size(), mesh.indices.size(), (GrVertex*)mesh.vertices, (int*)mesh.indices, 0);
 
 	if (!m_vao)
 	{
@@ -418,6 +587,356 @@ void CRenderModel::GenerateBuffers()
 	}
 }
 
+void CRenderModel::CreatePooledBuffers(modelMeshData_t& mesh)
+{
+	m_extMin = mesh.extMin;
+	m_extMax = mesh.extMax;
+
+	if (!mesh.GetNumVertices() || !mesh.indices.size())
+		return;
+
+	if (mesh.format != s_modelPool.GetVertexFormat())
+	{
+		MsgError("Model mesh vertex format doesn't match shared buffers!\n");
+		return;
+	}
+
+	if (!s_modelPool.Alloc(m_poolAlloc, mesh.GetNumVertices(), mesh.indices.size()))
+	{
+		MsgError("Cannot allocate model in shared buffers!\n");
+		return;
+	}
+
+	// page buffers are shared so rebase indices and batches
+	for (usize i = 0; i < mesh.indices.size(); i++)
+		mesh.indices[i] += m_poolAlloc.firstVertex;
+
+	for (usize i = 0; i < mesh.batches.size(); i++)
+		mesh.batches[i].startIndex += m_poolAlloc.firstIndex;
+
+	if (mesh.format == VERTEX_FORMAT_PACKED)
+		s_modelPool.Upload(m_poolAlloc, (GrPackedVertex*)mesh.packedVertices, (int*)mesh.indices);
+	else
+		s_modelPool.Upload(m_poolAlloc, (GrVertex*)mesh.vertices, (int*)mesh.indices);
+
+	m_vao = s_modelPool.GetVAO(m_poolAlloc.page);
+	m_batches = mesh.batches;
+	m_pooled = true;
+}
+
+void CRenderModel::FreeModelPool()
+{
+	s_modelPool.FreeAll();
+}
+
+void CRenderModel::PrintModelPoolStats()
+{
+	s_modelPool.PrintStats();
+}
+
+//-------------------------------------------------------------------
+// Parallel mesh preparation
+//-------------------------------------------------------------------
+
+#define MESH_BUILD_MAX_THREADS	16
+
+struct MeshBuildWork_t
+{
+	modelMeshData_t*	meshes;
+	ModelRef_t**		refs;
+	int					count;
+
+	volatile int		nextJob;
+};
+
+static uint MeshBuildThreadFunc(void* param)
+{
+	MeshBuildWork_t* work = (MeshBuildWork_t*)param;
+
+	while (true)
+	{
+		const int idx = Atomic::increment(work->nextJob) - 1;
+
+		if (idx >= work->count)
+			break;
+
+		CRenderModel::BuildMeshData(work->meshes[idx], work->refs[idx]);
+
+		if (s_vertexFormat == VERTEX_FORMAT_PACKED)
+			CRenderModel::PackMeshVertices(work->meshes[idx]);
+	}
+
+	return 0;
+}
+
+void CRenderModel::BuildMeshDataParallel(modelMeshData_t* meshes, ModelRef_t** refs, int count, int numThreads /*= 0*/)
+{
+	MeshBuildWork_t work;
+	work.meshes = meshes;
+	work.refs = refs;
+	work.count = count;
+	work.nextJob = 0;
+
+	if (numThreads <= 0)
+		numThreads = System::getProcessorCount();
+
+	numThreads = Math::max(1, Math::min(numThreads, Math::min(MESH_BUILD_MAX_THREADS, count)));
+
+	if (numThreads > 1)
+	{
+		Thread threads[MESH_BUILD_MAX_THREADS];
+
+		for (int i = 0; i < numThreads; i++)
+			threads[i].start(MeshBuildThreadFunc, &work);
+
+		for (int i = 0; i < numThreads; i++)
+			threads[i].join();
+	}
+	else
+	{
+		MeshBuildThreadFunc(&work);
+	}
+}
+
+// models waiting for mesh preparation
+static Array<CRenderModel*> s_pendingModels;
+
+void CRenderModel::UploadPendingModels()
+{
+	const int count = s_pendingModels.size();
+
+	if (!count)
+		return;
+
+	modelMeshData_t* meshes = new modelMeshData_t[count];
+	ModelRef_t** refs = new ModelRef_t*[count];
+
+	for (int i = 0; i < count; i++)
+		refs[i] = s_pendingModels[i]->m_sourceModel;
+
+	BuildMeshDataParallel(meshes, refs, count);
+
+	// only buffer upload is done on render thread
+	for (int i = 0; i < count; i++)
+		s_pendingModels[i]->CreatePooledBuffers(meshes[i]);
+
+	s_pendingModels.clear();
+
+	delete[] meshes;
+	delete[] refs;
+}
+
+//-------------------------------------------------------------------
+// Compares hash and linear vertex welding on all level models
+//-------------------------------------------------------------------
+
+#define MODEL_BENCH_ITERATIONS	10
+
+extern String g_levname;
+
+static bool CompareMeshData(const modelMeshData_t& a, const modelMeshData_t& b)
+{
+	if (a.vertices.size() != b.vertices.size() || a.indices.size() != b.indices.size() || a.batches.size() != b.batches.size())
+		return false;
+
+	if (a.vertices.size() && memcmp((GrVertex*)a.vertices, (GrVertex*)b.vertices, a.vertices.size() * sizeof(GrVertex)))
+		return false;
+
+	if (a.indices.size() && memcmp((int*)a.indices, (int*)b.indices, a.indices.size() * sizeof(int)))
+		return false;
+
+	if (a.batches.size() && memcmp((modelBatch_t*)a.batches, (modelBatch_t*)b.batches, a.batches.size() * sizeof(modelBatch_t)))
+		return false;
+
+	return true;
+}
+
+void BenchmarkModelBuffers()
+{
+	// all area data models are needed
+	FILE* fp = fopen(g_levname, "rb");
+	if (fp)
+	{
+		CFileStream stream(fp);
+
+		SPOOL_CONTEXT spoolContext;
+		spoolContext.dataStream = &stream;
+		spoolContext.lumpInfo = &g_levInfo;
+
+		const int totalRegions = g_levMap->GetRegionsAcross() * g_levMap->GetRegionsDown();
+
+		for (int i = 0; i < totalRegions; i++)
+			g_levMap->SpoolRegion(spoolContext, i);
+
+		fclose(fp);
+	}
+
+	Array<ModelRef_t*> models;
+	Array<int> modelVerts;
+	int numVerts = 0;
+	int numIndices = 0;
+	int numMismatches = 0;
+
+	for (int i = 0; i < MAX_MODELS; i++)
+	{
+		ModelRef_t* ref = g_levModels.GetModelByIndex(i);
+
+		if (ref && ref->model)
+			models.append(ref);
+	}
+
+	MsgInfo("Benchmarking render buffer generation on %d models\n", (int)models.size());
+
+	// check that hash lookup makes the same meshes, also decodes polygons before timing
+	for (usize i = 0; i < models.size(); i++)
+	{
+		modelMeshData_t reference, result;
+		CRenderModel::BuildMeshData(reference, models[i], true);
+		CRenderModel::BuildMeshData(result, models[i], false);
+
+		if (!CompareMeshData(reference, result))
+		{
+			MsgWarning("  model %d mesh differs\n", models[i]->index);
+			numMismatches++;
+		}
+
+		numVerts += result.vertices.size();
+		numIndices += result.indices.size();
+
+		modelVerts.append(result.vertices.size());
+	}
+
+	Msg("  %d vertices, %d indices\n", numVerts, numIndices);
+
+	// packed vertex format size and precision
+	{
+		float maxPositionError = 0.0f;
+		float maxTexcoordError = 0.0f;
+		float maxNormalError = 0.0f;
+
+		for (usize i = 0; i < models.size(); i++)
+		{
+			modelMeshData_t mesh;
+			CRenderModel::BuildMeshData(mesh, models[i]);
+
+			Array<GrVertex> source = mesh.vertices;
+			CRenderModel::PackMeshVertices(mesh);
+
+			for (usize j = 0; j < source.size(); j++)
+			{
+				const GrVertex& src = source[j];
+				const GrPackedVertex& dst = mesh.packedVertices[j];
+
+				// measured in fixed point units, texels and normal length units
+				maxPositionError = Math::max(maxPositionError, fabsf(dst.vx - src.vx * ONE_F));
+				maxPositionError = Math::max(maxPositionError, fabsf(dst.vy - src.vy * ONE_F));
+				maxPositionError = Math::max(maxPositionError, fabsf(dst.vz - src.vz * ONE_F));
+
+				maxTexcoordError = Math::max(maxTexcoordError, fabsf(dst.tc_u + 0.5f - src.tc_u * TEXPAGE_SIZE_Y));
+				maxTexcoordError = Math::max(maxTexcoordError, fabsf(dst.tc_v + 0.5f - src.tc_v * TEXPAGE_SIZE_Y));
+
+				maxNormalError = Math::max(maxNormalError, length(Vector3D(dst.nx, dst.ny, dst.nz) / 127.0f - Vector3D(src.nx, src.ny, src.nz)));
+			}
+		}
+
+		const int floatBytes = numVerts * sizeof(GrVertex);
+		const int packedBytes = numVerts * sizeof(GrPackedVertex);
+
+		Msg("  packed  : vertices %.2f MB -> %.2f MB (%d -> %d bytes per vertex)\n",
+			floatBytes / (1024.0f * 1024.0f), packedBytes / (1024.0f * 1024.0f), (int)sizeof(GrVertex), (int)sizeof(GrPackedVertex));
+		Msg("            max error: position %.3f, UV %.3f texels, normal %.4f\n", maxPositionError, maxTexcoordError, maxNormalError);
+	}
+
+	for (int linear = 1; linear >= 0; linear--)
+	{
+		modelMeshData_t mesh;
+		const int64 startTime = Time::microTicks();
+
+		for (int iter = 0; iter < MODEL_BENCH_ITERATIONS; iter++)
+		{
+			for (usize i = 0; i < models.size(); i++)
+				CRenderModel::BuildMeshData(mesh, models[i], linear != 0);
+		}
+
+		const int64 time = Math::max(Time::microTicks() - startTime, (int64)1);
+		Msg("  %-8s: %.2f ms per level\n", linear ? "linear" : "hash", time / 1000.0 / MODEL_BENCH_ITERATIONS);
+	}
+
+	// the way viewer prepares spooled models
+	{
+		const int numThreads = Math::min((int)System::getProcessorCount(), MESH_BUILD_MAX_THREADS);
+		modelMeshData_t* meshes = new modelMeshData_t[models.size()];
+
+		const int64 startTime = Time::microTicks();
+
+		for (int iter = 0; iter < MODEL_BENCH_ITERATIONS; iter++)
+			CRenderModel::BuildMeshDataParallel(meshes, (ModelRef_t**)models, models.size(), numThreads);
+
+		const int64 time = Math::max(Time::microTicks() - startTime, (int64)1);
+		Msg("  %-8s: %.2f ms per level (%d threads)\n", "parallel", time / 1000.0 / MODEL_BENCH_ITERATIONS, numThreads);
+
+		delete[] meshes;
+	}
+
+	// shared buffer allocator with spool-like eviction order
+	{
+		CRangeAllocator allocator;
+		allocator.Init(numVerts + numVerts / 8);
+
+		Array<int> offsets;
+		offsets.resize(modelVerts.size());
+
+		int numFailed = 0;
+		bool valid = true;
+		uint seed = 1;
+
+		for (usize i = 0; i < modelVerts.size(); i++)
+			offsets[i] = allocator.Alloc(modelVerts[i]);
+
+		for (int round = 0; round < MODEL_BENCH_ITERATIONS; round++)
+		{
+			Array<int> evicted;
+
+			for (usize i = 0; i < modelVerts.size(); i++)
+			{
+				seed = seed * 1103515245 + 12345;
+
+				if (offsets[i] == -1 || (seed >> 16) & 1)
+					continue;
+
+				allocator.Free(offsets[i], modelVerts[i]);
+				offsets[i] = -1;
+				evicted.append(i);
+			}
+
+			valid = valid && allocator.Validate();
+
+			// spooled back in reverse order
+			for (int i = evicted.size() - 1; i >= 0; i--)
+			{
+				offsets[evicted[i]] = allocator.Alloc(modelVerts[evicted[i]]);
+
+				if (offsets[evicted[i]] == -1)
+					numFailed++;
+			}
+
+			valid = valid && allocator.Validate();
+		}
+
+		Msg("  pool    : %d/%d vertices used, %d free blocks, largest %d, %d failed allocs\n",
+			allocator.GetCapacity() - allocator.GetFreeSize(), allocator.GetCapacity(),
+			allocator.GetNumFreeBlocks(), allocator.GetLargestFreeBlock(), numFailed);
+
+		if (!valid)
+			MsgError("Model pool allocator free list is broken!\n");
+	}
+
+	if (numMismatches)
+		MsgError("%d models have different meshes!\n", numMismatches);
+	else
+		MsgAccept("All meshes are identical\n");
+}
+
 void CRenderModel::SetDrawBuffer()
 {
 	GR_SetVAO(m_vao);
@@ -497,7 +1016,9 @@ struct ModelShaderInfo
 	int			lightColorConstantId{ -1 };
 
 	int			lightDirConstantId{ -1 };
-} g_modelShader;
+
+	int			instancesConstantId{ -1 };
+} g_modelShader, g_modelInstancedShader;
 
 struct WorldRenderProperties
 {
@@ -508,15 +1029,45 @@ struct WorldRenderProperties
 } g_worldRenderProperties;
 
 // compiles model shader
-void CRenderModel::InitModelShader()
+void CRenderModel::InitModelShader(GR_VertexFormat format /*= VERTEX_FORMAT_PACKED*/)
 {
+	const bool packed = (format == VERTEX_FORMAT_PACKED);
+
+	s_vertexFormat = format;
+	s_modelPool.SetVertexFormat(format);
+
 	// create shader
-	g_modelShader.shader = GR_CompileShader(model_shader);
+	g_modelShader.shader = GR_CompileShader(packed ? model_packed_shader : model_shader);
 
 	g_modelShader.ambientColorConstantId = GR_GetShaderConstantIndex(g_modelShader.shader, "u_ambientColor");
 	g_modelShader.lightColorConstantId = GR_GetShaderConstantIndex(g_modelShader.shader, "u_lightColor");
 
 	g_modelShader.lightDirConstantId = GR_GetShaderConstantIndex(g_modelShader.shader, "u_lightDir");
+
+	if (!IsInstancingSupported())
+		return;
+
+	g_modelInstancedShader.shader = GR_CompileShader(packed ? model_packed_instanced_shader : model_instanced_shader);
+
+	g_modelInstancedShader.ambientColorConstantId = GR_GetShaderConstantIndex(g_modelInstancedShader.shader, "u_ambientColor");
+	g_modelInstancedShader.lightColorConstantId = GR_GetShaderConstantIndex(g_modelInstancedShader.shader, "u_lightColor");
+
+	g_modelInstancedShader.lightDirConstantId = GR_GetShaderConstantIndex(g_modelInstancedShader.shader, "u_lightDir");
+	g_modelInstancedShader.instancesConstantId = GR_GetShaderConstantIndex(g_modelInstancedShader.shader, "u_instances");
+}
+
+GR_VertexFormat CRenderModel::GetVertexFormat()
+{
+	return s_vertexFormat;
+}
+
+bool CRenderModel::IsInstancingSupported()
+{
+#if defined(ES2_SHADERS)
+	return false;
+#else
+	return true;
+#endif
 }
 
 // prepares shader for rendering
@@ -530,6 +1081,22 @@ void CRenderModel::SetupModelShader()
 	GR_SetShaderConstantVector4D(g_modelShader.lightColorConstantId, g_worldRenderProperties.lightColor);
 }
 
+// same as SetupModelShader but for instanced drawing
+void CRenderModel::SetupInstancedModelShader()
+{
+	GR_SetShader(g_modelInstancedShader.shader);
+	GR_SetShaderConstantVector3D(g_modelInstancedShader.lightDirConstantId, g_worldRenderProperties.lightDir);
+
+	GR_SetShaderConstantVector4D(g_modelInstancedShader.ambientColorConstantId, g_worldRenderProperties.ambientColor);
+	GR_SetShaderConstantVector4D(g_modelInstancedShader.lightColorConstantId, g_worldRenderProperties.lightColor);
+}
+
+// sets up to MODEL_MAX_INSTANCES transforms for next instanced draw
+void CRenderModel::SetInstanceTransforms(const Vector4D* transforms, int count)
+{
+	GR_SetShaderConstantvi(g_modelInstancedShader.instancesConstantId, CONSTANT_VECTOR4D, count, (float*)transforms);
+}
+
 extern CBaseLevelMap* g_levMap;
 
 // sets up lighting properties
@@ -549,17 +1116,17 @@ void CRenderModel::SetupLightingProperties(float ambientScale /*= 1.0f*/, float
 // callbacks for model lump loader
 
 // called when model loaded in CDriverLevelModels
+// buffers are created later in UploadPendingModels
 void CRenderModel::OnModelLoaded(ModelRef_t* ref)
 {
 	if (!ref->model)
 		return;
 
 	CRenderModel* renderModel = new CRenderModel();
+	renderModel->m_sourceModel = ref;
 
-	if (renderModel->Initialize(ref))
-		ref->userData = renderModel;
-	else
-		delete renderModel;
+	ref->userData = renderModel;
+	s_pendingModels.append(renderModel);
 }
 
 // called when model freed in CDriverLevelModels
@@ -567,8 +1134,20 @@ void CRenderModel::OnModelFreed(ModelRef_t* ref)
 {
 	CRenderModel* model = (CRenderModel*)ref->userData;
 
-	if (model)
-		model->Destroy();
+	if (!model)
+		return;
+
+	for (usize i = 0; i < s_pendingModels.size(); i++)
+	{
+		if (s_pendingModels[i] == model)
+		{
+			s_pendingModels.remove(i);
+			break;
+		}
+	}
 
+	model->Destroy();
 	delete model;
+
+	ref->userData = nullptr;
 }
\ No newline at end of file
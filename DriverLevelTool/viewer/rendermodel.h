@@ -2,8 +2,13 @@
 #define DRAWMODEL_H
 
 #include "math/Vector.h"
+#include "gl_renderer.h"
+#include "modelpool.h"
+
+#include <nstd/Array.hpp>
 
 #define RENDER_SCALING			(1.0f / ONE_F)
+#define MODEL_MAX_INSTANCES		192		// per instanced draw, limited by vertex shader uniforms
 
 struct ModelRef_t;
 struct GrVAO;
@@ -15,6 +20,22 @@ struct modelBatch_t
 	int numIndices;
 };
 
+// CPU side mesh data of render model
+struct modelMeshData_t
+{
+	Array<GrVertex>			vertices;
+	Array<GrPackedVertex>	packedVertices;		// replaces vertices after PackMeshVertices
+	Array<int>				indices;
+	Array<modelBatch_t>		batches;
+
+	Vector3D				extMin;
+	Vector3D				extMax;
+
+	GR_VertexFormat			format{ VERTEX_FORMAT_FLOAT };
+
+	int						GetNumVertices() const { return format == VERTEX_FORMAT_PACKED ? packedVertices.size() : vertices.size(); }
+};
+
 class CRenderModel
 {
 public:
@@ -30,10 +51,40 @@ public:
 
 	void				GetExtents(Vector3D& outMin, Vector3D& outMax) const;
 
+	GrVAO*				GetVAO() const						{ return m_vao; }
+	int					GetNumBatches() const				{ return m_batches.size(); }
+	const modelBatch_t&	GetBatch(int index) const			{ return m_batches[index]; }
+
 	static void			DrawModelCollisionBox(ModelRef_t* ref, const VECTOR_NOPAD& position, int rotation);
 	static void			SetupModelShader();
 	static void			SetupLightingProperties(float ambientScale = 1.0f, float lightScale = 1.0f);
-	static void			InitModelShader();
+
+	// vertex format of all render models is selected with shaders
+	static void			InitModelShader(GR_VertexFormat format = VERTEX_FORMAT_PACKED);
+	static GR_VertexFormat GetVertexFormat();
+
+	// instanced drawing, transform is position and Y rotation
+	// not available with ES2 shaders which have no gl_InstanceID
+	static bool			IsInstancingSupported();
+	static void			SetupInstancedModelShader();
+	static void			SetInstanceTransforms(const Vector4D* transforms, int count);
+
+	// builds welded vertices and per-tpage batches
+	static void			BuildMeshData(modelMeshData_t& mesh, ModelRef_t* ref, bool linearSearch = false);
+
+	// quantises float vertices to GrPackedVertex
+	static void			PackMeshVertices(modelMeshData_t& mesh);
+
+	// builds meshes of many models on worker threads, 0 threads means all CPU cores
+	static void			BuildMeshDataParallel(modelMeshData_t* meshes, ModelRef_t** refs, int count, int numThreads = 0);
+
+	// prepares meshes of models loaded since last call and puts them to shared buffers
+	// must be called from render thread
+	static void			UploadPendingModels();
+
+	// destroys shared buffers of world models
+	static void			FreeModelPool();
+	static void			PrintModelPoolStats();
 
 	// callbacks for creating/destroying renderer objects
 	static void			OnModelLoaded(ModelRef_t* ref);
@@ -41,12 +92,16 @@ public:
 	
 protected:
 	void				GenerateBuffers();
+	void				CreateBuffers(const modelMeshData_t& mesh);
+	void				CreatePooledBuffers(modelMeshData_t& mesh);
 
 	Vector3D			m_extMin;
 	Vector3D			m_extMax;
 
 	ModelRef_t*			m_sourceModel { nullptr };
 	GrVAO*				m_vao { nullptr };
+	modelPoolAlloc_t	m_poolAlloc;			// when m_vao is pool page
+	bool				m_pooled { false };
 	Array<modelBatch_t>	m_batches;
 	int					m_numVerts;
 };
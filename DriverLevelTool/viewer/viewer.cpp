@@ -14,10 +14,13 @@
 #include "driver_level.h"
 #include "gl_renderer.h"
 #include "renderlevel.h"
+#include "renderlist.h"
+#include "modellod.h"
 #include "rendermodel.h"
 
 #include "core/cmdlib.h"
 #include "core/VirtualStream.h"
+#include "util/hash.h"
 
 #include "math/Volume.h"
 
@@ -47,6 +50,7 @@ bool g_displayAllCellLevels = true;
 bool g_displayRoads = false;
 bool g_displayRoadConnections = false;
 bool g_noLod = false;
+bool g_instancedDrawing = true;
 
 int g_cellsDrawDistance = 441;
 
@@ -63,7 +67,7 @@ bool g_holdShift = false;
 
 //-----------------------------------------------------------------
 
-TextureID g_hwTexturePages[128][16];
+TextureID g_hwTexturePages[128][17];	// default and 16 extra palettes
 extern TextureID g_whiteTexture;
 
 // Creates hardware texture
@@ -80,22 +84,7 @@ void InitHWTexturePage(CTexturePage* tpage)
 	memset(color_data, 0, imgSize);
 
 	// Dump whole TPAGE indexes
-	for (int y = 0; y < 256; y++)
-	{
-		for (int x = 0; x < 256; x++)
-		{
-			ubyte clindex = bitmap.data[y * 128 + (x >> 1)];
-
-			if (0 != (x & 1))
-				clindex >>= 4;
-
-			clindex &= 0xF;
-
-			int ypos = (TEXPAGE_SIZE_Y - y - 1) * TEXPAGE_SIZE_Y;
-
-			color_data[ypos + x] = clindex * 32;
-		}
-	}
+	tpage->ConvertIndexesToRGBA(color_data);
 
 	int numDetails = tpage->GetDetailCount();
 
@@ -108,6 +97,18 @@ void InitHWTexturePage(CTexturePage* tpage)
 	
 	g_hwTexturePages[tpageId][0] = GR_CreateRGBATexture(TEXPAGE_SIZE_Y, TEXPAGE_SIZE_Y, (ubyte*)color_data);
 
+	// palette pages are drawn over each other
+	// pages which end up with the same details state share the texture
+	uint64* detailHashes = new uint64[numDetails];
+	uint64 pageHashes[17];
+
+	pageHashes[0] = HASH64_INIT;
+	for (int i = 0; i < numDetails; i++)
+	{
+		detailHashes[i] = tpage->GetDetailHash(i);
+		pageHashes[0] = Hash64(&detailHashes[i], sizeof(uint64), pageHashes[0]);
+	}
+
 	// also load different palettes
 	int numPalettes = 0;
 	for (int pal = 0; pal < 16; pal++)
@@ -121,17 +122,38 @@ void InitHWTexturePage(CTexturePage* tpage)
 			if (detail->extraCLUTs[pal])
 			{
 				tpage->ConvertIndexedTextureToRGBA(color_data, j, detail->extraCLUTs[pal], false, false);
+				detailHashes[j] = tpage->GetDetailHash(j, detail->extraCLUTs[pal]);
 				anyMatched = true;
 			}
 		}
 
 		if (anyMatched)
 		{
-			g_hwTexturePages[tpageId][numPalettes + 1] = GR_CreateRGBATexture(TEXPAGE_SIZE_Y, TEXPAGE_SIZE_Y, (ubyte*)color_data);
+			uint64 pageHash = HASH64_INIT;
+			for (int j = 0; j < numDetails; j++)
+				pageHash = Hash64(&detailHashes[j], sizeof(uint64), pageHash);
+
 			numPalettes++;
+			pageHashes[numPalettes] = pageHash;
+
+			TextureID texture = g_whiteTexture;
+			for (int j = 0; j < numPalettes; j++)
+			{
+				if (pageHashes[j] == pageHash)
+				{
+					texture = g_hwTexturePages[tpageId][j];
+					break;
+				}
+			}
+
+			if (texture == g_whiteTexture)
+				texture = GR_CreateRGBATexture(TEXPAGE_SIZE_Y, TEXPAGE_SIZE_Y, (ubyte*)color_data);
+
+			g_hwTexturePages[tpageId][numPalettes] = texture;
 		}
 	}
-	
+
+	delete[] detailHashes;
 	
 	// no longer need in RGBA data
 	free(color_data);
@@ -140,20 +162,33 @@ void InitHWTexturePage(CTexturePage* tpage)
 void FreeHWTexturePage(CTexturePage* tpage)
 {
 	int tpageId = tpage->GetId();
-	GR_DestroyTexture(g_hwTexturePages[tpageId][0]);
+	TextureID* textures = g_hwTexturePages[tpageId];
 
-	for (int pal = 0; pal < 16; pal++)
+	for (int pal = 16; pal > 0; pal--)
 	{
-		if(g_hwTexturePages[tpageId][pal + 1] != g_whiteTexture)
-			GR_DestroyTexture(g_hwTexturePages[tpageId][pal + 1]);
+		if (textures[pal] == g_whiteTexture)
+			continue;
+
+		// shared with earlier palette
+		bool shared = false;
+		for (int j = 0; j < pal; j++)
+			shared = shared || textures[j] == textures[pal];
+
+		if(!shared)
+			GR_DestroyTexture(textures[pal]);
+
+		textures[pal] = g_whiteTexture;
 	}
+
+	GR_DestroyTexture(textures[0]);
+	textures[0] = g_whiteTexture;
 }
 
 // returns hardware texture
 TextureID GetHWTexture(int tpage, int pal)
 {
 	if (tpage < 0 || tpage >= 128 ||
-		pal < 0 || pal >= 32)
+		pal < 0 || pal >= 17)
 		return g_whiteTexture;
 
 	return g_hwTexturePages[tpage][pal];
@@ -167,7 +202,7 @@ void InitHWTextures()
 	
 	for (int i = 0; i < 128; i++)
 	{
-		for (int j = 0; j < 32; j++)
+		for (int j = 0; j < 17; j++)
 			g_hwTexturePages[i][j] = g_whiteTexture;
 	}
 }
@@ -182,6 +217,8 @@ extern OUT_CITYLUMP_INFO		g_levInfo;
 extern CDriverLevelTextures		g_levTextures;
 extern CDriverLevelModels		g_levModels;
 extern CBaseLevelMap*			g_levMap;
+extern CModelLodSelector		g_modelLods;
+extern bool						g_float_model_vertices;
 
 FILE* g_levFile = nullptr;
 
@@ -225,6 +262,9 @@ void FreeLevelData()
 	g_levTextures.FreeAll();
 	g_levModels.FreeAll();
 
+	CRenderModel::FreeModelPool();
+	g_modelLods.Reset();
+
 	delete g_levMap;
 
 	fclose(g_levFile);
@@ -264,6 +304,9 @@ void RenderModelView()
 	Vector3D forward, right;
 	AngleVectors(g_cameraAngles, &forward, &right);
 
+	// models might be loaded but not yet uploaded
+	CRenderModel::UploadPendingModels();
+
 	// setup orbital camera
 	CRenderModel::SetupModelShader();
 	SetupCameraViewAndMatrices(-forward * g_cameraDistance, g_cameraAngles, frustumVolume);
@@ -332,6 +375,9 @@ void UpdateCarRenderModel()
 {
 	CarModelData_t* carModel = g_levModels.GetCarModel(g_currentCarResidentModel);
 
+	// model is about to change
+	FreeModelPolys(&g_carModelRef);
+
 	if (g_currentCarModel == 0)
 	{
 		g_carModelRef.model = carModel->cleanmodel;
@@ -429,46 +475,13 @@ void UpdateOverlayMapPreview()
 	extern int g_overlaymap_width;
 
 	GR_DestroyTexture(g_overheadMapTexture);
+	g_overheadMapTexture = 0;
 
-	const int numValid = g_levTextures.GetOverlayMapSegmentCount();
-
-	const int overmapWidth = g_overlaymap_width * 32;
-	const int overmapHeight = (numValid / g_overlaymap_width) * 32;
-
-	int x, y, xx, yy;
-	int wide, tall;
-
-	wide = overmapWidth / 32;
-	tall = overmapHeight / 32;
-
-	int numTilesProcessed = 0;
+	int overmapWidth, overmapHeight;
+	TVec4D<ubyte>* rgba = g_levTextures.GetOverlayMapRGBA(g_overlaymap_width, overmapWidth, overmapHeight);
 
-	TVec4D<ubyte> tempSegment[32 * 32];
-	TVec4D<ubyte>* rgba = new TVec4D<ubyte>[overmapWidth * overmapHeight];
-
-	for (x = 0; x < wide; x++)
-	{
-		for (y = 0; y < tall; y++)
-		{
-			int idx = x + y * wide;
-
-			g_levTextures.GetOverlayMapSegmentRGBA(tempSegment, x + y * wide);
-
-			numTilesProcessed++;
-
-			// place segment
-			for (yy = 0; yy < 32; yy++)
-			{
-				for (xx = 0; xx < 32; xx++)
-				{
-					int px = x * 32 + xx;
-					int py = (tall - 1 - y) * 32 + (31 - yy);
-
-					rgba[px + py * overmapWidth] = tempSegment[yy * 32 + xx];
-				}
-			}
-		}
-	}
+	if (!rgba)
+		return;
 
 	g_overheadMapTexture = GR_CreateRGBATexture(overmapWidth, overmapHeight, (ubyte*)rgba);
 
@@ -633,21 +646,10 @@ void DisplayExportUI()
 				ImGui::EndChild();
 			}
 
-			auto countTextureRefs = [](MODEL* model, int id) {
-				if (!model)
-					return;
-
-				int face_ofs = 0;
-				dpoly_t dec_face;
-
-				// go through all polygons
-				for (int i = 0; i < model->num_polys; i++)
+			auto countPolyTextureRefs = [](const dpoly_t* polys, int numPolys, int id) {
+				for (int i = 0; i < numPolys; i++)
 				{
-					const char* facedata = model->pPolyAt(face_ofs);
-
-					dpoly_t dec_face;
-					const int poly_size = decode_poly(facedata, &dec_face);
-
+					const dpoly_t& dec_face = polys[i];
 					const uint key = (uint)dec_face.page | ((uint)dec_face.detail << 16);
 
 					auto it = s_modelUsedPageDetails.find(key);
@@ -657,18 +659,35 @@ void DisplayExportUI()
 
 					if(dec_face.page == texturePageIdx)
 						s_selectedTpageUsedModels.insert(id, {});
-
-					face_ofs += poly_size;
 				}
 			};
 
+			auto countTextureRefs = [countPolyTextureRefs](ModelRef_t* ref, int id) {
+				int numPolys;
+				const dpoly_t* polys = GetModelPolys(ref, numPolys);
+
+				countPolyTextureRefs(polys, numPolys, id);
+			};
+
+			// car models are not in ModelRef_t so they are decoded here
+			auto countCarTextureRefs = [countPolyTextureRefs](MODEL* model, int size, int id) {
+				if (!model)
+					return;
+
+				Array<dpoly_t> polys;
+				polys.resize(model->num_polys);
+
+				const int numPolys = decode_model_polys(model, size, (dpoly_t*)polys, -1, id);
+				countPolyTextureRefs((dpoly_t*)polys, numPolys, id);
+			};
+
 			if (s_modelUsedPageDetails.isEmpty())
 			{
 				if (g_viewerMode >= 1)
 				{
 					ModelRef_t* ref = (g_viewerMode == 2) ? &g_carModelRef : g_levModels.GetModelByIndex(g_currentModel);
 					if(ref)
-						countTextureRefs(ref->model, 0);
+						countTextureRefs(ref, 0);
 				}
 				else
 				{
@@ -676,14 +695,14 @@ void DisplayExportUI()
 					{
 						ModelRef_t* ref = g_levModels.GetModelByIndex(i);
 						if (ref)
-							countTextureRefs(ref->model, i);
+							countTextureRefs(ref, i);
 					}
 
 					for (int i = 0; i < MAX_CAR_MODELS; i++)
 					{
 						CarModelData_t* cmData = g_levModels.GetCarModel(i);
-						countTextureRefs(cmData->cleanmodel, i | 0x2000);
-						countTextureRefs(cmData->lowmodel, i | 0x1000);
+						countCarTextureRefs(cmData->cleanmodel, cmData->cleanSize, i | 0x2000);
+						countCarTextureRefs(cmData->lowmodel, cmData->lowSize, i | 0x1000);
 						// we don't count damage models because vertices only used
 					}
 				}
@@ -950,6 +969,7 @@ void DisplayAreaDataViewer()
 extern int g_drawnCells;
 extern int g_drawnModels;
 extern int g_drawnPolygons;
+extern CRenderList g_levelRenderList;
 
 //-------------------------------------------------------------
 // Displays Main menu bar, stats and child windows
@@ -1025,6 +1045,20 @@ void DisplayUI(float deltaTime)
 			if (ImGui::MenuItem("Disable LODs", nullptr, g_noLod))
 				g_noLod ^= 1;
 
+			if (ImGui::BeginMenu("LOD distances"))
+			{
+				modelLodSettings_t& lodSettings = g_modelLods.GetSettings();
+
+				ImGui::SliderFloat("High detail", &lodSettings.highDistance, 0.0f, 10.0f);
+				ImGui::SliderFloat("Low detail", &lodSettings.lowDistance, 0.0f, 40.0f);
+				ImGui::SliderFloat("Hysteresis", &lodSettings.hysteresis, 0.0f, 2.0f);
+
+				ImGui::EndMenu();
+			}
+
+			if (ImGui::MenuItem("Instanced drawing", nullptr, g_instancedDrawing, CRenderModel::IsInstancingSupported()))
+				g_instancedDrawing ^= 1;
+
 			ImGui::Separator();
 
 			if (ImGui::MenuItem("Display backfaces as wireframe", nullptr, g_displayWireframeBackfaces))
@@ -1072,7 +1106,7 @@ void DisplayUI(float deltaTime)
 
 		if(g_viewerMode == 0)
 		{
-			ImGui::SetWindowSize(ImVec2(400, 120));
+			ImGui::SetWindowSize(ImVec2(400, 160));
 			
 			ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.25f, 1.0f), "Position: X: %d Y: %d Z: %d",
 				int(g_cameraPosition.x * ONE_F), int(g_cameraPosition.y * ONE_F), int(g_cameraPosition.z * ONE_F));
@@ -1081,6 +1115,17 @@ void DisplayUI(float deltaTime)
 			ImGui::TextColored(ImVec4(1.0f, 1.0f, 1.0f, 0.5f), "Drawn cells: %d", g_drawnCells);
 			ImGui::TextColored(ImVec4(1.0f, 1.0f, 1.0f, 0.5f), "Drawn models: %d", g_drawnModels);
 			ImGui::TextColored(ImVec4(1.0f, 1.0f, 1.0f, 0.5f), "Drawn polygons: %d", g_drawnPolygons);
+
+			const modelLodStats_t& lodStats = g_modelLods.GetStats();
+			ImGui::TextColored(ImVec4(1.0f, 1.0f, 1.0f, 0.5f), "LODs: high %d, normal %d, low %d, switched %d",
+				lodStats.numLods[MODEL_LOD_HIGH], lodStats.numLods[MODEL_LOD_NORMAL], lodStats.numLods[MODEL_LOD_LOW], lodStats.numSwitches);
+
+			if (g_instancedDrawing)
+			{
+				const renderListStats_t& listStats = g_levelRenderList.GetStats();
+				ImGui::TextColored(ImVec4(1.0f, 1.0f, 1.0f, 0.5f), "Buckets: %d, draw calls: %d, texture changes: %d",
+					listStats.numBuckets, listStats.numDrawCalls, listStats.numTextureChanges);
+			}
 		}
 		else if (g_viewerMode >= 1 )
 		{
@@ -1520,7 +1565,8 @@ int ViewerMain()
 	ImGui_ImplSDL2_InitForOpenGL(g_window, nullptr);
 	ImGui_ImplOpenGL3_Init();
 
-	CRenderModel::InitModelShader();
+	CRenderModel::InitModelShader(g_float_model_vertices ? VERTEX_FORMAT_FLOAT : VERTEX_FORMAT_PACKED);
+	g_instancedDrawing = g_instancedDrawing && CRenderModel::IsInstancingSupported();
 
 	DebugOverlay_Init();
 	InitHWTextures();
@@ -1551,4 +1597,138 @@ int ViewerMain()
 	GR_Shutdown();
 
 	return 0;
-}
\ No newline at end of file
+}
+
+//-------------------------------------------------------------
+// Level viewer benchmark
+//-------------------------------------------------------------
+
+const float BENCHMARK_CAMERA_HEIGHT = 2.0f;
+const float BENCHMARK_CAMERA_PITCH = 25.0f;
+const float BENCHMARK_PATH_SCALE = 0.6f;		// of map half size
+
+extern int g_culledModels;
+extern int64 g_spoolTime;
+extern int64 g_meshUploadTime;
+
+// camera flies figure eight over the level and looks along the path
+static void SetBenchmarkCamera(int frame, int numFrames)
+{
+	const OUT_CELL_FILE_HEADER& mapInfo = g_levMap->GetMapInfo();
+
+	const float pathWidth = mapInfo.cells_across * mapInfo.cell_size * 0.5f / ONE_F * BENCHMARK_PATH_SCALE;
+	const float pathDepth = mapInfo.cells_down * mapInfo.cell_size * 0.5f / ONE_F * BENCHMARK_PATH_SCALE;
+
+	const float t = (float)frame / (float)numFrames * PI_F * 2.0f;
+
+	const float dx = cosf(t) * pathWidth;
+	const float dz = cosf(t * 2.0f) * 2.0f * pathDepth;
+
+	g_cameraPosition = Vector3D(sinf(t) * pathWidth, BENCHMARK_CAMERA_HEIGHT, sinf(t * 2.0f) * pathDepth);
+	g_cameraAngles = Vector3D(BENCHMARK_CAMERA_PITCH, RAD2DEG(atan2f(dx, dz)), 0.0f);
+}
+
+int ViewerBenchmark(int numFrames, bool nullRenderer)
+{
+	if (!GR_Init("OpenDriver2 Level viewer benchmark", 1280, 720, 0, nullRenderer ? GR_BACKEND_NULL : GR_BACKEND_GL))
+	{
+		MsgError("Failed to init graphics!\n");
+		return -1;
+	}
+
+	CRenderModel::InitModelShader(g_float_model_vertices ? VERTEX_FORMAT_FLOAT : VERTEX_FORMAT_PACKED);
+	g_instancedDrawing = g_instancedDrawing && CRenderModel::IsInstancingSupported();
+
+	DebugOverlay_Init();
+	InitHWTextures();
+
+	if (!LoadLevelFile())
+	{
+		GR_Shutdown();
+		return -1;
+	}
+
+	MsgInfo("Benchmarking level viewer, %d frames...\n", numFrames);
+
+	int64 totalFrameTime = 0;
+	int64 maxFrameTime = 0;
+	int64 totalSpoolTime = 0;
+	int64 totalUploadTime = 0;
+
+	int64 totalDrawn = 0;
+	int64 totalCulled = 0;
+	int64 totalDrawCalls = 0;
+	int64 totalStateChanges = 0;
+	int64 totalUploadedBytes = 0;
+
+	int64 totalLods[MODEL_LOD_COUNT] = { 0 };
+	int64 totalLodSwitches = 0;
+
+	for (int i = 0; i < numFrames; i++)
+	{
+		SetBenchmarkCamera(i, numFrames);
+
+		const int64 startTime = Time::microTicks();
+
+		GR_BeginScene();
+		GR_ClearDepth(1.0f);
+		GR_ClearColor(128 / 255.0f, 158 / 255.0f, 182 / 255.0f);
+
+		RenderLevelView();
+		DebugOverlay_Draw();
+
+		GR_EndScene();
+
+		const int64 frameTime = Time::microTicks() - startTime;
+
+		GR_SwapWindow();
+
+		const GrFrameStats& frameStats = GR_GetFrameStats();
+
+		totalFrameTime += frameTime;
+		maxFrameTime = Math::max(maxFrameTime, frameTime);
+		totalSpoolTime += g_spoolTime;
+		totalUploadTime += g_meshUploadTime;
+
+		totalDrawn += g_drawnModels;
+		totalCulled += g_culledModels;
+		totalDrawCalls += frameStats.numDrawCalls;
+		totalStateChanges += frameStats.numShaderChanges + frameStats.numTextureChanges + frameStats.numVAOChanges + frameStats.numStateChanges;
+		totalUploadedBytes += frameStats.uploadedBytes;
+
+		const modelLodStats_t& lodStats = g_modelLods.GetStats();
+
+		for (int j = 0; j < MODEL_LOD_COUNT; j++)
+			totalLods[j] += lodStats.numLods[j];
+
+		totalLodSwitches += lodStats.numSwitches;
+	}
+
+	const GrResourceStats& resourceStats = GR_GetResourceStats();
+	const double frames = Math::max(numFrames, 1);
+
+	MsgAccept("Benchmark results (%s renderer, %s drawing):\n", nullRenderer ? "null" : "GL", g_instancedDrawing ? "instanced" : "per-object");
+	Msg("  CPU frame time : %.3f ms avg, %.3f ms max\n", totalFrameTime / frames / 1000.0, maxFrameTime / 1000.0);
+	Msg("  spool time     : %.3f ms avg, %.3f ms total\n", totalSpoolTime / frames / 1000.0, totalSpoolTime / 1000.0);
+	Msg("  mesh upload    : %.3f ms avg, %.3f ms total\n", totalUploadTime / frames / 1000.0, totalUploadTime / 1000.0);
+	Msg("  models         : %.1f drawn, %.1f culled per frame\n", totalDrawn / frames, totalCulled / frames);
+	Msg("  LODs           : %.1f high, %.1f normal, %.1f low, %.2f switches per frame\n",
+		totalLods[MODEL_LOD_HIGH] / frames, totalLods[MODEL_LOD_NORMAL] / frames, totalLods[MODEL_LOD_LOW] / frames, totalLodSwitches / frames);
+	Msg("  renderer       : %.1f draw calls, %.1f state changes per frame, %.2f MB uploaded\n",
+		totalDrawCalls / frames, totalStateChanges / frames, totalUploadedBytes / (1024.0 * 1024.0));
+	Msg("  resources      : %d VAOs (%.2f MB), %d textures, %d shaders\n",
+		resourceStats.numVAOs, resourceStats.bufferBytes / (1024.0 * 1024.0), resourceStats.numTextures, resourceStats.numShaders);
+	Msg("  model data     : %.2f MB\n", g_levModels.GetModelDataSize() / (1024.0 * 1024.0));
+
+	CRenderModel::PrintModelPoolStats();
+
+	const int64 freeStartTime = Time::microTicks();
+	FreeLevelData();
+
+	Msg("  level free     : %.3f ms\n", (Time::microTicks() - freeStartTime) / 1000.0);
+
+	DebugOverlay_Destroy();
+	GR_Shutdown();
+
+	return 0;
+}
@@ -3,4 +3,9 @@
 
 int ViewerMain();
 
+#define VIEWER_BENCHMARK_DEFAULT_FRAMES	600
+
+// renders numFrames with scripted camera and prints CPU timings
+int ViewerBenchmark(int numFrames, bool nullRenderer);
+
 #endif
\ No newline at end of file
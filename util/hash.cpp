@@ -0,0 +1,16 @@
+#include "hash.h"
+
+//-------------------------------------------------------------------------------
+
+uint64 Hash64(const void* data, int size, uint64 hash /*= HASH64_INIT*/)
+{
+	const ubyte* bytes = (const ubyte*)data;
+
+	for (int i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
@@ -0,0 +1,11 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "core/dktypes.h"
+
+#define HASH64_INIT		0xcbf29ce484222325ULL
+
+// 64 bit FNV-1a hash, pass previous result as hash to continue
+uint64	Hash64(const void* data, int size, uint64 hash = HASH64_INIT);
+
+#endif // HASH_H
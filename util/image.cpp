@@ -1,6 +1,7 @@
 #include "image.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <nstd/Array.hpp>
 #include "core/cmdlib.h"
 
@@ -45,16 +46,44 @@ TVec4D<ubyte> rgb5a1_ToRGBA8(ushort color, bool originalTransparencyKey /*= true
 }
 
 //-------------------------------------------------------------
-// Saves TGA file
+// Streaming TGA writer
 //-------------------------------------------------------------
-void SaveTGA(const char* filename, ubyte* data, int w, int h, int c)
+
+#define TGA_MAX_PACKET_PIXELS	128
+
+CTGAWriter::CTGAWriter()
+{
+}
+
+CTGAWriter::~CTGAWriter()
 {
+	Close();
+}
+
+bool CTGAWriter::Open(const char* filename, int w, int h, int c, bool rle)
+{
+	Close();
+
+	m_file = fopen(filename, "wb");
+	if (!m_file)
+		return false;
+
+	m_buffer = new ubyte[TGA_WRITE_BUFFER_SIZE];
+	m_bufferUsed = 0;
+
+	m_width = w;
+	m_height = h;
+	m_channels = c;
+	m_rowsWritten = 0;
+	m_rle = rle;
+	m_error = false;
+
 	TGAHEADER tgaHeader;
 
 	// Initialize the Targa header
 	tgaHeader.identsize = 0;
 	tgaHeader.colorMapType = 0;
-	tgaHeader.imageType = 2;
+	tgaHeader.imageType = rle ? 10 : 2;
 	tgaHeader.colorMapStart = 0;
 	tgaHeader.colorMapLength = 0;
 	tgaHeader.colorMapBits = 0;
@@ -65,19 +94,157 @@ void SaveTGA(const char* filename, ubyte* data, int w, int h, int c)
 	tgaHeader.bits = c * 8;
 	tgaHeader.descriptor = 0;
 
-	int imageSize = w * h * c;
+	Write(&tgaHeader, sizeof(TGAHEADER));
 
-	FILE* pFile = fopen(filename, "wb");
-	if (!pFile)
+	return true;
+}
+
+void CTGAWriter::WriteRows(const ubyte* data, int numRows, int pitch)
+{
+	if (!m_file)
 		return;
 
-	// Write the header
-	fwrite(&tgaHeader, sizeof(TGAHEADER), 1, pFile);
+	numRows = (numRows < m_height - m_rowsWritten) ? numRows : m_height - m_rowsWritten;
 
-	// Write the image data
-	fwrite(data, imageSize, 1, pFile);
+	for (int i = 0; i < numRows; i++)
+	{
+		if (m_rle)
+			WriteRowRLE(data);
+		else
+			Write(data, m_width * m_channels);
 
-	fclose(pFile);
+		data += pitch;
+	}
+
+	m_rowsWritten += numRows;
+}
+
+bool CTGAWriter::Close()
+{
+	if (!m_file)
+		return false;
+
+	Flush();
+
+	const bool result = !m_error && m_rowsWritten == m_height;
+
+	fclose(m_file);
+	m_file = nullptr;
+
+	delete[] m_buffer;
+	m_buffer = nullptr;
+
+	return result;
+}
+
+// run packet - count of same pixels, raw packet - pixels until next run
+void CTGAWriter::WriteRowRLE(const ubyte* row)
+{
+	const int c = m_channels;
+	int x = 0;
+
+	while (x < m_width)
+	{
+		const int maxCount = (m_width - x < TGA_MAX_PACKET_PIXELS) ? m_width - x : TGA_MAX_PACKET_PIXELS;
+		const ubyte* pixel = row + x * c;
+
+		int runCount = 1;
+		while (runCount < maxCount && !memcmp(pixel, pixel + runCount * c, c))
+			runCount++;
+
+		if (runCount > 1)
+		{
+			const ubyte packet = 0x80 | (runCount - 1);
+
+			Write(&packet, 1);
+			Write(pixel, c);
+
+			x += runCount;
+			continue;
+		}
+
+		// raw packet ends where two same pixels start
+		int rawCount = 1;
+		while (rawCount < maxCount)
+		{
+			if (rawCount + 1 < m_width - x && !memcmp(pixel + rawCount * c, pixel + (rawCount + 1) * c, c))
+				break;
+
+			rawCount++;
+		}
+
+		const ubyte packet = rawCount - 1;
+
+		Write(&packet, 1);
+		Write(pixel, rawCount * c);
+
+		x += rawCount;
+	}
+}
+
+void CTGAWriter::Write(const void* data, int size)
+{
+	const ubyte* src = (const ubyte*)data;
+
+	while (size > 0)
+	{
+		if (m_bufferUsed == TGA_WRITE_BUFFER_SIZE)
+			Flush();
+
+		const int space = TGA_WRITE_BUFFER_SIZE - m_bufferUsed;
+		const int count = (size < space) ? size : space;
+
+		memcpy(m_buffer + m_bufferUsed, src, count);
+
+		m_bufferUsed += count;
+		src += count;
+		size -= count;
+	}
+}
+
+void CTGAWriter::Flush()
+{
+	if (m_bufferUsed && fwrite(m_buffer, 1, m_bufferUsed, m_file) != (size_t)m_bufferUsed)
+		m_error = true;
+
+	m_bufferUsed = 0;
+}
+
+//-------------------------------------------------------------
+// Saves TGA file getting each row from callback
+//-------------------------------------------------------------
+bool SaveTGAByRows(const char* filename, int w, int h, int c, bool rle, TGAGetRowFunc rowFunc, void* userData)
+{
+	CTGAWriter writer;
+
+	if (!writer.Open(filename, w, h, c, rle))
+		return false;
+
+	ubyte* row = new ubyte[w * c];
+
+	for (int y = 0; y < h; y++)
+	{
+		rowFunc(row, y, userData);
+		writer.WriteRows(row, 1, 0);
+	}
+
+	delete[] row;
+
+	return writer.Close();
+}
+
+//-------------------------------------------------------------
+// Saves TGA file
+//-------------------------------------------------------------
+void SaveTGA(const char* filename, ubyte* data, int w, int h, int c, bool rle /*= false*/)
+{
+	CTGAWriter writer;
+
+	if (!writer.Open(filename, w, h, c, rle))
+		return;
+
+	writer.WriteRows(data, h, w * c);
+	writer.Close();
 }
 
 //-------------------------------------------------------------
@@ -4,6 +4,8 @@
 #include "core/dktypes.h"
 #include "math/Vector.h"
 
+#include <stdio.h>
+
 // Define targa header.
 #pragma pack( push, 1 )
 typedef struct
@@ -50,8 +52,53 @@ TVec4D<ubyte> rgb5a1_ToRGBA8(ushort color, bool originalTransparencyKey /*= true
 
 //-------------------------------------------------------------------
 
+// Streaming TGA writer
+//
+// Rows are stored bottom-up and are written as they are produced
+// through write buffer, so whole image never has to be in memory.
+// RLE packets never cross rows.
+//-------------------------------------------------------------------
+
+#define TGA_WRITE_BUFFER_SIZE	(64 * 1024)
+
+class CTGAWriter
+{
+public:
+	CTGAWriter();
+	~CTGAWriter();
+
+	bool	Open(const char* filename, int w, int h, int c, bool rle);
+
+	// writes next rows, pitch is in bytes and can be negative
+	void	WriteRows(const ubyte* data, int numRows, int pitch);
+
+	// returns false if write failed or not all rows were written
+	bool	Close();
+
+protected:
+	void	WriteRowRLE(const ubyte* row);
+	void	Write(const void* data, int size);
+	void	Flush();
+
+	FILE*	m_file{ nullptr };
+	ubyte*	m_buffer{ nullptr };
+	int		m_bufferUsed{ 0 };
+
+	int		m_width{ 0 };
+	int		m_height{ 0 };
+	int		m_channels{ 0 };
+	int		m_rowsWritten{ 0 };
+
+	bool	m_rle{ false };
+	bool	m_error{ false };
+};
+
+// row is filled by callback, y goes from bottom row to top
+typedef void (*TGAGetRowFunc)(ubyte* row, int y, void* userData);
+
+bool SaveTGAByRows(const char* filename, int w, int h, int c, bool rle, TGAGetRowFunc rowFunc, void* userData);
 
-void SaveTGA(const char* filename, ubyte* data, int w, int h, int c);
+void SaveTGA(const char* filename, ubyte* data, int w, int h, int c, bool rle = false);
 
 void SaveTIM_4bit(char* filename,
 	ubyte* image_data, int image_size,
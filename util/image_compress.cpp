@@ -0,0 +1,632 @@
+#include "image_compress.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <nstd/Math.hpp>
+
+#define TEXEL_KEY_PINK		0x00FF00FFu
+
+static inline bool IsKeyTexel(uint color)
+{
+	return color == 0 || color == TEXEL_KEY_PINK;
+}
+
+static inline int TexelRed(uint color)		{ return (color >> 16) & 255; }
+static inline int TexelGreen(uint color)	{ return (color >> 8) & 255; }
+static inline int TexelBlue(uint color)		{ return color & 255; }
+static inline int TexelAlpha(uint color)	{ return color >> 24; }
+
+static ushort PackRGB565(const float* rgb)
+{
+	int r = (int)(Math::max(0.0f, Math::min(rgb[0], 255.0f)) * 31.0f / 255.0f + 0.5f);
+	int g = (int)(Math::max(0.0f, Math::min(rgb[1], 255.0f)) * 63.0f / 255.0f + 0.5f);
+	int b = (int)(Math::max(0.0f, Math::min(rgb[2], 255.0f)) * 31.0f / 255.0f + 0.5f);
+
+	return (r << 11) | (g << 5) | b;
+}
+
+static void UnpackRGB565(ushort color, int* rgb)
+{
+	const int r = (color >> 11) & 31;
+	const int g = (color >> 5) & 63;
+	const int b = color & 31;
+
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+//-------------------------------------------------------------------------------
+// Color block. Endpoints are extremes of texels projected on principal axis.
+// With punchThrough key texels use transparent index of 3 color mode
+//-------------------------------------------------------------------------------
+static void CompressColorBlock(ubyte* dest, const uint* block, bool punchThrough)
+{
+	float colors[16][3];
+	bool isKey[16];
+
+	int numColors = 0;
+	bool anyKey = false;
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (int i = 0; i < 16; i++)
+	{
+		isKey[i] = IsKeyTexel(block[i]);
+		anyKey = anyKey || isKey[i];
+
+		// key color does not matter
+		if (isKey[i])
+			continue;
+
+		float* color = colors[numColors++];
+		color[0] = (float)TexelRed(block[i]);
+		color[1] = (float)TexelGreen(block[i]);
+		color[2] = (float)TexelBlue(block[i]);
+
+		mean[0] += color[0];
+		mean[1] += color[1];
+		mean[2] += color[2];
+	}
+
+	ushort c0 = 0;
+	ushort c1 = 0;
+
+	if (numColors > 0)
+	{
+		mean[0] /= numColors;
+		mean[1] /= numColors;
+		mean[2] /= numColors;
+
+		float cov[6] = { 0.0f };
+		float minColor[3] = { 255.0f, 255.0f, 255.0f };
+		float maxColor[3] = { 0.0f, 0.0f, 0.0f };
+
+		for (int i = 0; i < numColors; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				minColor[j] = Math::min(minColor[j], colors[i][j]);
+				maxColor[j] = Math::max(maxColor[j], colors[i][j]);
+			}
+
+			const float r = colors[i][0] - mean[0];
+			const float g = colors[i][1] - mean[1];
+			const float b = colors[i][2] - mean[2];
+
+			cov[0] += r * r;
+			cov[1] += r * g;
+			cov[2] += r * b;
+			cov[3] += g * g;
+			cov[4] += g * b;
+			cov[5] += b * b;
+		}
+
+		// principal axis by power iteration, seeded with channel of largest variance
+		// as fixed seed (e.g. grey for red/green block) can be orthogonal to it
+		float axis[3] = { 0.0f, 0.0f, 0.0f };
+
+		if (cov[0] >= cov[3] && cov[0] >= cov[5])
+			axis[0] = 1.0f;
+		else if (cov[3] >= cov[5])
+			axis[1] = 1.0f;
+		else
+			axis[2] = 1.0f;
+
+		bool collapsed = false;
+
+		for (int iter = 0; iter < 8; iter++)
+		{
+			const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+			const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+			const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+
+			const float len = Math::max(Math::abs(x), Math::max(Math::abs(y), Math::abs(z)));
+
+			if (len < 1e-6f)
+			{
+				collapsed = true;
+				break;
+			}
+
+			axis[0] = x / len;
+			axis[1] = y / len;
+			axis[2] = z / len;
+		}
+
+		float end0[3], end1[3];
+
+		if (collapsed)
+		{
+			// no usable axis (single color or degenerate covariance) - use bounding box
+			for (int i = 0; i < 3; i++)
+			{
+				end0[i] = maxColor[i];
+				end1[i] = minColor[i];
+			}
+		}
+		else
+		{
+			const float axisLenSqr = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+			float minT = 0.0f;
+			float maxT = 0.0f;
+
+			for (int i = 0; i < numColors; i++)
+			{
+				const float t = ((colors[i][0] - mean[0]) * axis[0] + (colors[i][1] - mean[1]) * axis[1] + (colors[i][2] - mean[2]) * axis[2]) / axisLenSqr;
+
+				minT = Math::min(minT, t);
+				maxT = Math::max(maxT, t);
+			}
+
+			for (int i = 0; i < 3; i++)
+			{
+				end0[i] = mean[i] + axis[i] * maxT;
+				end1[i] = mean[i] + axis[i] * minT;
+			}
+		}
+
+		c0 = PackRGB565(end0);
+		c1 = PackRGB565(end1);
+	}
+
+	const bool threeColorMode = punchThrough && anyKey;
+
+	// color0 <= color1 selects 3 color mode
+	if (threeColorMode ? (c0 > c1) : (c0 < c1))
+	{
+		const ushort t = c0;
+		c0 = c1;
+		c1 = t;
+	}
+
+	int palette[4][3];
+	UnpackRGB565(c0, palette[0]);
+	UnpackRGB565(c1, palette[1]);
+
+	int numPalette;
+
+	if (threeColorMode)
+	{
+		for (int i = 0; i < 3; i++)
+			palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+
+		numPalette = 3;
+	}
+	else
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+			palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+		}
+
+		// equal endpoints are all index 0
+		numPalette = (c0 == c1) ? 1 : 4;
+	}
+
+	uint indices = 0;
+
+	for (int i = 0; i < 16; i++)
+	{
+		int best = 0;
+
+		if (threeColorMode && isKey[i])
+		{
+			best = 3;
+		}
+		else
+		{
+			const int r = TexelRed(block[i]);
+			const int g = TexelGreen(block[i]);
+			const int b = TexelBlue(block[i]);
+
+			int bestDist = 0x7FFFFFFF;
+
+			for (int j = 0; j < numPalette; j++)
+			{
+				const int dr = r - palette[j][0];
+				const int dg = g - palette[j][1];
+				const int db = b - palette[j][2];
+				const int dist = dr * dr + dg * dg + db * db;
+
+				if (dist < bestDist)
+				{
+					bestDist = dist;
+					best = j;
+				}
+			}
+		}
+
+		indices |= best << (i * 2);
+	}
+
+	dest[0] = c0 & 255;
+	dest[1] = c0 >> 8;
+	dest[2] = c1 & 255;
+	dest[3] = c1 >> 8;
+	dest[4] = indices & 255;
+	dest[5] = (indices >> 8) & 255;
+	dest[6] = (indices >> 16) & 255;
+	dest[7] = indices >> 24;
+}
+
+//-------------------------------------------------------------------------------
+// Alpha block, always 8 value mode
+//-------------------------------------------------------------------------------
+static void CompressAlphaBlock(ubyte* dest, const uint* block)
+{
+	int minA = 255;
+	int maxA = 0;
+
+	for (int i = 0; i < 16; i++)
+	{
+		minA = Math::min(minA, TexelAlpha(block[i]));
+		maxA = Math::max(maxA, TexelAlpha(block[i]));
+	}
+
+	int palette[8];
+	palette[0] = maxA;
+	palette[1] = minA;
+
+	for (int i = 1; i < 7; i++)
+		palette[i + 1] = ((7 - i) * maxA + i * minA + 3) / 7;
+
+	uint64 indices = 0;
+
+	if (maxA != minA)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			const int a = TexelAlpha(block[i]);
+
+			int best = 0;
+			int bestDist = 256;
+
+			for (int j = 0; j < 8; j++)
+			{
+				const int dist = Math::abs(a - palette[j]);
+
+				if (dist < bestDist)
+				{
+					bestDist = dist;
+					best = j;
+				}
+			}
+
+			indices |= (uint64)best << (i * 3);
+		}
+	}
+
+	dest[0] = maxA;
+	dest[1] = minA;
+
+	for (int i = 0; i < 6; i++)
+		dest[2 + i] = (indices >> (i * 8)) & 255;
+}
+
+void CompressBlockBC1(ubyte* dest, const uint* block)
+{
+	CompressColorBlock(dest, block, true);
+}
+
+void CompressBlockBC3(ubyte* dest, const uint* block)
+{
+	CompressAlphaBlock(dest, block);
+	CompressColorBlock(dest + 8, block, false);
+}
+
+//-------------------------------------------------------------------------------
+
+int GetCompressedImageSize(int w, int h, int blockFormat)
+{
+	const int blockSize = (blockFormat == BLOCK_BC3) ? 16 : 8;
+	return ((w + 3) / 4) * ((h + 3) / 4) * blockSize;
+}
+
+void CompressImageBC(ubyte* dest, const uint* src, int w, int h, int blockFormat)
+{
+	const int blockSize = (blockFormat == BLOCK_BC3) ? 16 : 8;
+
+	uint block[16];
+
+	for (int by = 0; by < h; by += 4)
+	{
+		for (int bx = 0; bx < w; bx += 4)
+		{
+			// edge blocks repeat last row and column
+			for (int y = 0; y < 4; y++)
+			{
+				const uint* row = src + Math::min(by + y, h - 1) * w;
+
+				for (int x = 0; x < 4; x++)
+					block[y * 4 + x] = row[Math::min(bx + x, w - 1)];
+			}
+
+			if (blockFormat == BLOCK_BC3)
+				CompressBlockBC3(dest, block);
+			else
+				CompressBlockBC1(dest, block);
+
+			dest += blockSize;
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------
+// 2x2 box filter. Key texels are skipped, result is key only if most of them are
+//-------------------------------------------------------------------------------
+void DownsampleBGRA8(uint* dest, const uint* src, int w, int h)
+{
+	const int nw = Math::max(1, w / 2);
+	const int nh = Math::max(1, h / 2);
+
+	for (int y = 0; y < nh; y++)
+	{
+		const uint* row0 = src + Math::min(y * 2, h - 1) * w;
+		const uint* row1 = src + Math::min(y * 2 + 1, h - 1) * w;
+
+		for (int x = 0; x < nw; x++)
+		{
+			const int x0 = Math::min(x * 2, w - 1);
+			const int x1 = Math::min(x * 2 + 1, w - 1);
+
+			const uint texels[4] = { row0[x0], row0[x1], row1[x0], row1[x1] };
+
+			int sum[4] = { 0, 0, 0, 0 };
+			int numColors = 0;
+			uint key = 0;
+
+			for (int i = 0; i < 4; i++)
+			{
+				if (IsKeyTexel(texels[i]))
+				{
+					key = texels[i];
+					continue;
+				}
+
+				sum[0] += TexelBlue(texels[i]);
+				sum[1] += TexelGreen(texels[i]);
+				sum[2] += TexelRed(texels[i]);
+				sum[3] += TexelAlpha(texels[i]);
+				numColors++;
+			}
+
+			if (numColors < 2)
+			{
+				dest[y * nw + x] = key;
+				continue;
+			}
+
+			const int half = numColors / 2;
+
+			const uint b = (sum[0] + half) / numColors;
+			const uint g = (sum[1] + half) / numColors;
+			const uint r = (sum[2] + half) / numColors;
+			const uint a = (sum[3] + half) / numColors;
+
+			uint color = (a << 24) | (r << 16) | (g << 8) | b;
+
+			// averaged color must not turn into a key
+			if (IsKeyTexel(color))
+				color |= 1;
+
+			dest[y * nw + x] = color;
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------
+// File headers
+//-------------------------------------------------------------------------------
+
+#define DDS_MAGIC				0x20534444		// "DDS "
+
+#define DDSD_CAPS				0x1
+#define DDSD_HEIGHT				0x2
+#define DDSD_WIDTH				0x4
+#define DDSD_PIXELFORMAT		0x1000
+#define DDSD_MIPMAPCOUNT		0x20000
+#define DDSD_LINEARSIZE			0x80000
+
+#define DDPF_FOURCC				0x4
+
+#define DDSCAPS_COMPLEX			0x8
+#define DDSCAPS_TEXTURE			0x1000
+#define DDSCAPS_MIPMAP			0x400000
+
+#define DDS_FOURCC_DXT1			0x31545844		// "DXT1"
+#define DDS_FOURCC_DXT5			0x35545844		// "DXT5"
+
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT	0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT	0x83F3
+#define GL_RGBA								0x1908
+
+#pragma pack( push, 1 )
+struct DDS_PIXELFORMAT
+{
+	uint	size;
+	uint	flags;
+	uint	fourCC;
+	uint	RGBBitCount;
+	uint	RBitMask;
+	uint	GBitMask;
+	uint	BBitMask;
+	uint	ABitMask;
+};
+
+struct DDS_HEADER
+{
+	uint	magic;
+	uint	size;
+	uint	flags;
+	uint	height;
+	uint	width;
+	uint	pitchOrLinearSize;
+	uint	depth;
+	uint	mipMapCount;
+	uint	reserved1[11];
+	DDS_PIXELFORMAT ddspf;
+	uint	caps;
+	uint	caps2;
+	uint	caps3;
+	uint	caps4;
+	uint	reserved2;
+};
+
+struct KTX_HEADER
+{
+	ubyte	identifier[12];
+	uint	endianness;
+	uint	glType;
+	uint	glTypeSize;
+	uint	glFormat;
+	uint	glInternalFormat;
+	uint	glBaseInternalFormat;
+	uint	pixelWidth;
+	uint	pixelHeight;
+	uint	pixelDepth;
+	uint	numberOfArrayElements;
+	uint	numberOfFaces;
+	uint	numberOfMipmapLevels;
+	uint	bytesOfKeyValueData;
+};
+#pragma pack( pop )
+
+static int GetMipCount(int w, int h)
+{
+	int numMips = 1;
+
+	while (w > 1 || h > 1)
+	{
+		w = Math::max(1, w / 2);
+		h = Math::max(1, h / 2);
+		numMips++;
+	}
+
+	return numMips;
+}
+
+//-------------------------------------------------------------------------------
+// DDS is stored top-down, KTX has OpenGL bottom-up row order
+//-------------------------------------------------------------------------------
+int MakeCompressedTextureFile(ubyte*& outData, const uint* bgra, int w, int h, int fileFormat, int blockFormat)
+{
+	const int numMips = GetMipCount(w, h);
+
+	int dataSize = 0;
+	{
+		int mw = w, mh = h;
+		for (int i = 0; i < numMips; i++)
+		{
+			dataSize += GetCompressedImageSize(mw, mh, blockFormat);
+
+			if (fileFormat == TEXFILE_KTX)
+				dataSize += sizeof(uint);
+
+			mw = Math::max(1, mw / 2);
+			mh = Math::max(1, mh / 2);
+		}
+	}
+
+	const int headerSize = (fileFormat == TEXFILE_KTX) ? sizeof(KTX_HEADER) : sizeof(DDS_HEADER);
+
+	outData = new ubyte[headerSize + dataSize];
+	memset(outData, 0, headerSize);
+
+	if (fileFormat == TEXFILE_KTX)
+	{
+		static const ubyte ktxIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+		KTX_HEADER& header = *(KTX_HEADER*)outData;
+		memcpy(header.identifier, ktxIdentifier, sizeof(ktxIdentifier));
+		header.endianness = 0x04030201;
+		header.glTypeSize = 1;
+		header.glInternalFormat = (blockFormat == BLOCK_BC3) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		header.glBaseInternalFormat = GL_RGBA;
+		header.pixelWidth = w;
+		header.pixelHeight = h;
+		header.numberOfFaces = 1;
+		header.numberOfMipmapLevels = numMips;
+	}
+	else
+	{
+		DDS_HEADER& header = *(DDS_HEADER*)outData;
+		header.magic = DDS_MAGIC;
+		header.size = sizeof(DDS_HEADER) - sizeof(uint);
+		header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+		header.height = h;
+		header.width = w;
+		header.pitchOrLinearSize = GetCompressedImageSize(w, h, blockFormat);
+		header.mipMapCount = numMips;
+		header.ddspf.size = sizeof(DDS_PIXELFORMAT);
+		header.ddspf.flags = DDPF_FOURCC;
+		header.ddspf.fourCC = (blockFormat == BLOCK_BC3) ? DDS_FOURCC_DXT5 : DDS_FOURCC_DXT1;
+		header.caps = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+	}
+
+	uint* mipData = new uint[w * h];
+	uint* nextMipData = new uint[Math::max(1, w / 2) * Math::max(1, h / 2)];
+
+	if (fileFormat == TEXFILE_KTX)
+	{
+		memcpy(mipData, bgra, w * h * sizeof(uint));
+	}
+	else
+	{
+		for (int y = 0; y < h; y++)
+			memcpy(mipData + y * w, bgra + (h - y - 1) * w, w * sizeof(uint));
+	}
+
+	ubyte* dest = outData + headerSize;
+
+	int mw = w, mh = h;
+	for (int i = 0; i < numMips; i++)
+	{
+		const int mipSize = GetCompressedImageSize(mw, mh, blockFormat);
+
+		if (fileFormat == TEXFILE_KTX)
+		{
+			*(uint*)dest = mipSize;
+			dest += sizeof(uint);
+		}
+
+		CompressImageBC(dest, mipData, mw, mh, blockFormat);
+		dest += mipSize;
+
+		if (i + 1 < numMips)
+		{
+			DownsampleBGRA8(nextMipData, mipData, mw, mh);
+
+			uint* t = mipData;
+			mipData = nextMipData;
+			nextMipData = t;
+
+			mw = Math::max(1, mw / 2);
+			mh = Math::max(1, mh / 2);
+		}
+	}
+
+	delete[] mipData;
+	delete[] nextMipData;
+
+	return headerSize + dataSize;
+}
+
+bool SaveCompressedTexture(const char* filename, const uint* bgra, int w, int h, int fileFormat, int blockFormat)
+{
+	FILE* pFile = fopen(filename, "wb");
+	if (!pFile)
+		return false;
+
+	ubyte* fileData;
+	const int fileSize = MakeCompressedTextureFile(fileData, bgra, w, h, fileFormat, blockFormat);
+
+	fwrite(fileData, 1, fileSize, pFile);
+	fclose(pFile);
+
+	delete[] fileData;
+
+	return true;
+}
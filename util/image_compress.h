@@ -0,0 +1,45 @@
+#ifndef IMAGE_COMPRESS_H
+#define IMAGE_COMPRESS_H
+
+#include "core/dktypes.h"
+
+//-------------------------------------------------------------------
+// Block compressed texture output
+//
+// Input is 32 bit BGRA (0xAARRGGBB) with rows stored bottom-up as
+// for SaveTGA. Alpha of exported textures is the semi-transparency
+// bit, real transparency is the color key (zero or pink with zero
+// alpha). Mip filter does not blend key texels into colors and BC1
+// stores them as punch-through transparent texels.
+//-------------------------------------------------------------------
+
+enum ETextureFileFormat
+{
+	TEXFILE_TGA = 0,
+	TEXFILE_DDS,
+	TEXFILE_KTX,
+};
+
+enum EBlockCompression
+{
+	BLOCK_BC1 = 0,		// 1 bit alpha, 8 bytes per block
+	BLOCK_BC3,			// 8 bit alpha, 16 bytes per block
+};
+
+// compresses 4x4 block, texels are stored in rows
+void		CompressBlockBC1(ubyte* dest, const uint* block);
+void		CompressBlockBC3(ubyte* dest, const uint* block);
+
+// whole image compression, src rows are top-down
+int			GetCompressedImageSize(int w, int h, int blockFormat);
+void		CompressImageBC(ubyte* dest, const uint* src, int w, int h, int blockFormat);
+
+// makes next mip level of (w, h) image
+void		DownsampleBGRA8(uint* dest, const uint* src, int w, int h);
+
+// makes DDS or KTX file in memory with full mip chain, returns size. Free data with delete[]
+int			MakeCompressedTextureFile(ubyte*& outData, const uint* bgra, int w, int h, int fileFormat, int blockFormat);
+
+bool		SaveCompressedTexture(const char* filename, const uint* bgra, int w, int h, int fileFormat, int blockFormat);
+
+#endif // IMAGE_COMPRESS_H
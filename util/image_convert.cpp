@@ -0,0 +1,316 @@
+#include "image_convert.h"
+#include "image.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define IMAGE_CONVERT_X86
+#endif
+
+#ifdef IMAGE_CONVERT_X86
+
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#else
+#define TARGET_SSSE3	__attribute__((target("ssse3")))
+#define TARGET_AVX2		__attribute__((target("avx2")))
+#endif
+
+#endif // IMAGE_CONVERT_X86
+
+typedef void (*ConvertIndexed4Func)(uint* dest, const ubyte* src, int numPairs, const uint* palette);
+
+//-------------------------------------------------------------------------------
+
+void MakePalette_RGBA8(uint* palette, const ushort* colors, bool bgra, bool originalTransparencyKey)
+{
+	for (int i = 0; i < 16; i++)
+	{
+		TVec4D<ubyte> color = bgra ? rgb5a1_ToBGRA8(colors[i], originalTransparencyKey) : rgb5a1_ToRGBA8(colors[i], originalTransparencyKey);
+		palette[i] = *(uint*)&color;
+	}
+}
+
+//-------------------------------------------------------------------------------
+// Kernels. Each one converts numPairs source bytes (two pixels per byte)
+
+static void ConvertIndexed4_Scalar(uint* dest, const ubyte* src, int numPairs, const uint* palette)
+{
+	for (int i = 0; i < numPairs; i++)
+	{
+		const ubyte pair = src[i];
+
+		dest[0] = palette[pair & 15];
+		dest[1] = palette[pair >> 4];
+		dest += 2;
+	}
+}
+
+#ifdef IMAGE_CONVERT_X86
+
+// splits palette into byte planes so pshufb can look them up
+static void MakePaletteBytePlanes(ubyte planes[4][16], const uint* palette)
+{
+	for (int i = 0; i < 16; i++)
+	{
+		const ubyte* color = (const ubyte*)&palette[i];
+
+		planes[0][i] = color[0];
+		planes[1][i] = color[1];
+		planes[2][i] = color[2];
+		planes[3][i] = color[3];
+	}
+}
+
+TARGET_SSSE3 static void ConvertIndexed4_SSSE3(uint* dest, const ubyte* src, int numPairs, const uint* palette)
+{
+	ubyte planes[4][16];
+	MakePaletteBytePlanes(planes, palette);
+
+	const __m128i plane0 = _mm_loadu_si128((const __m128i*)planes[0]);
+	const __m128i plane1 = _mm_loadu_si128((const __m128i*)planes[1]);
+	const __m128i plane2 = _mm_loadu_si128((const __m128i*)planes[2]);
+	const __m128i plane3 = _mm_loadu_si128((const __m128i*)planes[3]);
+	const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+
+	int i = 0;
+
+	// 16 pixels per iteration
+	for (; i + 8 <= numPairs; i += 8)
+	{
+		const __m128i packed = _mm_loadl_epi64((const __m128i*)(src + i));
+
+		const __m128i lo = _mm_and_si128(packed, nibbleMask);
+		const __m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), nibbleMask);
+		const __m128i indices = _mm_unpacklo_epi8(lo, hi);
+
+		const __m128i c0 = _mm_shuffle_epi8(plane0, indices);
+		const __m128i c1 = _mm_shuffle_epi8(plane1, indices);
+		const __m128i c2 = _mm_shuffle_epi8(plane2, indices);
+		const __m128i c3 = _mm_shuffle_epi8(plane3, indices);
+
+		const __m128i c01lo = _mm_unpacklo_epi8(c0, c1);
+		const __m128i c01hi = _mm_unpackhi_epi8(c0, c1);
+		const __m128i c23lo = _mm_unpacklo_epi8(c2, c3);
+		const __m128i c23hi = _mm_unpackhi_epi8(c2, c3);
+
+		__m128i* out = (__m128i*)(dest + i * 2);
+		_mm_storeu_si128(out + 0, _mm_unpacklo_epi16(c01lo, c23lo));
+		_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(c01lo, c23lo));
+		_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(c01hi, c23hi));
+		_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(c01hi, c23hi));
+	}
+
+	ConvertIndexed4_Scalar(dest + i * 2, src + i, numPairs - i, palette);
+}
+
+TARGET_AVX2 static void ConvertIndexed4_AVX2(uint* dest, const ubyte* src, int numPairs, const uint* palette)
+{
+	ubyte planes[4][16];
+	MakePaletteBytePlanes(planes, palette);
+
+	// pshufb works within 128 bit lanes, so both lanes hold the same plane
+	const __m256i plane0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)planes[0]));
+	const __m256i plane1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)planes[1]));
+	const __m256i plane2 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)planes[2]));
+	const __m256i plane3 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)planes[3]));
+	const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+
+	int i = 0;
+
+	// 32 pixels per iteration
+	for (; i + 16 <= numPairs; i += 16)
+	{
+		const __m128i packed = _mm_loadu_si128((const __m128i*)(src + i));
+
+		const __m128i lo = _mm_and_si128(packed, nibbleMask);
+		const __m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), nibbleMask);
+
+		// lane 0 - pixels 0..15, lane 1 - pixels 16..31
+		const __m256i indices = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(lo, hi)), _mm_unpackhi_epi8(lo, hi), 1);
+
+		const __m256i c0 = _mm256_shuffle_epi8(plane0, indices);
+		const __m256i c1 = _mm256_shuffle_epi8(plane1, indices);
+		const __m256i c2 = _mm256_shuffle_epi8(plane2, indices);
+		const __m256i c3 = _mm256_shuffle_epi8(plane3, indices);
+
+		const __m256i c01lo = _mm256_unpacklo_epi8(c0, c1);
+		const __m256i c01hi = _mm256_unpackhi_epi8(c0, c1);
+		const __m256i c23lo = _mm256_unpacklo_epi8(c2, c3);
+		const __m256i c23hi = _mm256_unpackhi_epi8(c2, c3);
+
+		// per lane: p0 - pixels 0..3, p1 - 4..7, p2 - 8..11, p3 - 12..15
+		const __m256i p0 = _mm256_unpacklo_epi16(c01lo, c23lo);
+		const __m256i p1 = _mm256_unpackhi_epi16(c01lo, c23lo);
+		const __m256i p2 = _mm256_unpacklo_epi16(c01hi, c23hi);
+		const __m256i p3 = _mm256_unpackhi_epi16(c01hi, c23hi);
+
+		__m256i* out = (__m256i*)(dest + i * 2);
+		_mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+		_mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+		_mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+		_mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+	}
+
+	ConvertIndexed4_SSSE3(dest + i * 2, src + i, numPairs - i, palette);
+}
+
+static bool CPUSupportsSSSE3()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 9)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+static bool CPUSupportsAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+
+	if (info[0] < 7)
+		return false;
+
+	// OS must save YMM registers
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // IMAGE_CONVERT_X86
+
+//-------------------------------------------------------------------------------
+
+static ConvertIndexed4Func GetKernelFunc(int kernel)
+{
+	switch (kernel)
+	{
+#ifdef IMAGE_CONVERT_X86
+		case INDEXED_KERNEL_SSSE3:
+			return ConvertIndexed4_SSSE3;
+		case INDEXED_KERNEL_AVX2:
+			return ConvertIndexed4_AVX2;
+#endif
+		default:
+			return ConvertIndexed4_Scalar;
+	}
+}
+
+static int GetBestKernel()
+{
+	if (IsIndexedConvertKernelSupported(INDEXED_KERNEL_AVX2))
+		return INDEXED_KERNEL_AVX2;
+
+	if (IsIndexedConvertKernelSupported(INDEXED_KERNEL_SSSE3))
+		return INDEXED_KERNEL_SSSE3;
+
+	return INDEXED_KERNEL_SCALAR;
+}
+
+static int s_convertKernel = GetBestKernel();
+static ConvertIndexed4Func s_convertFunc = GetKernelFunc(s_convertKernel);
+
+bool IsIndexedConvertKernelSupported(int kernel)
+{
+	switch (kernel)
+	{
+		case INDEXED_KERNEL_AUTO:
+		case INDEXED_KERNEL_SCALAR:
+			return true;
+#ifdef IMAGE_CONVERT_X86
+		case INDEXED_KERNEL_SSSE3:
+			return CPUSupportsSSSE3();
+		case INDEXED_KERNEL_AVX2:
+			return CPUSupportsAVX2();
+#endif
+	}
+
+	return false;
+}
+
+bool SetIndexedConvertKernel(int kernel)
+{
+	if (kernel == INDEXED_KERNEL_AUTO)
+		kernel = GetBestKernel();
+
+	if (!IsIndexedConvertKernelSupported(kernel))
+		return false;
+
+	s_convertKernel = kernel;
+	s_convertFunc = GetKernelFunc(kernel);
+
+	return true;
+}
+
+int GetIndexedConvertKernel()
+{
+	return s_convertKernel;
+}
+
+const char* GetIndexedConvertKernelName(int kernel)
+{
+	static const char* s_kernelNames[] = {
+		"scalar",
+		"SSSE3",
+		"AVX2",
+	};
+
+	if (kernel < 0 || kernel >= INDEXED_KERNEL_COUNT)
+		return "auto";
+
+	return s_kernelNames[kernel];
+}
+
+//-------------------------------------------------------------------------------
+
+void ConvertIndexed4ToRGBA8(uint* dest, const ubyte* srcRow, int srcX, int count, const uint* palette)
+{
+	if (count <= 0)
+		return;
+
+	const ubyte* src = srcRow + srcX / 2;
+
+	// odd start pixel is high nibble
+	if (srcX & 1)
+	{
+		*dest++ = palette[*src++ >> 4];
+		count--;
+	}
+
+	const int numPairs = count / 2;
+	s_convertFunc(dest, src, numPairs, palette);
+
+	// odd end pixel is low nibble
+	if (count & 1)
+		dest[numPairs * 2] = palette[src[numPairs] & 15];
+}
+
+void ConvertIndexed4RectToRGBA8(uint* dest, int destPitch,
+	const ubyte* src, int srcPitch,
+	int x, int y, int w, int h,
+	const uint* palette)
+{
+	const ubyte* srcRow = src + y * srcPitch;
+
+	for (int i = 0; i < h; i++)
+	{
+		ConvertIndexed4ToRGBA8(dest, srcRow, x, w, palette);
+
+		dest += destPitch;
+		srcRow += srcPitch;
+	}
+}
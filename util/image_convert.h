@@ -0,0 +1,45 @@
+#ifndef IMAGE_CONVERT_H
+#define IMAGE_CONVERT_H
+
+#include "core/dktypes.h"
+
+//-------------------------------------------------------------------
+// 4 bit indexed to 32 bit color conversion
+//
+// Palette is 16 precomputed 32 bit colors, so kernels only do
+// lookups. SIMD kernels use byte shuffles on palette byte planes
+// and produce bit-exact results with the scalar one.
+//-------------------------------------------------------------------
+
+enum EIndexedConvertKernel
+{
+	INDEXED_KERNEL_AUTO = -1,
+
+	INDEXED_KERNEL_SCALAR = 0,
+	INDEXED_KERNEL_SSSE3,
+	INDEXED_KERNEL_AVX2,
+
+	INDEXED_KERNEL_COUNT
+};
+
+// makes 16 entry palette from 16 bit CLUT colors
+// originalTransparencyKey makes color 0 pink
+void		MakePalette_RGBA8(uint* palette, const ushort* colors, bool bgra, bool originalTransparencyKey);
+
+// converts count pixels of 4 bit row starting from pixel srcX
+void		ConvertIndexed4ToRGBA8(uint* dest, const ubyte* srcRow, int srcX, int count, const uint* palette);
+
+// converts rectangle of 4 bit image
+// srcPitch is in bytes, destPitch is in pixels and can be negative for flipped output
+void		ConvertIndexed4RectToRGBA8(uint* dest, int destPitch,
+				const ubyte* src, int srcPitch,
+				int x, int y, int w, int h,
+				const uint* palette);
+
+// kernel selection, AUTO picks the best one supported by CPU
+bool		SetIndexedConvertKernel(int kernel);
+int			GetIndexedConvertKernel();
+bool		IsIndexedConvertKernelSupported(int kernel);
+const char*	GetIndexedConvertKernelName(int kernel);
+
+#endif // IMAGE_CONVERT_H
@@ -64,10 +64,11 @@ void mem_move(unsigned char** put, unsigned char* start, int count)
 
 /* 8 bit left going stream
  * count is zero to initialze
+ * bit stream state is kept by caller so segments can be unpacked in parallel
  */
-unsigned short get_bits2(unsigned char** byteStreamPtr, unsigned short count)
+unsigned short get_bits2(unsigned char** byteStreamPtr, unsigned char* bitStreamPtr, unsigned short count)
 {
-    static unsigned char bitStream = 0;
+    unsigned char bitStream = *bitStreamPtr;
     unsigned short nextBit = 0;
     unsigned short theBits = 0;
 
@@ -92,21 +93,22 @@ unsigned short get_bits2(unsigned char** byteStreamPtr, unsigned short count)
         }
         theBits = (theBits << 1) + nextBit;
     }
+    *bitStreamPtr = bitStream;
     return theBits;
 }
 
-unsigned short get_offset(unsigned char** byteStreamPtr)
+unsigned short get_offset(unsigned char** byteStreamPtr, unsigned char* bitStream)
 {
     unsigned short value = 0;
-    if (get_bits2(byteStreamPtr, 1)) {
-        value = get_bits2(byteStreamPtr, 1);
-        if (get_bits2(byteStreamPtr, 1)) {
-            value = value * 2 + 4 + get_bits2(byteStreamPtr, 1);
-            if (!get_bits2(byteStreamPtr, 1))
-                value = value * 2 + get_bits2(byteStreamPtr, 1);
+    if (get_bits2(byteStreamPtr, bitStream, 1)) {
+        value = get_bits2(byteStreamPtr, bitStream, 1);
+        if (get_bits2(byteStreamPtr, bitStream, 1)) {
+            value = value * 2 + 4 + get_bits2(byteStreamPtr, bitStream, 1);
+            if (!get_bits2(byteStreamPtr, bitStream, 1))
+                value = value * 2 + get_bits2(byteStreamPtr, bitStream, 1);
         }
         else if (value == 0)
-            value = get_bits2(byteStreamPtr, 1) + 2;
+            value = get_bits2(byteStreamPtr, bitStream, 1) + 2;
     }
     return (value << 8) + get_byte(byteStreamPtr) + 1;
 }
@@ -123,35 +125,36 @@ int RNCunpack2(unsigned char* packed, unsigned long srcSize,
     unsigned char* dstEnd = dst + dstSize;
     unsigned short length, offset, index;
     unsigned short end = 0;
+    unsigned char bitStream = 0;
 
-    get_bits2(&src, 0); //resets bit stream
-    get_bits2(&src, 2); //toss first two bits
+    get_bits2(&src, &bitStream, 0); //resets bit stream
+    get_bits2(&src, &bitStream, 2); //toss first two bits
 
     while (!end && dst < dstEnd && src < srcEnd) {
-        if (!get_bits2(&src, 1)) {
+        if (!get_bits2(&src, &bitStream, 1)) {
             *dst++ = get_byte(&src); //pack bits
         }
         else {
             length = 2;
-            if (!get_bits2(&src, 1)) {
-                length = 4 + get_bits2(&src, 1); //pack length
-                if (get_bits2(&src, 1)) {
-                    length = (length - 1) * 2 + get_bits2(&src, 1);
+            if (!get_bits2(&src, &bitStream, 1)) {
+                length = 4 + get_bits2(&src, &bitStream, 1); //pack length
+                if (get_bits2(&src, &bitStream, 1)) {
+                    length = (length - 1) * 2 + get_bits2(&src, &bitStream, 1);
                     if (length == 9) {
-                        length = (get_bits2(&src, 4) + 3) * 4;
+                        length = (get_bits2(&src, &bitStream, 4) + 3) * 4;
                         for (index = 0; index < length; index++)
                             *dst++ = get_byte(&src);
                         continue;
                     }
                 }
-                offset = get_offset(&src);
+                offset = get_offset(&src, &bitStream);
             }
             else {
-                if (get_bits2(&src, 1)) {
-                    if (get_bits2(&src, 1)) {
+                if (get_bits2(&src, &bitStream, 1)) {
+                    if (get_bits2(&src, &bitStream, 1)) {
                         length = get_byte(&src) + 8;
                         if (length == 8) {
-                            if (!get_bits2(&src, 1))
+                            if (!get_bits2(&src, &bitStream, 1))
                                 end = 1;
                             continue; //restart if length was zero
                         }
@@ -159,7 +162,7 @@ int RNCunpack2(unsigned char* packed, unsigned long srcSize,
                     else {
                         length = 3;
                     }
-                    offset = get_offset(&src);
+                    offset = get_offset(&src, &bitStream);
                 }
                 else {
                     offset = get_byte(&src) + 1;